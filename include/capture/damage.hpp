@@ -0,0 +1,34 @@
+#ifndef CAPTURE_DAMAGE_HPP
+#define CAPTURE_DAMAGE_HPP
+
+#include <vector>
+#include <cstdint>
+
+#include "capture/frame.hpp"
+
+namespace capture
+{
+
+/**
+ * Compares the frames tile by tile, both must have the same size
+ * Uses AVX2 or SSE2 kernels if the processor supports them and tiles are
+ * at least 4 pixels wide. A tile stops being compared at its first difference
+ */
+tile_map compare_tiles(const frame_buffer& previous, const frame_buffer& current, uint32_t tile_size);
+
+/**
+ * Merges the dirty tiles into rectangles. Horizontally adjacent tiles form
+ * one rectangle, which grows downwards as long as the tiles below change
+ * with the same span. Tiles on the right and bottom edge are clipped to the frame
+ */
+std::vector<rect> damage_rects(const tile_map& tiles, uint32_t width, uint32_t height);
+
+/**
+ * Returns the changed regions between the frames
+ * Frames of different size are damaged as a whole
+ */
+std::vector<rect> diff_frames(const frame_buffer& previous, const frame_buffer& current, uint32_t tile_size);
+
+} // namespace capture
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef CAPTURE_FRAME_HPP
+#define CAPTURE_FRAME_HPP
+
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace capture
+{
+
+/// Bytes per pixel, blue, green, red and one unused byte as X11 delivers them
+inline constexpr size_t bytes_per_pixel = 4;
+
+// Area of a frame in pixels
+struct rect
+{
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// Pixels of one captured frame handed out by a frame_pool, rows follow each other without padding
+struct frame_buffer
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+
+    size_t stride() const
+    {
+        return static_cast<size_t>(width) * bytes_per_pixel;
+    }
+
+    uint8_t* row(uint32_t y)
+    {
+        return pixels.data() + y * stride();
+    }
+
+    const uint8_t* row(uint32_t y) const
+    {
+        return pixels.data() + y * stride();
+    }
+};
+
+// Changed state of every tile of a frame compared to the previous frame
+struct tile_map
+{
+    uint32_t tile_size = 0;
+    uint32_t columns = 0;
+    uint32_t rows = 0;
+    std::vector<uint8_t> dirty;                         /// one flag per tile, row by row
+
+    bool is_dirty(uint32_t column, uint32_t row) const
+    {
+        return dirty[static_cast<size_t>(row) * columns + column] != 0;
+    }
+};
+
+// Captured frame with the regions that changed since the previous frame
+// Later stages may skip a frame without damage or only encode its damaged regions
+struct frame
+{
+    std::shared_ptr<const frame_buffer> buffer;         /// returns to the ring when the last frame is released
+    uint64_t sequence = 0;                              /// of the capture, dropped frames leave gaps
+    std::chrono::steady_clock::time_point captured;
+    std::vector<rect> damage;                           /// the whole frame for the first frame of a source
+    tile_map tiles;                                     /// empty for the first frame of a source
+
+    /**
+     * Returns true if the frame equals the previous one and can be sent as skip frame
+     */
+    bool is_static() const
+    {
+        return damage.empty();
+    }
+};
+
+} // namespace capture
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef CAPTURE_FRAME_POOL_HPP
+#define CAPTURE_FRAME_POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "capture/frame.hpp"
+#include "object_pool.hpp"
+
+namespace capture
+{
+
+// Ring of equally sized frame buffers shared by the capture and later stages
+// The number of buffers is fixed, if all of them are in use the capture
+// drops frames instead of allocating more
+class frame_pool : public utils::object_pool<frame_buffer>
+{
+public:
+
+    frame_pool() = delete;
+    frame_pool(const frame_pool&) = delete;
+    frame_pool& operator=(const frame_pool&) = delete;
+    frame_pool(frame_pool&&) = delete;
+    frame_pool& operator=(frame_pool&&) = delete;
+    ~frame_pool() = default;
+
+    /**
+     * Buffers are allocated on first use, at most capacity of them
+     */
+    frame_pool(uint32_t width, uint32_t height, size_t capacity);
+
+    uint32_t width() const
+    {
+        return m_width;
+    }
+
+    uint32_t height() const
+    {
+        return m_height;
+    }
+
+private:
+
+    uint32_t m_width;
+    uint32_t m_height;
+
+};
+
+} // namespace capture
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef CAPTURE_FRAME_SOURCE_HPP
+#define CAPTURE_FRAME_SOURCE_HPP
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+#include "capture/frame.hpp"
+#include "capture/frame_pool.hpp"
+
+namespace capture
+{
+
+enum class capture_backend : uint8_t
+{
+    x11_shm,        /// root window of an X11 display through MIT-SHM
+    test_pattern    /// generated frames with a moving box, needs no display
+};
+
+struct capture_config
+{
+    /// X11 falls back to the test pattern if no display can be opened
+    capture_backend backend = capture_backend::x11_shm;
+
+    /// X11 display name, empty for $DISPLAY
+    std::string display;
+
+    /// Size of the test pattern, X11 captures the size of the root window
+    uint32_t width = 1920;
+    uint32_t height = 1080;
+
+    /// Buffers in the ring, frames are dropped while later stages hold all of them
+    /// At least 2, the previous frame keeps one for the damage tracking
+    size_t ring_size = 4;
+
+    /// Edge length of the tiles compared to find the damaged regions
+    uint32_t tile_size = 64;
+};
+
+// Produces frames of the desktop or a substitute for it
+// The backends only differ in how they fill a buffer, pooling the buffers
+// and tracking the damage between frames is shared by all of them
+class frame_source
+{
+public:
+
+    frame_source() = delete;
+    frame_source(const frame_source&) = delete;
+    frame_source& operator=(const frame_source&) = delete;
+    frame_source(frame_source&&) = delete;
+    frame_source& operator=(frame_source&&) = delete;
+    virtual ~frame_source() = default;
+
+    /**
+     * Creates the source of the configured backend
+     * Falls back to the test pattern if X11 or MIT-SHM is not available
+     */
+    static std::unique_ptr<frame_source> create(const capture_config& config = {});
+
+    /**
+     * Captures the next frame into a buffer of the ring
+     * Returns std::nullopt if all buffers are in use, the frame is dropped
+     * A frame equal to the previous one is a skip frame without damage sharing
+     * the buffer of the previous frame, so static desktops do not fill the ring
+     * Throws std::runtime_error if the backend fails to capture
+     */
+    std::optional<frame> capture();
+
+    /**
+     * Name of the backend producing the frames
+     */
+    virtual std::string_view backend_name() const = 0;
+
+    uint32_t width() const
+    {
+        return m_pool.width();
+    }
+
+    uint32_t height() const
+    {
+        return m_pool.height();
+    }
+
+protected:
+
+    frame_source(uint32_t width, uint32_t height, const capture_config& config);
+
+    /**
+     * Overwrites the whole buffer with the current content
+     */
+    virtual void grab(frame_buffer& buffer) = 0;
+
+private:
+
+    frame_pool m_pool;
+    uint32_t m_tile_size;
+    uint64_t m_sequence = 0;
+    std::shared_ptr<const frame_buffer> m_previous;     /// damage is tracked against this frame
+
+};
+
+} // namespace capture
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef CAPTURE_TEST_PATTERN_SOURCE_HPP
+#define CAPTURE_TEST_PATTERN_SOURCE_HPP
+
+#include <vector>
+#include <cstdint>
+
+#include "capture/frame_source.hpp"
+
+namespace capture
+{
+
+// Static gradient with a box bouncing over it and a frame counter in the
+// top left corner, so consecutive frames only differ in small regions like
+// a desktop does. Used where no display is available
+class test_pattern_source : public frame_source
+{
+public:
+
+    test_pattern_source() = delete;
+    test_pattern_source(const test_pattern_source&) = delete;
+    test_pattern_source& operator=(const test_pattern_source&) = delete;
+    test_pattern_source(test_pattern_source&&) = delete;
+    test_pattern_source& operator=(test_pattern_source&&) = delete;
+    ~test_pattern_source() override = default;
+
+    explicit test_pattern_source(const capture_config& config);
+
+    std::string_view backend_name() const override
+    {
+        return "test pattern";
+    }
+
+protected:
+
+    void grab(frame_buffer& buffer) override;
+
+private:
+
+    std::vector<uint8_t> m_background;      /// one frame of the gradient, copied before drawing
+    uint64_t m_count = 0;
+
+};
+
+} // namespace capture
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef CAPTURE_X11_SOURCE_HPP
+#define CAPTURE_X11_SOURCE_HPP
+
+#include <memory>
+
+#include "capture/frame_source.hpp"
+
+namespace capture
+{
+
+// Captures the root window of an X11 display into a shared memory segment
+// with MIT-SHM, the server writes the pixels without a copy through the socket
+// Only built if X11 with the XShm extension was found (DESK_CAST_X11)
+class x11_source : public frame_source
+{
+public:
+
+    x11_source() = delete;
+    x11_source(const x11_source&) = delete;
+    x11_source& operator=(const x11_source&) = delete;
+    x11_source(x11_source&&) = delete;
+    x11_source& operator=(x11_source&&) = delete;
+    ~x11_source() override;
+
+    /**
+     * Throws std::runtime_error if the display can not be opened, lacks
+     * MIT-SHM or does not use 32 bits per pixel
+     */
+    explicit x11_source(const capture_config& config);
+
+    std::string_view backend_name() const override
+    {
+        return "X11 MIT-SHM";
+    }
+
+protected:
+
+    void grab(frame_buffer& buffer) override;
+
+private:
+
+    // X11 and shared memory state, keeps the X11 headers out of this header
+    struct connection;
+
+    /**
+     * Opens the display and attaches a shared image of the size of its root window
+     */
+    static std::unique_ptr<connection> open(const capture_config& config);
+
+    x11_source(const capture_config& config, std::unique_ptr<connection> conn);
+
+    std::unique_ptr<connection> m_connection;
+
+};
+
+} // namespace capture
+
+#endif
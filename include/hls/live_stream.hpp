@@ -0,0 +1,171 @@
+#ifndef HLS_LIVE_STREAM_HPP
+#define HLS_LIVE_STREAM_HPP
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ctime>
+#include <cstdint>
+
+#include "hls/packet_pool.hpp"
+#include "hls/ts_segmenter.hpp"
+#include "http/request.hpp"
+#include "http/response.hpp"
+
+namespace hls
+{
+
+struct live_config
+{
+    /// Segments are cut at the first random access point after this duration
+    std::chrono::milliseconds target_duration {std::chrono::seconds {2}};
+
+    /// Maximum duration of Low-Latency HLS partial segments, zero serves regular HLS
+    std::chrono::milliseconds part_target {0};
+
+    /// Number of segments listed in the playlist
+    size_t window_size = 6;
+
+    /// Number of segments kept in memory, segments that left the playlist stay
+    /// available for players that are still working on an older playlist
+    size_t retained_segments = 12;
+};
+
+// Finished segment of a live stream, immutable once published
+struct segment
+{
+    uint64_t sequence;
+    double duration;                    /// in seconds
+    bool discontinuity;                 /// timestamps restart, tagged in the playlist
+    packet_chain packets;
+};
+
+// Partial segment of Low-Latency HLS, published while its segment is still recorded
+struct part
+{
+    uint64_t sequence;                  /// of the segment the part belongs to
+    uint32_t index;                     /// within the segment
+    double duration;
+    bool independent;                   /// starts with a random access point
+    packet_chain packets;
+};
+
+// Live HLS stream kept entirely in memory
+// A single producer writes transport stream data which is cut into segments,
+// the last segments form a sliding window. The window is replaced as a whole
+// with every new segment or part, readers take a reference to the current one
+// and render the playlist from it, so serving never blocks the producer.
+// Segments reference the pooled packets they were cut from, responses send
+// them straight from the pool.
+// With a part target the playlist follows Low-Latency HLS: recent segments
+// are listed with their parts, the next part is announced as preload hint and
+// requests for a playlist or part that does not exist yet are parked until
+// the producer publishes it
+class live_stream
+{
+public:
+
+    live_stream(const live_stream&) = delete;
+    live_stream& operator=(const live_stream&) = delete;
+    live_stream(live_stream&&) = delete;
+    live_stream& operator=(live_stream&&) = delete;
+    ~live_stream() = default;
+
+    explicit live_stream(const live_config& config = {});
+
+    /**
+     * Sets the function called after every published segment or part,
+     * usually http::webserver::notify to retry parked requests
+     * Has to be set before the producer starts writing
+     */
+    void set_listener(std::function<void()> listener);
+
+    /**
+     * Consumes transport stream data, only called from the producer thread
+     */
+    void write(std::string_view data);
+
+    /**
+     * Consumes packets written into blocks of pool(), e.g. by a ts_muxer
+     */
+    void write(const packet_slice& packets);
+
+    /**
+     * Returns the pool segments are kept in, producers writing packets
+     * directly should take their blocks from it
+     */
+    const std::shared_ptr<packet_pool>& pool() const
+    {
+        return m_pool;
+    }
+
+    /**
+     * Publishes the last partial segment and marks the playlist as ended
+     */
+    void end();
+
+    /**
+     * Returns the current playlist, empty if no segment was published yet
+     */
+    std::string playlist() const;
+
+    /**
+     * Answers a request for "index.m3u8", a segment or a part listed in it
+     * name is the path of the request relative to the directory of the stream
+     * Blocking playlist reloads and preload hinted parts park the request
+     */
+    void serve(std::string_view name, const http::request& req, http::response& res) const;
+
+    bool low_latency() const
+    {
+        return m_config.part_target.count() > 0;
+    }
+
+private:
+
+    struct window
+    {
+        std::vector<std::shared_ptr<const segment>> segments;  /// oldest first
+        std::vector<std::shared_ptr<const part>> parts;        /// parts of the last segments and the open one
+        uint64_t open_sequence = 0;     /// sequence of the segment currently recorded
+        uint32_t open_parts = 0;        /// parts of the open segment published so far
+        bool open_discontinuity = false;
+        uint64_t target_duration = 0;   /// in whole seconds, never decreases
+        uint64_t discontinuity_sequence = 0;    /// discontinuities before the first segment
+        std::time_t published = 0;
+        bool ended = false;
+    };
+
+    void publish_segment(packet_chain&& packets, double duration, bool discontinuity);
+
+    void publish_part(packet_chain&& packets, double duration, bool independent, bool discontinuity);
+
+    void store(std::shared_ptr<window> next);
+
+    void render(const window& w, std::string& out) const;
+
+    void serve_playlist(const window& w, const http::request& req, http::response& res) const;
+
+    void serve_media(const window& w, std::string_view name, const http::request& req, http::response& res) const;
+
+    std::string etag(uint64_t sequence, uint32_t index, char kind) const;
+
+    live_config m_config;
+    std::shared_ptr<packet_pool> m_pool;
+    ts_segmenter m_segmenter;
+    std::function<void()> m_listener;
+
+    uint64_t m_next_sequence = 0;
+    uint64_t m_stream_id;                   /// start time, keeps entity tags unique across restarts
+
+    std::atomic<std::shared_ptr<const window>> m_window;
+
+};
+
+} // namespace hls
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef HLS_PACKET_POOL_HPP
+#define HLS_PACKET_POOL_HPP
+
+#include <array>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include "hls/ts_packet.hpp"
+#include "object_pool.hpp"
+
+namespace hls
+{
+
+// Fixed size buffer of transport stream packets handed out by a packet_pool
+// Packets are written once by the producer and only read afterwards, so
+// segments and responses reference them instead of copying
+struct packet_block
+{
+    static constexpr size_t capacity = 128;             /// packets
+
+    std::array<uint8_t, capacity * ts::packet_size> data;
+
+    uint8_t* packet(size_t index)
+    {
+        return data.data() + index * ts::packet_size;
+    }
+
+    const uint8_t* packet(size_t index) const
+    {
+        return data.data() + index * ts::packet_size;
+    }
+};
+
+// Consecutive packets of a block, the unit segments and parts are built from
+struct packet_slice
+{
+    std::shared_ptr<const packet_block> block;
+    uint32_t first = 0;
+    uint32_t count = 0;
+
+    std::string_view bytes() const
+    {
+        return {reinterpret_cast<const char*>(block->packet(first)), count * ts::packet_size};
+    }
+};
+
+using packet_chain = std::vector<packet_slice>;
+
+/**
+ * Appends a packet of the block to the chain, extends the last slice if it
+ * ends right before the packet
+ */
+void append_packet(packet_chain& chain, const std::shared_ptr<const packet_block>& block, uint32_t index);
+
+/**
+ * Returns the number of bytes of all slices in the chain
+ */
+size_t chain_size(const packet_chain& chain);
+
+// Recycles packet blocks so a running stream does not allocate per packet
+// Blocks return to the pool when the last segment or response referencing them is released
+using packet_pool = utils::object_pool<packet_block>;
+
+/// Unused blocks a packet pool keeps, about 6 MB of packets
+static constexpr size_t max_free_blocks = 256;
+
+} // namespace hls
+
+#endif
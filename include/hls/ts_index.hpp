@@ -0,0 +1,68 @@
+#ifndef HLS_TS_INDEX_HPP
+#define HLS_TS_INDEX_HPP
+
+#include <chrono>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include "hls/ts_packet.hpp"
+
+namespace hls
+{
+
+// Position where decoding of the key stream can start
+struct ts_keyframe
+{
+    uint64_t offset;                    /// of the first packet of the segment starting here
+    uint64_t pts;
+    bool discontinuity;                 /// timestamps do not continue those before
+    uint64_t previous_end;              /// end of the stream before a discontinuity
+};
+
+// Structure of a transport stream file, enough to cut it into segments
+// without touching the payload again
+struct ts_index
+{
+    uint64_t size = 0;
+    uint16_t pmt_pid = ts::null_pid;
+    uint16_t key_pid = ts::null_pid;    /// video stream, or the first stream if there is none
+    uint16_t pcr_pid = ts::null_pid;
+    std::vector<ts_stream> streams;     /// of the first program
+    std::vector<ts_keyframe> keyframes;
+
+    uint64_t tables_offset = 0;         /// first PAT directly followed by the PMT
+    uint64_t tables_length = 0;         /// zero if the file has no such pair
+
+    uint64_t first_pts = 0;             /// of the key stream
+    uint64_t end_pts = 0;               /// last PTS plus one frame
+    uint64_t first_pcr = 0;
+    uint64_t last_pcr = 0;
+    bool has_pcr = false;
+};
+
+// Byte range of a file played as one segment
+struct ts_range
+{
+    uint64_t offset;
+    uint64_t length;
+    double duration;                    /// in seconds
+    bool discontinuity;
+};
+
+/**
+ * Indexes the packets of a complete transport stream
+ * Only packet headers and the start of key stream PES packets are read, so
+ * the scan runs at memory bandwidth. Bytes outside of packets are skipped
+ */
+ts_index scan_transport_stream(std::string_view data);
+
+/**
+ * Cuts the indexed file at the first key frame after every target duration
+ * The ranges cover the whole file without gaps
+ */
+std::vector<ts_range> cut_segments(const ts_index& index, std::chrono::milliseconds target_duration);
+
+} // namespace hls
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef HLS_TS_MUXER_HPP
+#define HLS_TS_MUXER_HPP
+
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <cstdint>
+
+#include "hls/packet_pool.hpp"
+#include "hls/ts_packet.hpp"
+
+namespace hls
+{
+
+// Multiplexes H.264 video and AAC audio into an MPEG transport stream
+// Every key frame is preceded by PAT and PMT and starts with a random access
+// point, the PCR is carried by the video stream. Access units are written
+// straight into pooled packet blocks, the payload is copied exactly once
+// and everything downstream references the blocks
+class ts_muxer
+{
+public:
+
+    /**
+     * Receives the packets written for one access unit, the slice stays valid
+     * and unchanged as long as it is referenced
+     */
+    using packet_callback = std::function<void(const packet_slice& packets)>;
+
+    static constexpr uint16_t pmt_pid = 0x1000;
+    static constexpr uint16_t video_pid = 0x0100;
+    static constexpr uint16_t audio_pid = 0x0101;
+
+    ts_muxer() = delete;
+    ts_muxer(const ts_muxer&) = delete;
+    ts_muxer& operator=(const ts_muxer&) = delete;
+    ts_muxer(ts_muxer&&) = default;
+    ts_muxer& operator=(ts_muxer&&) = default;
+    ~ts_muxer() = default;
+
+    /**
+     * with_audio adds an AAC stream to the program, it is listed even before
+     * the first audio frame arrives
+     */
+    ts_muxer(std::shared_ptr<packet_pool> pool, packet_callback on_packets, bool with_audio = true);
+
+    /**
+     * Writes an H.264 access unit in Annex B format, timestamps in 90 kHz ticks
+     * An access unit delimiter is inserted if the access unit does not start with one
+     */
+    void write_video(std::string_view access_unit, uint64_t pts, uint64_t dts, bool key_frame);
+
+    /**
+     * Writes one or more AAC frames with ADTS headers, pts in 90 kHz ticks
+     */
+    void write_audio(std::string_view frames, uint64_t pts);
+
+private:
+
+    void write_tables();
+
+    /**
+     * Splits a PES packet into transport stream packets, the PES header is
+     * written in front of the first payload bytes
+     */
+    void write_pes(uint16_t pid, uint8_t& counter, std::string_view header, std::string_view prefix,
+        std::string_view payload, bool random_access, const uint64_t* pcr);
+
+    uint8_t* next_packet();
+
+    /**
+     * Hands the packets written since the last call to the callback
+     */
+    void emit();
+
+    std::shared_ptr<packet_pool> m_pool;
+    packet_callback m_on_packets;
+    bool m_with_audio;
+
+    std::shared_ptr<packet_block> m_block;
+    uint32_t m_block_count = 0;             /// packets written to m_block
+    uint32_t m_emitted = 0;                 /// packets of m_block already handed out
+
+    uint8_t m_pat_counter = 0;
+    uint8_t m_pmt_counter = 0;
+    uint8_t m_video_counter = 0;
+    uint8_t m_audio_counter = 0;
+
+};
+
+} // namespace hls
+
+#endif
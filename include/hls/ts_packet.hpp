@@ -0,0 +1,234 @@
+#ifndef HLS_TS_PACKET_HPP
+#define HLS_TS_PACKET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace hls
+{
+
+// Elementary stream of a program as listed in its PMT
+struct ts_stream
+{
+    uint16_t pid;
+    uint8_t stream_type;
+};
+
+// Helpers to read fields of 188 byte MPEG transport stream packets (ISO 13818-1)
+// All functions expect a complete packet starting with the sync byte
+namespace ts
+{
+
+static constexpr size_t packet_size = 188;
+static constexpr uint8_t sync_byte = 0x47;
+
+static constexpr uint16_t pat_pid = 0x0000;
+static constexpr uint16_t null_pid = 0x1fff;
+
+/// Clock rate of PTS and DTS values
+static constexpr uint64_t pts_clock = 90000;
+static constexpr uint64_t pts_mask = (uint64_t {1} << 33) - 1;
+
+inline uint16_t pid(const uint8_t* packet)
+{
+    return static_cast<uint16_t>(((packet[1] & 0x1f) << 8) | packet[2]);
+}
+
+/**
+ * Returns true if a PES packet or PSI section starts in this packet
+ */
+inline bool payload_unit_start(const uint8_t* packet)
+{
+    return (packet[1] & 0x40) != 0;
+}
+
+inline bool has_adaptation_field(const uint8_t* packet)
+{
+    return (packet[3] & 0x20) != 0;
+}
+
+inline bool has_payload(const uint8_t* packet)
+{
+    return (packet[3] & 0x10) != 0;
+}
+
+inline uint8_t continuity_counter(const uint8_t* packet)
+{
+    return packet[3] & 0x0f;
+}
+
+inline void set_continuity_counter(uint8_t* packet, uint8_t counter)
+{
+    packet[3] = static_cast<uint8_t>((packet[3] & 0xf0) | (counter & 0x0f));
+}
+
+/**
+ * Returns true if the encoder flagged the packet as random access point,
+ * set on the first packet of every key frame
+ */
+inline bool random_access(const uint8_t* packet)
+{
+    return has_adaptation_field(packet) && packet[4] > 0 && (packet[5] & 0x40) != 0;
+}
+
+/**
+ * Returns the offset of the payload or packet_size if there is none
+ */
+inline size_t payload_offset(const uint8_t* packet)
+{
+    if(!has_payload(packet))
+        return packet_size;
+    size_t offset = 4;
+    if(has_adaptation_field(packet))
+        offset += 1 + packet[4];
+    return (offset < packet_size) ? offset : packet_size;
+}
+
+/**
+ * Returns the PTS of the PES packet starting in this packet
+ */
+inline std::optional<uint64_t> pes_pts(const uint8_t* packet)
+{
+    if(!payload_unit_start(packet))
+        return std::nullopt;
+
+    size_t offset = payload_offset(packet);
+    if(offset + 14 > packet_size)
+        return std::nullopt;
+
+    const uint8_t* pes = packet + offset;
+    if(pes[0] != 0x00 || pes[1] != 0x00 || pes[2] != 0x01 || (pes[7] & 0x80) == 0)
+        return std::nullopt;
+
+    const uint8_t* p = pes + 9;
+    return (static_cast<uint64_t>(p[0] & 0x0e) << 29) | (static_cast<uint64_t>(p[1]) << 22) |
+        (static_cast<uint64_t>(p[2] & 0xfe) << 14) | (static_cast<uint64_t>(p[3]) << 7) |
+        (static_cast<uint64_t>(p[4]) >> 1);
+}
+
+/**
+ * Returns the PCR base in 90 kHz ticks if the packet carries one
+ */
+inline std::optional<uint64_t> pcr(const uint8_t* packet)
+{
+    if(!has_adaptation_field(packet) || packet[4] < 7 || (packet[5] & 0x10) == 0)
+        return std::nullopt;
+
+    const uint8_t* p = packet + 6;
+    return (static_cast<uint64_t>(p[0]) << 25) | (static_cast<uint64_t>(p[1]) << 17) |
+        (static_cast<uint64_t>(p[2]) << 9) | (static_cast<uint64_t>(p[3]) << 1) | (p[4] >> 7);
+}
+
+inline bool is_video_stream(uint8_t stream_type)
+{
+    switch(stream_type)
+    {
+        case 0x01:  // MPEG-1 video
+        case 0x02:  // MPEG-2 video
+        case 0x1b:  // H.264
+        case 0x24:  // H.265
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Returns the PSI section starting in the packet and its end within the packet
+ * Returns nullptr if the packet does not start a complete section of the table
+ */
+inline const uint8_t* find_section(const uint8_t* packet, uint8_t table_id, const uint8_t*& end)
+{
+    if(!payload_unit_start(packet))
+        return nullptr;
+
+    size_t offset = payload_offset(packet);
+    if(offset >= packet_size)
+        return nullptr;
+    offset += 1 + packet[offset];      // pointer field
+    if(offset + 3 > packet_size)
+        return nullptr;
+
+    const uint8_t* section = packet + offset;
+    size_t section_length = ((section[1] & 0x0f) << 8) | section[2];
+    if(section[0] != table_id || offset + 3 + section_length > packet_size || section_length < 9)
+        return nullptr;
+
+    end = section + 3 + section_length - 4;     // without CRC
+    return section;
+}
+
+/**
+ * Returns the PMT PID of the first program of the PAT starting in the packet
+ * Returns null_pid if the packet starts no complete PAT or it lists no program
+ */
+inline uint16_t parse_pat(const uint8_t* packet)
+{
+    const uint8_t* end = nullptr;
+    const uint8_t* section = find_section(packet, 0x00, end);
+    if(section == nullptr)
+        return null_pid;
+
+    for(const uint8_t* program = section + 8; program + 4 <= end; program += 4)
+    {
+        uint16_t number = static_cast<uint16_t>((program[0] << 8) | program[1]);
+        if(number == 0)
+            continue;   // network PID
+        return static_cast<uint16_t>(((program[2] & 0x1f) << 8) | program[3]);
+    }
+    return null_pid;
+}
+
+// Streams of a program as listed in its PMT
+struct program_map
+{
+    uint16_t pcr_pid = null_pid;
+    uint16_t key_pid = null_pid;        /// video stream, or the first stream if there is none
+    bool key_is_video = false;
+    std::vector<ts_stream> streams;
+};
+
+/**
+ * Parses the PMT starting in the packet into out, the streams keep their capacity
+ * Returns false if the packet starts no complete PMT or it lists no stream
+ */
+inline bool parse_pmt(const uint8_t* packet, program_map& out)
+{
+    const uint8_t* end = nullptr;
+    const uint8_t* section = find_section(packet, 0x02, end);
+    if(section == nullptr || section + 12 > end)
+        return false;
+
+    out.streams.clear();
+    out.pcr_pid = static_cast<uint16_t>(((section[8] & 0x1f) << 8) | section[9]);
+    size_t program_info_length = ((section[10] & 0x0f) << 8) | section[11];
+    for(const uint8_t* stream = section + 12 + program_info_length; stream + 5 <= end; )
+    {
+        uint16_t pid = static_cast<uint16_t>(((stream[1] & 0x1f) << 8) | stream[2]);
+        out.streams.push_back(ts_stream {pid, stream[0]});
+        stream += 5 + (((stream[3] & 0x0f) << 8) | stream[4]);
+    }
+    if(out.streams.empty())
+        return false;
+
+    out.key_pid = out.streams.front().pid;
+    out.key_is_video = false;
+    for(const auto& stream : out.streams)
+    {
+        if(is_video_stream(stream.stream_type))
+        {
+            out.key_pid = stream.pid;
+            out.key_is_video = true;
+            break;
+        }
+    }
+    return true;
+}
+
+} // namespace ts
+
+} // namespace hls
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef HLS_TS_SEGMENTER_HPP
+#define HLS_TS_SEGMENTER_HPP
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <cstdint>
+
+#include "hls/packet_pool.hpp"
+#include "hls/ts_packet.hpp"
+
+namespace hls
+{
+
+// Cuts a continuous MPEG transport stream into independently decodable segments
+// Segments start at a random access point of the video stream, or of the first
+// stream if there is no video, once the target duration is reached. Every
+// segment begins with the latest PAT and PMT so players can join at any segment
+// With a part target every segment is additionally published in partial
+// segments for Low-Latency HLS, parts start at any frame and never exceed the
+// target as long as the frame rate is constant
+// Segments and parts reference the packets in pooled blocks, only the inserted
+// PAT and PMT copies are written by the segmenter itself
+class ts_segmenter
+{
+public:
+
+    /**
+     * Receives the data of a finished segment and its duration in seconds
+     * discontinuity is set if the timestamps do not continue those of the previous segment
+     */
+    using segment_callback = std::function<void(packet_chain&& packets, double duration, bool discontinuity)>;
+
+    /**
+     * Receives a partial segment before the segment it belongs to is finished
+     * independent is set if the part starts with a random access point,
+     * discontinuity if the segment of the part does not continue the previous one
+     */
+    using part_callback = std::function<void(packet_chain&& packets, double duration, bool independent, bool discontinuity)>;
+
+    ts_segmenter() = delete;
+    ts_segmenter(const ts_segmenter&) = delete;
+    ts_segmenter& operator=(const ts_segmenter&) = delete;
+    ts_segmenter(ts_segmenter&&) = default;
+    ts_segmenter& operator=(ts_segmenter&&) = default;
+    ~ts_segmenter() = default;
+
+    ts_segmenter(std::shared_ptr<packet_pool> pool, std::chrono::milliseconds target_duration, segment_callback on_segment);
+
+    /**
+     * Also publishes parts of at most part_target, a zero target publishes no parts
+     */
+    ts_segmenter(std::shared_ptr<packet_pool> pool, std::chrono::milliseconds target_duration,
+        std::chrono::milliseconds part_target, segment_callback on_segment, part_callback on_part);
+
+    /**
+     * Consumes stream data, the data does not need to be aligned to packets
+     * The data is copied into pooled blocks, bytes before the next sync byte
+     * are skipped if the stream lost sync
+     */
+    void write(std::string_view data);
+
+    /**
+     * Consumes complete packets, e.g. from a ts_muxer, without copying them
+     * The packets must not change after they were written
+     */
+    void write(const packet_slice& packets);
+
+    /**
+     * Finishes the current segment, its duration is estimated from the last timestamp
+     * The next segment is marked as discontinuity
+     */
+    void flush();
+
+private:
+
+    void handle_packet(const std::shared_ptr<const packet_block>& block, uint32_t index);
+
+    /**
+     * Appends the packet to the current segment, PSI packets get their own
+     * continuity counters because copies of them are inserted into every segment
+     */
+    void append(const std::shared_ptr<const packet_block>& block, uint32_t index);
+
+    /**
+     * Appends a copy of a PSI packet with the next continuity counter of its table
+     */
+    void append_psi(const uint8_t* packet, uint8_t& counter);
+
+    void start_segment(uint64_t pts);
+
+    void finish_segment(uint64_t end_pts);
+
+    void finish_part(uint64_t end_pts);
+
+    uint64_t m_target_duration;                 /// in PTS ticks
+    uint64_t m_part_target;                     /// in PTS ticks, zero without parts
+    segment_callback m_on_segment;
+    part_callback m_on_part;
+
+    std::shared_ptr<packet_pool> m_pool;
+    std::shared_ptr<packet_block> m_input;      /// copied stream data, the last packet may be incomplete
+    size_t m_input_size = 0;                    /// in bytes
+    std::shared_ptr<packet_block> m_psi;        /// PAT and PMT copies inserted into the segments
+    uint32_t m_psi_count = 0;                   /// in packets
+
+    std::array<uint8_t, ts::packet_size> m_pat {};
+    std::array<uint8_t, ts::packet_size> m_pmt {};
+    bool m_has_pat = false;
+    bool m_has_pmt = false;
+    uint16_t m_pmt_pid = ts::null_pid;
+    ts::program_map m_program;                  /// its key stream's random access points start segments
+    uint8_t m_pat_counter = 0;
+    uint8_t m_pmt_counter = 0;
+
+    packet_chain m_segment;                     /// empty until the first random access point
+    bool m_in_segment = false;
+    uint64_t m_segment_start = 0;               /// PTS of the first frame of the segment
+    uint64_t m_last_pts = 0;
+    bool m_segment_discontinuity = false;
+    bool m_discontinuity = false;               /// the next segment does not continue the previous one
+
+    packet_chain m_part;                        /// tail of m_segment since the last part
+    uint64_t m_part_start = 0;
+    bool m_part_independent = false;
+    uint64_t m_frame_interval = 0;              /// last distance between two frames, predicts the next one
+
+};
+
+} // namespace hls
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef HLS_VOD_LIBRARY_HPP
+#define HLS_VOD_LIBRARY_HPP
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+#include "hls/ts_index.hpp"
+#include "http/body.hpp"
+#include "http/prepared_cache.hpp"
+#include "http/request.hpp"
+#include "http/response.hpp"
+#include "mp4/fragmenter.hpp"
+
+namespace hls
+{
+
+struct vod_config
+{
+    /// Files are cut at the first key frame after this duration
+    std::chrono::milliseconds target_duration {std::chrono::seconds {6}};
+
+    /// Number of indexed files kept in memory
+    size_t max_entries = 64;
+
+    /// Requests wait this long for a file to be indexed before they are answered with 503
+    std::chrono::milliseconds prepare_timeout {std::chrono::seconds {10}};
+};
+
+// Playlists for transport stream and MP4 files below the media root
+// A file is indexed on the first request for its playlist and cut into
+// segments at key frames. Transport stream segments are byte ranges of the
+// unchanged file, players fetch them from the static file route with range
+// requests. MP4 files are remuxed into fragmented MP4 served by the library
+// itself, an initialization segment and one moof/mdat fragment per segment
+// Files are indexed on a thread of the library, requests for a file that is
+// not indexed yet are parked until it is
+class vod_library
+{
+public:
+
+    vod_library() = delete;
+    vod_library(const vod_library&) = delete;
+    vod_library& operator=(const vod_library&) = delete;
+    vod_library(vod_library&&) = delete;
+    vod_library& operator=(vod_library&&) = delete;
+    ~vod_library() = default;
+
+    /**
+     * Transport stream segment URIs are absolute paths, the media root has to be served under "/"
+     */
+    explicit vod_library(std::string media_root, const vod_config& config = {});
+
+    /**
+     * Answers a request for "<path>.m3u8" with the playlist of "<path>.ts" or,
+     * if there is none, of "<path>.mp4". The fragments of an MP4 file are
+     * "<path>.mp4/init.mp4" and "<path>.mp4/seg<N>.m4s"
+     * name is the path of the request relative to the route of the library
+     */
+    void serve(std::string_view name, const http::request& req, http::response& res);
+
+    /**
+     * Sets the function called whenever a file was indexed, usually
+     * http::webserver::notify to retry the parked requests
+     */
+    void set_listener(std::function<void()> listener)
+    {
+        m_entries.set_listener(std::move(listener));
+    }
+
+private:
+
+    // Indexed version of a file and the playlist generated from it
+    struct entry : http::prepared_file
+    {
+        std::shared_ptr<const ts_index> index;              /// of transport streams
+        std::shared_ptr<mp4::fragmenter> fragments;         /// of MP4 files
+        std::shared_ptr<const std::string> playlist;
+    };
+
+    /**
+     * Returns the entry of the file, nullptr while it is indexed
+     * Throws std::invalid_argument if the file can not be opened
+     */
+    std::shared_ptr<const entry> lookup(const std::string& uri);
+
+    /**
+     * Indexes the file and renders its playlist, runs on the thread of the cache
+     * Throws std::runtime_error if an MP4 file can not be remuxed
+     */
+    void prepare(entry& e, const std::string& uri, const std::shared_ptr<const http::file_handle>& file) const;
+
+    /**
+     * Answers a request for the initialization segment or a fragment of an MP4 file
+     */
+    void serve_fragment(const std::string& uri, std::string_view resource, const http::request& req,
+        http::response& res);
+
+    std::string render(const ts_index& index, const std::string& uri) const;
+
+    std::string render(const mp4::fragmenter& fragments, const std::string& uri) const;
+
+    std::string m_root;
+    vod_config m_config;
+
+    http::prepared_cache<entry> m_entries;              /// by URI of the file
+
+};
+
+} // namespace hls
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef HTTP_BODY_HPP
+#define HTTP_BODY_HPP
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <variant>
+#include <vector>
+#include <ctime>
+#include <cstdint>
+
+namespace http
+{
+
+// Read-only descriptor of a file that is streamed to clients with sendfile
+// Shared between the response and the connection that is still sending it
+class file_handle
+{
+public:
+
+    file_handle() = delete;
+    file_handle(const file_handle&) = delete;
+    file_handle& operator=(const file_handle&) = delete;
+    file_handle(file_handle&&) = delete;
+    file_handle& operator=(file_handle&&) = delete;
+    ~file_handle();
+
+    /**
+     * Opens the file for reading
+     * Throws std::invalid_argument if the file does not exist or is no regular file
+     */
+    explicit file_handle(const std::string& path);
+
+    /**
+     * Takes ownership of an already opened and checked descriptor
+     */
+    file_handle(int fd, size_t size, std::time_t mtime);
+
+    int get() const
+    {
+        return m_fd;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    std::time_t mtime() const
+    {
+        return m_mtime;
+    }
+
+    /**
+     * Reads length bytes from offset on into memory
+     * Throws std::runtime_error if the file ends before or can not be read
+     */
+    std::string read_range(uint64_t offset, size_t length) const;
+
+private:
+
+    int m_fd;
+    size_t m_size = 0;
+    std::time_t m_mtime = 0;
+
+};
+
+// Part of a file used as response body
+struct file_body
+{
+    std::shared_ptr<const file_handle> file;
+    size_t offset = 0;
+    size_t length = 0;
+};
+
+// Immutable memory used as response body without copying it into the response
+// The owner keeps the memory alive until the connection sent it
+struct memory_body
+{
+    std::shared_ptr<const void> owner;
+    std::string_view data;
+};
+
+// Slice of a file or of memory, the pieces bodies are assembled from
+using body_piece = std::variant<file_body, memory_body>;
+
+// Content served in a different layout than stored, e.g. an MP4 file with its
+// index moved to the front. Pieces are ranges of the original file or
+// generated memory in the order they are served
+struct spliced_file
+{
+    std::vector<body_piece> pieces;
+    size_t size = 0;                    /// of all pieces together
+    size_t memory = 0;                  /// held by generated pieces
+};
+
+// One part of a multipart/byteranges body, the part header is followed by
+// a slice of the file or of the cached content
+struct body_part
+{
+    std::string header;
+    body_piece data;
+};
+
+// Several body slices separated by part headers and closed by the trailer
+// The connection queues every part as its own chunk, so the slices are still
+// sent with sendfile or straight from shared memory
+struct multipart_body
+{
+    std::vector<body_part> parts;
+    std::string trailer;
+};
+
+// Body data that is not stored in the response itself
+using body_source = std::variant<std::monostate, file_body, memory_body, multipart_body>;
+
+} // namespace http
+
+#endif
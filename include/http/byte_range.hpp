@@ -0,0 +1,65 @@
+#ifndef HTTP_BYTE_RANGE_HPP
+#define HTTP_BYTE_RANGE_HPP
+
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+#include "http/small_vector.hpp"
+
+namespace http
+{
+
+// Inclusive range of bytes of a representation
+struct byte_range
+{
+    size_t first = 0;
+    size_t last = 0;
+
+    size_t length() const
+    {
+        return last - first + 1;
+    }
+};
+
+enum class range_status : uint8_t
+{
+    none,           /// no or an unparsable Range header, the full representation is sent
+    satisfiable,    /// at least one range overlaps the representation
+    unsatisfiable   /// no range overlaps the representation, answered with 416
+};
+
+// Requests with more ranges are answered with the full representation
+static constexpr size_t max_byte_ranges = 16;
+
+using range_list = small_vector<byte_range, 4>;
+
+/**
+ * Parses the value of a Range header (RFC 7233) for a representation of size bytes
+ * Supports "first-last", open ended "first-" and suffix "-length" specs. The
+ * ranges are clamped to the size and overlapping or adjacent ranges are merged
+ */
+range_status parse_range_header(std::string_view header, size_t size, range_list& out);
+
+// Enough for "bytes " plus three 20 digit numbers and separators
+static constexpr size_t content_range_length = 6 + 3 * 20 + 2;
+
+/**
+ * Writes the Content-Range value "bytes first-last/size" into out
+ */
+std::string_view format_content_range(const byte_range& range, size_t size, char* out);
+
+/**
+ * Writes the Content-Range value "bytes * /size" of an unsatisfiable range into out
+ */
+std::string_view format_unsatisfied_range(size_t size, char* out);
+
+/**
+ * Boundary separating the parts of multipart/byteranges responses
+ * Chosen randomly once per process
+ */
+std::string_view multipart_boundary();
+
+} // namespace http
+
+#endif
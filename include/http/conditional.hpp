@@ -0,0 +1,36 @@
+#ifndef HTTP_CONDITIONAL_HPP
+#define HTTP_CONDITIONAL_HPP
+
+#include <string_view>
+#include <cstdint>
+#include <ctime>
+
+#include "http/request.hpp"
+
+namespace http
+{
+
+enum class condition_result : uint8_t
+{
+    proceed,                /// no precondition or all of them passed
+    not_modified,           /// answer with 304 and without body
+    precondition_failed     /// answer with 412
+};
+
+/**
+ * Evaluates If-Match, If-Unmodified-Since, If-None-Match and If-Modified-Since
+ * in the order of RFC 7232 section 6 against the current validators of the
+ * selected representation
+ */
+condition_result evaluate_conditions(const request& req, std::string_view etag, std::time_t last_modified);
+
+/**
+ * Returns true if the Range header of the request may be applied
+ * A missing If-Range always matches, an entity tag has to match strongly and
+ * a date has to equal the modification time exactly
+ */
+bool if_range_matches(const request& req, std::string_view etag, std::time_t last_modified);
+
+} // namespace http
+
+#endif
@@ -0,0 +1,336 @@
+#ifndef HTTP_CONNECTION_HPP
+#define HTTP_CONNECTION_HPP
+
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <vector>
+#include <array>
+#include <memory>
+#include <optional>
+
+#include <sys/uio.h>
+#include <openssl/ssl.h>
+
+#include "socketwrapper.hpp"
+#include "http/body.hpp"
+#include "http/request.hpp"
+#include "http/request_parser.hpp"
+#include "http/response.hpp"
+
+namespace http
+{
+
+using steady_time = std::chrono::steady_clock::time_point;
+
+// Next piece of queued output handed to the I/O engine
+// Either serialized data optionally followed by shared memory in the iovecs,
+// or a part of a file when iov_count is zero
+struct output_segment
+{
+    std::array<iovec, 2> iov {};
+    size_t iov_count = 0;
+    const file_body* file = nullptr;
+    bool more = false;                  /// file data follows the serialized data
+};
+
+// Non-blocking persistent client connection owned by the event loop
+// Buffers incoming bytes until one or more full requests are available and
+// keeps the unsent part of the responses until the socket is writable again
+class connection
+{
+public:
+
+    connection() = delete;
+    connection(const connection&) = delete;
+    connection& operator=(const connection&) = delete;
+    connection(connection&&) = default;
+    connection& operator=(connection&&) = default;
+    ~connection() = default;
+
+    /**
+     * Takes over the accepted socket
+     * With a TLS context the handshake runs non-blocking as part of reading
+     * and flushing, requests are only parsed once it finished
+     */
+    connection(net::tcp_connection<net::ip_version::v4>&& sock, size_t max_request_size, SSL_CTX* tls_context = nullptr);
+
+    /**
+     * Lets the kernel abort the connection if sent data stays unacknowledged
+     * for the timeout, this covers receivers that stall after the output left
+     * user space and only sits in the socket send buffer
+     */
+    void set_send_timeout(std::chrono::milliseconds timeout);
+
+    /**
+     * Limits the rate the kernel sends data of this socket with, TCP spaces
+     * the packets out instead of sending a whole window at once
+     * Returns false if the kernel does not support pacing
+     */
+    bool set_pacing_rate(uint64_t bytes_per_second);
+
+    /**
+     * Reads the data currently available on the socket into the input buffer
+     * Stops once the input buffer holds max_request_size bytes, input_capped()
+     * tells if the rest has to be read after handling the buffered requests
+     * Returns false if the peer closed the connection or the read failed
+     */
+    bool read_available();
+
+    /**
+     * Returns true if the last read stopped at the size limit of the input buffer
+     */
+    bool input_capped() const
+    {
+        return m_input_capped;
+    }
+
+    /**
+     * Bytes the input buffer may still grow by
+     */
+    size_t input_room() const
+    {
+        size_t limit = m_parser.max_request_size();
+        return (m_input.size() < limit) ? limit - m_input.size() : 0;
+    }
+
+    /**
+     * Writes as much of the pending output as the socket accepts
+     * File bodies go straight from the page cache to the socket with sendfile,
+     * on TLS connections only if the kernel encrypts the records
+     * Returns false if the write failed
+     */
+    bool flush();
+
+    /**
+     * Returns true if the connection waits for the socket to become writable
+     * either to send output or to continue the TLS handshake
+     */
+    bool wants_write() const
+    {
+        return has_pending_output() || m_tls_want_write;
+    }
+
+    bool is_tls() const
+    {
+        return m_ssl != nullptr;
+    }
+
+    /**
+     * Returns true if the handshake or a read waits for the socket to become
+     * writable, read_available() continues it
+     */
+    bool tls_wants_write() const
+    {
+        return m_tls_want_write;
+    }
+
+    /**
+     * Describes the next piece of output without sending it
+     * Returns false if all output was sent
+     */
+    bool next_output(output_segment& segment);
+
+    /**
+     * Marks bytes of the segment returned by next_output() as sent
+     */
+    void consume_output(size_t bytes);
+
+    /**
+     * Grows the input buffer by size bytes for an asynchronous receive
+     * The buffer must not be used until commit_input() was called
+     */
+    char* prepare_input(size_t size);
+
+    /**
+     * Keeps the received bytes of the area returned by prepare_input()
+     */
+    void commit_input(size_t received);
+
+    /**
+     * Serializes the response directly into the output buffer
+     * The body source is sent after the serialized data without copying it
+     */
+    void queue_response(const response& res);
+
+    /**
+     * Removes a handled request from the front of the input buffer and
+     * prepares the parser for the next one
+     */
+    void consume_input(size_t bytes);
+
+    bool has_pending_output() const
+    {
+        return m_pending_bytes > 0;
+    }
+
+    size_t pending_output() const
+    {
+        return m_pending_bytes;
+    }
+
+    std::string_view get_input() const
+    {
+        return m_input;
+    }
+
+    request_parser& get_parser()
+    {
+        return m_parser;
+    }
+
+    int get() const
+    {
+        return m_sock.get();
+    }
+
+    steady_time last_activity() const
+    {
+        return m_last_activity;
+    }
+
+    /**
+     * Returns true while a request or the TLS handshake is partially received
+     */
+    bool reading_request() const
+    {
+        return m_input.size() > m_input_prepared || (m_ssl && !m_handshake_done);
+    }
+
+    steady_time request_started() const
+    {
+        return m_request_started;
+    }
+
+    steady_time last_send_progress() const
+    {
+        return m_last_send_progress;
+    }
+
+    size_t requests_served() const
+    {
+        return m_requests_served;
+    }
+
+    /**
+     * Holds back a request that could not be answered yet
+     * The request has to own its data, no further requests of the connection
+     * are handled until it is answered
+     */
+    void park(request&& req, steady_time deadline)
+    {
+        m_parked = std::move(req);
+        m_park_deadline = deadline;
+    }
+
+    /**
+     * Returns the parked request, the deadline is kept for parking it again
+     */
+    request unpark()
+    {
+        request req = std::move(*m_parked);
+        m_parked.reset();
+        return req;
+    }
+
+    bool parked() const
+    {
+        return m_parked.has_value();
+    }
+
+    steady_time park_deadline() const
+    {
+        return m_park_deadline;
+    }
+
+    void set_close_after_flush()
+    {
+        m_close_after_flush = true;
+    }
+
+    bool close_after_flush() const
+    {
+        return m_close_after_flush;
+    }
+
+    uint32_t get_events() const
+    {
+        return m_events;
+    }
+
+    void set_events(uint32_t events)
+    {
+        m_events = events;
+    }
+
+private:
+
+    // Piece of queued output, serialized data optionally followed by a shared body
+    struct output_chunk
+    {
+        std::string data;
+        size_t data_offset = 0;
+        body_source body;
+    };
+
+    struct ssl_deleter
+    {
+        void operator()(SSL* ssl) const
+        {
+            SSL_free(ssl);
+        }
+    };
+
+    /**
+     * Returns the chunk the next output is appended to
+     */
+    output_chunk& next_chunk();
+
+    /**
+     * Continues the server side TLS handshake
+     * Returns false if the handshake failed
+     */
+    bool handshake();
+
+    bool read_tls();
+
+    /**
+     * Encrypts the pending output with SSL_write, used without kernel TLS
+     */
+    bool flush_tls();
+
+    net::tcp_connection<net::ip_version::v4> m_sock;
+
+    std::string m_input;                /// bytes received but not yet handled
+    size_t m_input_prepared = 0;        /// bytes at the end of m_input reserved for a pending receive
+    bool m_input_capped = false;        /// last read left data in the socket or TLS buffers
+    request_parser m_parser;            /// state of the request at the front of m_input
+    std::vector<output_chunk> m_output; /// responses waiting to be sent, sent chunks are kept for reuse
+    size_t m_output_head = 0;           /// first chunk not completely sent
+    size_t m_output_tail = 0;           /// one past the last queued chunk
+    size_t m_pending_bytes = 0;         /// total number of queued bytes not sent yet
+
+    steady_time m_last_activity;        /// last time data was received or sent
+    steady_time m_request_started;      /// first byte of the partially received request
+    steady_time m_last_send_progress;   /// last time pending output was queued or partially sent
+    size_t m_requests_served = 0;       /// number of responses queued on this connection
+    bool m_close_after_flush = false;
+    uint32_t m_events = 0;              /// epoll events the connection is registered for
+
+    std::optional<request> m_parked;    /// request waiting for content that does not exist yet
+    steady_time m_park_deadline;
+
+    std::unique_ptr<SSL, ssl_deleter> m_ssl;    /// nullptr for plain connections
+    bool m_handshake_done = false;
+    bool m_tls_want_write = false;      /// handshake or read waits for the socket to become writable
+    bool m_ktls_send = false;           /// kernel encrypts sent data, plain syscalls can be used
+
+    std::string m_staging;              /// file data read for SSL_write without kernel TLS
+    size_t m_staged_offset = 0;
+    size_t m_staged_length = 0;
+
+};
+
+} // namespace http
+
+#endif
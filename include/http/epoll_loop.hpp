@@ -0,0 +1,87 @@
+#ifndef HTTP_EPOLL_LOOP_HPP
+#define HTTP_EPOLL_LOOP_HPP
+
+#include <memory>
+#include <unordered_map>
+
+#include "socketwrapper.hpp"
+#include "http/event_loop.hpp"
+
+namespace http
+{
+
+// Level triggered epoll reactor
+// Owns the listening socket and all accepted connections and drives them
+// without ever blocking on a single client
+class epoll_loop : public event_loop
+{
+public:
+
+    epoll_loop() = delete;
+    epoll_loop(const epoll_loop&) = delete;
+    epoll_loop& operator=(const epoll_loop&) = delete;
+    epoll_loop(epoll_loop&&) = delete;
+    epoll_loop& operator=(epoll_loop&&) = delete;
+    ~epoll_loop() override;
+
+    /**
+     * Serves TLS if a context is given
+     */
+    epoll_loop(std::string_view bind_addr, uint16_t port, request_handler handler, const server_config& config = {},
+        std::shared_ptr<SSL_CTX> tls_context = nullptr);
+
+    void run(std::atomic<bool>& run_condition) override;
+
+    std::string_view engine_name() const override
+    {
+        return "epoll";
+    }
+
+private:
+
+    void accept_connection();
+
+    /**
+     * Stops watching the acceptor while descriptors are exhausted, level
+     * triggered it would report the pending connection on every wait
+     */
+    void pause_accept();
+
+    /**
+     * Watches the acceptor again if it was paused
+     */
+    void resume_accept();
+
+    void handle_event(connection& conn, uint32_t events);
+
+    /**
+     * Expires timed out connections and parked requests
+     */
+    void close_expired_connections();
+
+    /**
+     * Retries all parked requests after the loop was woken
+     */
+    void resume_parked();
+
+    void close_connection(int fd);
+
+    void update_events(connection& conn, uint32_t events);
+
+    int m_epollfd;
+
+    net::tcp_acceptor<net::ip_version::v4> m_acceptor;
+
+    std::shared_ptr<SSL_CTX> m_tls_context;    /// shared with all workers, nullptr for plain HTTP
+
+    bool m_accept_paused = false;
+
+    std::unordered_map<int, std::unique_ptr<connection>> m_connections;
+
+    steady_time m_last_sweep;
+
+};
+
+} // namespace http
+
+#endif
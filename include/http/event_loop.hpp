@@ -0,0 +1,136 @@
+#ifndef HTTP_EVENT_LOOP_HPP
+#define HTTP_EVENT_LOOP_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <cstdint>
+
+#include <openssl/ssl.h>
+
+#include "http/connection.hpp"
+#include "http/request.hpp"
+#include "http/response.hpp"
+#include "http/server_config.hpp"
+
+namespace http
+{
+
+/**
+ * Fills the response for the request
+ * The response is cleared before and reused for all requests of the loop
+ * A thrown std::invalid_argument is answered with 400, any other exception with 500
+ */
+using request_handler = std::function<void(const request&, response&)>;
+
+// Single threaded reactor serving the connections of one worker
+// The I/O engines only differ in how they wait for and perform socket I/O,
+// parsing and answering requests is shared by all of them
+class event_loop
+{
+public:
+
+    event_loop() = delete;
+    event_loop(const event_loop&) = delete;
+    event_loop& operator=(const event_loop&) = delete;
+    event_loop(event_loop&&) = delete;
+    event_loop& operator=(event_loop&&) = delete;
+    virtual ~event_loop();
+
+    /**
+     * Creates the loop of the configured I/O engine listening on its own SO_REUSEPORT socket
+     * Falls back to epoll if the kernel does not provide io_uring
+     * Throws std::invalid_argument for a TLS context with the io_uring engine,
+     * TLS is only served by the epoll engine
+     */
+    static std::unique_ptr<event_loop> create(std::string_view bind_addr, uint16_t port, request_handler handler,
+        const server_config& config = {}, std::shared_ptr<SSL_CTX> tls_context = nullptr);
+
+    /**
+     * Runs the loop until run_condition is set to false
+     * The condition is checked at least every poll interval so no wake up
+     * connection is needed to shut the loop down
+     */
+    virtual void run(std::atomic<bool>& run_condition) = 0;
+
+    /**
+     * Name of the I/O engine driving the loop
+     */
+    virtual std::string_view engine_name() const = 0;
+
+    /**
+     * Retries the parked requests of the loop, safe to call from any thread
+     */
+    void wake();
+
+protected:
+
+    event_loop(request_handler handler, const server_config& config);
+
+    /**
+     * Handles all complete requests in the input buffer of the connection
+     * Pipelined requests are answered in order until the pending output
+     * reaches the configured limit
+     * Returns true if at least one request was answered
+     */
+    bool process_requests(connection& conn);
+
+    /**
+     * Applies the send timeout and pacing rate to a newly accepted connection
+     */
+    void configure_connection(connection& conn) const;
+
+    /**
+     * Returns false if the handler parked the request instead of answering it
+     */
+    bool handle_request(connection& conn, const request& req);
+
+    /**
+     * Queues the filled response of the request
+     */
+    void finish_response(connection& conn, const request& req);
+
+    /**
+     * Answers a parked request with 503 once its deadline passed
+     * Returns true if the connection has a new response to send
+     */
+    bool expire_parked(connection& conn, steady_time now);
+
+    /**
+     * Resets the wake up counter after the loop was woken
+     */
+    void drain_wakeup();
+
+    /**
+     * Returns true if the connection exceeded the timeout of its current phase:
+     * sending output, receiving a request or waiting idle for the next one
+     */
+    bool timed_out(const connection& conn, steady_time now) const;
+
+    /**
+     * Tells a client accepted beyond max_connections that the server is busy
+     * The caller closes the socket afterwards
+     */
+    static void refuse_connection(int fd, bool tls);
+
+    /**
+     * Returns true if accept failed with the error because descriptors or socket
+     * memory ran out. Accepting again right away fails the same way, so the
+     * loop waits until a connection closed or the next sweep
+     */
+    static bool out_of_descriptors(int error);
+
+    request_handler m_handler;
+
+    server_config m_config;
+
+    response m_response;                /// scratch response reused for every request
+
+    int m_wakeup;                       /// eventfd the loop waits on besides its sockets
+
+};
+
+} // namespace http
+
+#endif
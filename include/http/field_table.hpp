@@ -0,0 +1,102 @@
+#ifndef HTTP_FIELD_TABLE_HPP
+#define HTTP_FIELD_TABLE_HPP
+
+#include <string_view>
+
+#include "http/small_vector.hpp"
+
+namespace http
+{
+
+inline bool equals_ignore_case(std::string_view lhs, std::string_view rhs)
+{
+    if(lhs.size() != rhs.size())
+        return false;
+
+    for(size_t i = 0; i < lhs.size(); ++i)
+    {
+        char l = (lhs[i] >= 'A' && lhs[i] <= 'Z') ? lhs[i] + ('a' - 'A') : lhs[i];
+        char r = (rhs[i] >= 'A' && rhs[i] <= 'Z') ? rhs[i] + ('a' - 'A') : rhs[i];
+        if(l != r)
+            return false;
+    }
+    return true;
+}
+
+struct field
+{
+    std::string_view name;
+    std::string_view value;
+};
+
+// Flat table of name value pairs viewing into a request buffer
+// Lookups are linear scans which beat any tree or hash for the handful of
+// fields a request carries. Header tables compare names case-insensitive
+template<size_t N>
+class field_table
+{
+public:
+
+    field_table() = default;
+
+    explicit field_table(bool ignore_case)
+        : m_ignore_case {ignore_case}
+    {}
+
+    void add(std::string_view name, std::string_view value)
+    {
+        m_fields.push_back(field {name, value});
+    }
+
+    const field* find(std::string_view name) const
+    {
+        for(const auto& f : m_fields)
+        {
+            if((m_ignore_case) ? equals_ignore_case(f.name, name) : f.name == name)
+                return &f;
+        }
+        return nullptr;
+    }
+
+    bool contains(std::string_view name) const
+    {
+        return find(name) != nullptr;
+    }
+
+    /**
+     * Returns the value of the first field with the name or an empty view if missing
+     */
+    std::string_view get(std::string_view name) const
+    {
+        const field* f = find(name);
+        return (f) ? f->value : std::string_view {};
+    }
+
+    void clear()
+    {
+        m_fields.clear();
+    }
+
+    size_t size() const { return m_fields.size(); }
+
+    bool empty() const { return m_fields.empty(); }
+
+    const field* begin() const { return m_fields.begin(); }
+    const field* end() const { return m_fields.end(); }
+
+    field* begin() { return m_fields.begin(); }
+    field* end() { return m_fields.end(); }
+
+private:
+
+    small_vector<field, N> m_fields;
+    bool m_ignore_case = false;
+
+};
+
+using header_table = field_table<24>;
+using param_table = field_table<8>;
+
+} // namespace http
+
+#endif
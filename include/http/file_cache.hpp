@@ -0,0 +1,204 @@
+#ifndef HTTP_FILE_CACHE_HPP
+#define HTTP_FILE_CACHE_HPP
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <memory>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <ctime>
+#include <cstdint>
+
+#include "http/body.hpp"
+#include "http/job_queue.hpp"
+
+namespace http
+{
+
+/**
+ * Returns the mime type matching the extension of the path
+ */
+std::string_view content_type_of(std::string_view path);
+
+// Metadata and, for small enough files, the content of a file served by the webserver
+struct cached_file
+{
+    std::string path;
+    size_t size = 0;
+    timespec mtime {};
+    std::string_view content_type;
+    std::string etag;                                   /// strong entity tag built from size and mtime
+    std::string last_modified;                          /// mtime as IMF-fixdate for the Last-Modified header
+    std::string header_block;                           /// validator and CORS header lines of every response
+    std::shared_ptr<const std::string> content;         /// nullptr if the file exceeds the entry limit
+    std::shared_ptr<const file_handle> file;            /// open descriptor of files not held in memory
+    std::shared_ptr<const spliced_file> spliced;        /// served instead of the stored layout if set
+};
+
+/**
+ * Presents a loaded file in a different layout, e.g. to move the index of an
+ * MP4 file to the front. Returns nullptr to serve the file as stored
+ * The pieces may reference the content or the descriptor of the entry
+ */
+using file_transform = std::function<std::shared_ptr<const spliced_file>(const cached_file& entry)>;
+
+/**
+ * Server and CORS header lines every media response carries, for responses
+ * without a header block of their own
+ */
+std::string_view common_header_block();
+
+/**
+ * Appends the common header lines and the entity tag to out, for content
+ * served by a route of its own that has no cached_file
+ */
+void format_header_block(std::string& out, std::string_view etag);
+
+/**
+ * Fills the header block of the entry from its validators
+ */
+void format_header_block(cached_file& entry);
+
+/**
+ * Appends the path to out without empty and "." segments, so every file has
+ * exactly one cache key. Returns false for ".." segments that could leave the root
+ */
+bool append_normalized(std::string& out, std::string_view path);
+
+// Memory budgeted LRU cache of files keyed by their path
+// Small files are cached with their content, larger ones with their open
+// descriptor and metadata, so a hit needs no open or stat. The directories
+// of cached files are watched with inotify and entries are dropped as soon
+// as their file changes. Without inotify every lookup revalidates the entry
+// with the modification time of the file instead
+// Transforms run on a thread of the cache, a file is only served once its
+// transform finished so every version has a single layout
+class file_cache
+{
+public:
+
+    file_cache() = delete;
+    file_cache(const file_cache&) = delete;
+    file_cache& operator=(const file_cache&) = delete;
+    file_cache(file_cache&&) = delete;
+    file_cache& operator=(file_cache&&) = delete;
+    ~file_cache();
+
+    /**
+     * max_entries bounds the number of entries and with it the open descriptors
+     */
+    file_cache(size_t memory_budget, size_t max_entry_size, size_t max_entries);
+
+    /**
+     * Returns the cached entry of the file, loading it from disk if missing or outdated
+     * Returns nullptr while the transform of the file runs, the request has to be
+     * parked until the listener is called
+     * Throws std::invalid_argument if the file does not exist or is no regular file
+     */
+    std::shared_ptr<const cached_file> get(const std::string& path);
+
+    /**
+     * Sets the function called whenever a transform finished, usually
+     * http::webserver::notify to retry the parked requests
+     */
+    void set_listener(std::function<void()> listener)
+    {
+        m_jobs.set_listener(std::move(listener));
+    }
+
+    size_t memory_usage() const;
+
+    /**
+     * Applies the transform to every file of the content type when it is loaded
+     * Only allowed before the cache is used by the workers
+     */
+    void add_transform(std::string_view content_type, file_transform transform);
+
+    /**
+     * Drops all entries, responses still sending an entry keep it alive
+     */
+    void clear();
+
+private:
+
+    struct slot
+    {
+        std::shared_ptr<const cached_file> entry;
+        bool watched;                   /// invalidated by inotify, no revalidation on lookup
+        bool transforming;              /// loaded, but not served before the transform replaced it
+    };
+
+    struct pending_load
+    {
+        size_t count = 0;               /// workers currently reading the file
+        bool stale = false;             /// the file changed while it was read
+    };
+
+    using lru_list = std::list<slot>;
+
+    std::shared_ptr<const cached_file> load(const std::string& path) const;
+
+    /**
+     * Marks the current entry as most recently used and returns it
+     * Returns nullptr while its transform runs
+     */
+    std::shared_ptr<const cached_file> use(lru_list::iterator it);
+
+    bool has_transform(const cached_file& entry) const;
+
+    void apply_transform(cached_file& entry) const;
+
+    /**
+     * Queues the transform of the loaded entry, its result replaces the entry
+     * if the file did not change in the meantime
+     */
+    void queue_transform(std::shared_ptr<const cached_file> entry);
+
+    void insert(std::shared_ptr<const cached_file> entry, bool watched, bool transforming = false);
+
+    void erase(lru_list::iterator it);
+
+    /**
+     * Ends a load started by get(), returns true if the file changed in the meantime
+     */
+    bool finish_load(const std::string& path);
+
+    /**
+     * Adds an inotify watch for the directory of the path if there is none yet
+     * Returns false if the directory can not be watched
+     */
+    bool watch_directory(std::string_view path);
+
+    /**
+     * Reads inotify events and drops the entries of changed files until the cache is destroyed
+     */
+    void watch_changes();
+
+    size_t m_memory_budget;
+    size_t m_max_entry_size;
+    size_t m_max_entries;
+    size_t m_memory_usage = 0;
+
+    lru_list m_lru;                                             /// most recently used entry first
+    std::unordered_map<std::string_view, lru_list::iterator> m_index;   /// keys point into the entries path
+
+    int m_inotify = -1;                                         /// -1 if inotify is not available
+    int m_wakeup = -1;                                          /// eventfd stopping the watcher
+    std::unordered_map<int, std::string> m_watches;             /// directory of every watch descriptor
+    std::unordered_map<std::string, int> m_watched_dirs;
+    std::unordered_map<std::string, pending_load> m_loads;      /// files read outside the lock right now
+    std::unordered_map<std::string, file_transform> m_transforms;   /// by content type, read-only while serving
+    std::thread m_watcher;
+
+    mutable std::mutex m_mutex;
+
+    job_queue m_jobs;                                           /// last, transforms use all other members
+
+};
+
+} // namespace http
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef HTTP_HTTP_DATE_HPP
+#define HTTP_HTTP_DATE_HPP
+
+#include <string_view>
+#include <ctime>
+
+namespace http
+{
+
+// Length of an IMF-fixdate like "Sun, 06 Nov 1994 08:49:37 GMT"
+static constexpr size_t http_date_length = 29;
+
+/**
+ * Writes the IMF-fixdate of the time to out which must hold http_date_length chars
+ */
+void format_http_date(std::time_t time, char* out);
+
+/**
+ * Parses an IMF-fixdate as sent in If-Modified-Since and similar headers
+ * The obsolete RFC 850 and asctime formats are not accepted, callers ignore
+ * headers that fail to parse
+ */
+bool parse_http_date(std::string_view date, std::time_t& out);
+
+/**
+ * Returns the current time as IMF-fixdate
+ * The string is formatted at most once per second and thread, the view is
+ * valid until the next call on the same thread
+ */
+std::string_view current_http_date();
+
+} // namespace http
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef HTTP_JOB_QUEUE_HPP
+#define HTTP_JOB_QUEUE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+
+namespace http
+{
+
+// Runs slow work like indexing or transcoding a file on a thread of its own
+// Handlers post a job and park the request instead of blocking their event
+// loop, the listener is called after every job so parked requests are retried
+class job_queue
+{
+public:
+
+    job_queue(const job_queue&) = delete;
+    job_queue& operator=(const job_queue&) = delete;
+    job_queue(job_queue&&) = delete;
+    job_queue& operator=(job_queue&&) = delete;
+
+    job_queue();
+
+    /**
+     * Drops the queued jobs and waits for the running one
+     */
+    ~job_queue();
+
+    /**
+     * Sets the function called after every finished job, usually
+     * http::webserver::notify. Once it returns the previous function is
+     * not running and is never called again
+     */
+    void set_listener(std::function<void()> listener);
+
+    /**
+     * Queues the job unless a job with the same key is queued or running
+     * Exceptions of the job are ignored, it has to record failures itself
+     * Returns false if the key was already pending
+     */
+    bool post(std::string key, std::function<void()> job);
+
+private:
+
+    struct job
+    {
+        std::string key;
+        std::function<void()> work;
+    };
+
+    void run();
+
+    std::deque<job> m_jobs;
+    std::unordered_set<std::string> m_pending;      /// keys of queued and running jobs
+    bool m_stopping = false;
+
+    std::mutex m_mutex;
+    std::function<void()> m_listener;
+    std::mutex m_listener_mutex;                    /// held while the listener runs
+    std::condition_variable m_wakeup;
+    std::thread m_worker;                           /// started last, it uses all other members
+
+};
+
+} // namespace http
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef HTTP_PREPARED_CACHE_HPP
+#define HTTP_PREPARED_CACHE_HPP
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <ctime>
+#include <cstdint>
+
+#include "http/body.hpp"
+#include "http/file_cache.hpp"
+#include "http/job_queue.hpp"
+#include "http/text.hpp"
+
+namespace http
+{
+
+// Validators and headers of content prepared from a file, e.g. a playlist
+// indexed from a recording or a scaled image
+struct prepared_file
+{
+    std::string etag;
+    std::string header_block;           /// common header lines and the entity tag
+    int failure = 0;                    /// status code answered instead if the file could not be prepared
+    std::time_t mtime = 0;              /// of the file the content was prepared from
+    uint64_t size = 0;
+};
+
+// LRU cache of content that is expensive to prepare from a file
+// Preparing runs on a thread of the cache, lookups of a file that is not
+// prepared yet return nullptr and the request is parked until the listener
+// retries it. Entries are revalidated with the modification time and size of
+// the file on every lookup. Entry has to derive from prepared_file
+template<typename Entry>
+class prepared_cache
+{
+    static_assert(std::is_base_of_v<prepared_file, Entry>, "Entries have to derive from prepared_file");
+
+public:
+
+    /**
+     * Fills the entry from the file, may append a variant like a resolution
+     * to the open entity tag. Throwing stores the entry as failure
+     */
+    using prepare_function = std::function<void(Entry& entry, const std::shared_ptr<const file_handle>& file)>;
+
+    prepared_cache() = delete;
+    prepared_cache(const prepared_cache&) = delete;
+    prepared_cache& operator=(const prepared_cache&) = delete;
+    prepared_cache(prepared_cache&&) = delete;
+    prepared_cache& operator=(prepared_cache&&) = delete;
+    ~prepared_cache() = default;
+
+    /**
+     * tag_kind starts the entity tags, so tags of different caches never match
+     */
+    prepared_cache(size_t max_entries, char tag_kind)
+        : m_max_entries {std::max<size_t>(max_entries, 1)}, m_tag_kind {tag_kind}
+    {}
+
+    /**
+     * Sets the function called whenever an entry was prepared, usually
+     * http::webserver::notify to retry the parked requests
+     */
+    void set_listener(std::function<void()> listener)
+    {
+        m_jobs.set_listener(std::move(listener));
+    }
+
+    /**
+     * Returns the entry of the key if it was prepared from the current version of the file
+     * Otherwise queues preparing it and returns nullptr, the request has to be parked
+     * Throws std::invalid_argument if the file can not be opened
+     */
+    std::shared_ptr<const Entry> lookup(const std::string& key, const std::string& path, prepare_function prepare)
+    {
+        auto file = std::make_shared<const file_handle>(path);
+        {
+            std::lock_guard<std::mutex> lock {m_mutex};
+            auto it = m_entries.find(key);
+            if(it != m_entries.end() && it->second.prepared->mtime == file->mtime() && it->second.prepared->size == file->size())
+            {
+                it->second.last_use = ++m_uses;
+                return it->second.prepared;
+            }
+        }
+
+        // Preparing reads the whole file, it must not block the event loop of the request
+        m_jobs.post(key, [this, key, file = std::move(file), prepare = std::move(prepare)]() {
+            store(key, build(file, prepare));
+        });
+        return nullptr;
+    }
+
+private:
+
+    struct slot
+    {
+        std::shared_ptr<const Entry> prepared;
+        uint64_t last_use;
+    };
+
+    std::shared_ptr<const Entry> build(const std::shared_ptr<const file_handle>& file, const prepare_function& prepare) const
+    {
+        auto next = std::make_shared<Entry>();
+        next->mtime = file->mtime();
+        next->size = file->size();
+        next->etag.push_back('"');
+        next->etag.push_back(m_tag_kind);
+        append_number(next->etag, static_cast<uint64_t>(next->mtime));
+        next->etag.push_back('-');
+        append_number(next->etag, next->size);
+        try {
+            prepare(*next, file);
+        } catch(std::exception&) {
+            // Kept like content, requests are not parked again until the file changes
+            next->failure = 415;
+        }
+        next->etag.push_back('"');
+        format_header_block(next->header_block, next->etag);
+        return next;
+    }
+
+    void store(const std::string& key, std::shared_ptr<const Entry> next)
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        if(m_entries.size() >= m_max_entries && m_entries.find(key) == m_entries.end())
+        {
+            auto oldest = std::min_element(m_entries.begin(), m_entries.end(), [](const auto& a, const auto& b) {
+                return a.second.last_use < b.second.last_use;
+            });
+            m_entries.erase(oldest);
+        }
+        m_entries[key] = slot {std::move(next), ++m_uses};
+    }
+
+    size_t m_max_entries;
+    char m_tag_kind;
+
+    std::unordered_map<std::string, slot> m_entries;
+    uint64_t m_uses = 0;
+    std::mutex m_mutex;
+
+    job_queue m_jobs;                   /// last, its thread is joined before the entries go
+
+};
+
+} // namespace http
+
+#endif
@@ -3,38 +3,62 @@
 
 #include <string>
 #include <string_view>
-#include <sstream>
-#include <istream>
-#include <iterator>
 #include <map>
-#include <vector>
-#include <memory>
 
 #include "http/cookie.hpp"
+#include "http/field_table.hpp"
 
 namespace http {
 
+// Parsed HTTP request
+// All parts are views, either into the input buffer of the connection the
+// request was parsed from or into the own copy created by parse(). Parsing a
+// request with a usual amount of headers and parameters does not allocate
 class request {
 
 public:
 
     request() = default;
-    request(const request& other) = default;
+    request(const request& other);
     request(request&& other) noexcept;
-    request& operator=(const request& other) = default;
-    request& operator=(request&& other);
+    request& operator=(const request& other);
+    request& operator=(request&& other) noexcept;
+    ~request() = default;
 
     explicit request(const char* request_string);
 
+    /**
+     * Copies and parses a complete request
+     * Throws std::invalid_argument if the request is malformed or incomplete
+     */
     void parse(const char *request);
 
     std::string to_string() const;
 
-    bool check_header(const std::string& key) const;
+    /**
+     * Copies the buffer the request was parsed from into the request, so it
+     * stays valid after the connection consumed its input
+     */
+    void own(std::string_view source);
 
-    std::map<std::string_view, std::string_view> get_headers() const { return m_headers; }
+    bool check_header(std::string_view key) const
+    {
+        return m_headers.contains(key);
+    }
 
-    std::string_view get_header(const std::string& key) const;
+    const header_table& get_headers() const
+    {
+        return m_headers;
+    }
+
+    /**
+     * Returns the value of the header, the name is compared case-insensitive
+     * Returns an empty view if the header is missing
+     */
+    std::string_view get_header(std::string_view key) const
+    {
+        return m_headers.get(key);
+    }
 
     std::string_view get_method() const
     {
@@ -56,30 +80,47 @@ public:
         return m_path;
     }
 
-    std::map<std::string_view, std::string_view> get_params() const
+    const param_table& get_params() const
     {
         return m_query_params;
     }
 
-    std::string_view get_param(const std::string& key) const;
+    std::string_view get_param(std::string_view key) const
+    {
+        return m_query_params.get(key);
+    }
 
-    std::map<std::string, cookie> get_cookies() const { return m_cookies; }
+    /**
+     * Parses the Cookie header on every call, cookies are not needed on the hot path
+     */
+    std::map<std::string, cookie> get_cookies() const;
 
     cookie get_cookie(const std::string &cookie_name) const;
 
-    std::map<std::string_view, std::string_view> get_post_params() const { return m_body_params; }
+    const param_table& get_post_params() const
+    {
+        return m_body_params;
+    }
 
-    std::string_view get_post_param(const std::string &key) const;
+    std::string_view get_post_param(std::string_view key) const
+    {
+        return m_body_params.get(key);
+    }
 
 private:
 
-    void parse_requestline(std::string_view requestline);
+    friend class request_parser;
+
+    static void parse_params(std::string_view param_string, param_table& param_container);
 
-    static void parse_params(std::string_view param_string, std::map<std::string_view, std::string_view>& param_container);
+    /**
+     * Moves all views pointing into the buffer at old_base into m_request
+     */
+    void rebase(const char* old_base, size_t old_size);
 
-    void parse_cookies(const std::string &cookies);
+    void clear();
 
-    std::string m_request;    /// unparsed request
+    std::string m_request;    /// unparsed request, only used if the request owns its data
 
     std::string_view m_method;     /// http method used by this request (e.g. post, get, ...)
     std::string_view m_protocol;   /// protocol of this request - should be HTTP/*.*
@@ -87,10 +128,9 @@ private:
     std::string_view m_path;       /// path of the resource addressed by this request
     std::string_view m_fragment;   /// TODO parse fragment?!
 
-    std::map<std::string_view, std::string_view> m_query_params; /// contains names and values of the query string
-    std::map<std::string_view, std::string_view> m_headers; /// contains names and values of the http request headers
-    std::map<std::string, cookie> m_cookies; /// contains names and values of the cookies
-    std::map<std::string_view, std::string_view> m_body_params; /// Contains post params from the requests body
+    param_table m_query_params;         /// contains names and values of the query string
+    header_table m_headers {true};      /// contains names and values of the http request headers
+    param_table m_body_params;          /// Contains post params from the requests body
 
 };
 
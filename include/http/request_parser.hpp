@@ -0,0 +1,130 @@
+#ifndef HTTP_REQUEST_PARSER_HPP
+#define HTTP_REQUEST_PARSER_HPP
+
+#include <string_view>
+#include <cstdint>
+
+#include "http/request.hpp"
+#include "http/small_vector.hpp"
+
+namespace http
+{
+
+enum class parse_status : uint8_t
+{
+    need_more,
+    complete,
+    error,
+    too_large       /// request exceeds the size limit
+};
+
+// Resumable HTTP/1.x request parser
+// The parser is fed with the buffered input of a connection whenever new data
+// arrived and continues where the previous call stopped. Positions are stored
+// as offsets so the caller may grow or move its buffer between calls
+class request_parser
+{
+public:
+
+    request_parser() = default;
+    request_parser(const request_parser&) = default;
+    request_parser& operator=(const request_parser&) = default;
+    request_parser(request_parser&&) = default;
+    request_parser& operator=(request_parser&&) = default;
+    ~request_parser() = default;
+
+    explicit request_parser(size_t max_request_size)
+        : m_max_request_size {max_request_size}
+    {}
+
+    /**
+     * Continues parsing the request at the front of data
+     * data must start with the same bytes as in the previous call
+     * On complete the request is filled with views into data, so data has to
+     * outlive the request
+     */
+    parse_status parse(std::string_view data, request& req);
+
+    /**
+     * Length of the complete request including its body
+     */
+    size_t consumed() const
+    {
+        return m_pos;
+    }
+
+    /**
+     * Returns true once the header block of the request was parsed
+     */
+    bool headers_complete() const
+    {
+        return m_state == state::body || m_state == state::done;
+    }
+
+    size_t max_request_size() const
+    {
+        return m_max_request_size;
+    }
+
+    /**
+     * Prepares the parser for the next request on the same connection
+     */
+    void reset();
+
+private:
+
+    enum class state : uint8_t
+    {
+        method,
+        target,
+        version,
+        request_line_end,
+        header_start,
+        header_name,
+        header_value_start,
+        header_value,
+        header_line_end,
+        headers_end,
+        body,
+        done
+    };
+
+    struct token
+    {
+        uint32_t start = 0;
+        uint32_t end = 0;
+    };
+
+    struct header_token
+    {
+        token name;
+        token value;
+    };
+
+    parse_status scan(std::string_view data);
+
+    /**
+     * Reads the body length from the parsed headers
+     * Returns need_more if the body may follow, too_large if headers and body
+     * together exceed the limit
+     */
+    parse_status prepare_body(std::string_view data);
+
+    void fill_request(std::string_view data, request& req) const;
+
+    size_t m_max_request_size = 64 * 1024;
+
+    state m_state = state::method;
+    size_t m_pos = 0;                   /// offset of the next byte to look at
+    size_t m_body_length = 0;
+
+    token m_method;
+    token m_target;
+    token m_version;
+    small_vector<header_token, 24> m_headers;
+
+};
+
+} // namespace http
+
+#endif
@@ -2,53 +2,146 @@
 #define HTTP_RESPONSE_HPP
 
 #include <string>
+#include <string_view>
 #include <map>
+#include <vector>
 #include <memory>
-#include <list>
 #include <variant>
 #include <exception>
 #include <mutex>
+#include <chrono>
 
-#include "http/request.hpp"
+#include "http/cookie.hpp"
+#include "http/body.hpp"
 
 namespace http
 {
 
+// HTTP response meant to be reused for every response of a connection
+// clear() keeps the memory of headers, phrase and body so building the next
+// response does not allocate once the connection is warmed up
 class response
 {
 public:
 
     response() = default;
 
-    explicit response(const request& req) 
-        : m_req {req}
-    {}
+    /**
+     * Appends the serialized response to out
+     * Status line, cached Date header, cookies, headers and an in-memory body
+     * are written directly into the buffer without temporary strings
+     */
+    void write_to(std::string& out) const;
 
-    std::string to_string();
+    std::string to_string() const;
+
+    /**
+     * Resets the response for the next request while keeping allocated memory
+     */
+    void clear();
 
     void set_body_from_file(const std::string& bodyFile);
 
     void send_redirect(const std::string& url);
 
-    void set_header(const std::string& key, const std::string& value);
+    /**
+     * Sets or replaces a header, names are compared case-insensitive
+     */
+    void set_header(std::string_view key, std::string_view value);
+
+    void set_header(std::string_view key, uint64_t value);
+
+    bool has_header(std::string_view key) const;
 
-    void set_header(const std::string& key, std::string&& value);
+    /**
+     * Adds preformatted header lines, each terminated by CRLF, without copying them
+     * The owner keeps the block alive until the response is serialized. Names
+     * in the block are not seen by has_header and must not be set again
+     */
+    void set_header_block(std::shared_ptr<const void> owner, std::string_view block);
 
     void add_cookie(cookie&& cookie);
 
     void set_code(int code)
     {
         m_code = code;
+        m_phrase.clear();
     }
 
-    void set_code(int code, std::string&& phrase) 
+    void set_code(int code, std::string_view phrase) 
     {
-        m_code = code; m_phrase = std::move(phrase);
+        m_code = code;
+        m_phrase.assign(phrase);
     }
 
-    void set_body(const std::string& body);
+    void set_body(std::string_view body);
 
-    void set_body(std::string&& body);
+    /**
+     * Answers with the status code and an empty body
+     */
+    void reject(int code)
+    {
+        set_code(code);
+        set_body("");
+    }
+
+    /**
+     * Uses a part of an open file as body
+     * The file content is not read into the response, write_to only writes
+     * the header block and the file is sent afterwards with sendfile
+     */
+    void set_body_file(std::shared_ptr<const file_handle> file, size_t offset, size_t length);
+
+    /**
+     * Uses shared immutable memory as body without copying it
+     * write_to only writes the header block, the data is sent afterwards
+     */
+    void set_body_shared(std::shared_ptr<const void> owner, std::string_view data);
+
+    /**
+     * Uses several slices as multipart body
+     * Content-Length covers part headers, slices and trailer, the caller sets
+     * the multipart Content-Type including the boundary
+     */
+    void set_body_multipart(multipart_body&& body);
+
+    /**
+     * Uses several file ranges and slices of shared immutable memory as one
+     * body, e.g. media kept in pooled buffers or a remuxed file, every piece
+     * is sent straight from its owner
+     */
+    void set_body_pieces(std::vector<body_piece>&& pieces);
+
+    /**
+     * Asks the event loop to hold the request back instead of answering it
+     * The handler is called again whenever the worker is woken up, if it still
+     * parks the request when the timeout elapsed the loop answers with 503
+     */
+    void park(std::chrono::milliseconds timeout)
+    {
+        m_parked = true;
+        m_park_timeout = timeout;
+    }
+
+    bool parked() const
+    {
+        return m_parked;
+    }
+
+    std::chrono::milliseconds park_timeout() const
+    {
+        return m_park_timeout;
+    }
+
+    /**
+     * Drops the body but keeps its Content-Length, used to answer HEAD requests
+     */
+    void omit_body();
+
+    const body_source& get_body_source() const
+    {
+        return m_body_source;
+    }
 
     int get_code() const
     {
@@ -57,13 +150,25 @@ public:
 
 private:
 
-    request m_req;                     /// Request from the client to answer with this response
+    struct header
+    {
+        std::string name;
+        std::string value;
+    };
+
+    header& header_slot(std::string_view key);
 
     int m_code = 0;
+    bool m_parked = false;
+    std::chrono::milliseconds m_park_timeout {0};
     std::string m_phrase;
     std::string m_body;
+    body_source m_body_source;          /// body data sent after the serialized response
 
-    std::map<std::string, std::string> m_headers;
+    std::vector<header> m_headers;      /// slots beyond m_header_count are kept for reuse
+    size_t m_header_count = 0;
+    std::shared_ptr<const void> m_header_block_owner;
+    std::string_view m_header_block;
     std::map<std::string, cookie> m_cookies;
 
     static std::mutex c_file_mutex;
@@ -0,0 +1,125 @@
+#ifndef HTTP_ROUTER_HPP
+#define HTTP_ROUTER_HPP
+
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include "http/request.hpp"
+#include "http/response.hpp"
+
+namespace http
+{
+
+/**
+ * Fills the response for a request matched by a route
+ * Same signature as the request handler of the event loops
+ */
+using route_handler = std::function<void(const request&, response&)>;
+
+// Methods a route answers, combined as bit mask
+namespace methods
+{
+    static constexpr uint8_t get = 1 << 0;
+    static constexpr uint8_t head = 1 << 1;
+    static constexpr uint8_t post = 1 << 2;
+    static constexpr uint8_t put = 1 << 3;
+    static constexpr uint8_t del = 1 << 4;
+    static constexpr uint8_t options = 1 << 5;
+
+    static constexpr uint8_t read = get | head | options;
+
+    /**
+     * Returns the bit of the method or zero for unknown methods
+     */
+    uint8_t from_string(std::string_view method);
+} // namespace methods
+
+enum class match_kind : uint8_t
+{
+    exact,      /// the path has to equal the pattern
+    prefix      /// the path starts with the pattern, the longest matching prefix wins
+};
+
+// Maps request paths onto handlers
+// Routes are compiled into a flat byte-wise prefix trie once all of them are
+// added. A lookup walks the path once and does a binary search over at most
+// 256 edges per byte, so its cost only depends on the path length and not on
+// the number of routes
+class router
+{
+public:
+
+    router() = default;
+    router(const router&) = delete;
+    router& operator=(const router&) = delete;
+    router(router&&) = default;
+    router& operator=(router&&) = default;
+    ~router() = default;
+
+    /**
+     * Adds or replaces the route of the pattern
+     * An exact route takes precedence over a prefix route with the same pattern
+     * Throws std::logic_error once the router is compiled
+     */
+    void add(std::string_view pattern, match_kind kind, uint8_t allowed_methods, route_handler handler);
+
+    /**
+     * Builds the lookup tables, no routes can be added afterwards
+     */
+    void compile();
+
+    bool compiled() const
+    {
+        return m_compiled;
+    }
+
+    /**
+     * Calls the handler of the route matching the request
+     * Answers 404 if no route matches and 405 if the route does not allow the method
+     */
+    void dispatch(const request& req, response& res) const;
+
+private:
+
+    struct route
+    {
+        uint8_t allowed_methods;
+        std::string allow;              /// value of the Allow header for 405 responses
+        route_handler handler;
+    };
+
+    struct node
+    {
+        uint32_t first_edge = 0;
+        uint32_t edge_count = 0;
+        int32_t exact = -1;             /// route ending at this node
+        int32_t prefix = -1;            /// route matching everything below this node
+    };
+
+    struct edge
+    {
+        unsigned char byte;
+        uint32_t target;
+    };
+
+    /**
+     * Returns the index of the route matching the path or -1
+     */
+    int32_t find(std::string_view path) const;
+
+    std::vector<route> m_routes;
+    std::vector<node> m_nodes {1};      /// root at index zero
+    std::vector<edge> m_edges;          /// children of a node are contiguous and sorted by byte
+
+    std::vector<std::map<unsigned char, uint32_t>> m_children {1};   /// trie under construction, dropped by compile()
+    bool m_compiled = false;
+
+};
+
+} // namespace http
+
+#endif
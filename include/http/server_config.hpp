@@ -0,0 +1,85 @@
+#ifndef HTTP_SERVER_CONFIG_HPP
+#define HTTP_SERVER_CONFIG_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <string>
+
+namespace http
+{
+
+enum class io_engine : uint8_t
+{
+    epoll,      /// readiness based, one syscall per socket operation
+    io_uring    /// completion based, socket and file operations are batched in one submission queue
+};
+
+// Tunables of the webserver and its event loops
+struct server_config
+{
+    /// Number of event loops, each with its own SO_REUSEPORT acceptor and thread
+    /// Zero uses one worker per available core
+    size_t workers = 1;
+
+    /// Directory the static media route serves files from
+    std::string media_root = "./test_data";
+
+    /// I/O engine of the workers, io_uring falls back to epoll if the kernel lacks it
+    /// or TLS is enabled
+    io_engine engine = io_engine::epoll;
+
+    /// Serve HTTPS with the certificate and key given to the webserver
+    /// Receivers only accept certificates of a trusted CA, so a self-signed
+    /// certificate breaks playback and plain HTTP is the default
+    bool tls = false;
+
+    /// Time a persistent connection may stay idle between two requests
+    std::chrono::milliseconds keep_alive_timeout {std::chrono::seconds {30}};
+
+    /// Time a client may take from the first byte of a request, or from
+    /// connecting for TLS handshakes, until the request is complete
+    std::chrono::milliseconds header_timeout {std::chrono::seconds {10}};
+
+    /// Time pending output may make no progress before the receiver is
+    /// considered stalled and disconnected
+    std::chrono::milliseconds send_timeout {std::chrono::seconds {20}};
+
+    /// Bitrate of the streamed media in bits per second, zero disables pacing
+    uint64_t stream_bitrate = 0;
+
+    /// Sending rate of every connection as multiple of stream_bitrate
+    /// Keeps receivers ahead of playback without bursting whole segments at
+    /// once and starving other receivers on the same Wi-Fi
+    double pacing_factor = 4.0;
+
+    /// Connections per worker, further clients are answered with 503
+    size_t max_connections = 1024;
+
+    /// Size limit of request line, headers and body of a single request
+    size_t max_request_size = 64 * 1024;
+
+    /// Number of requests served on one connection before it is closed
+    size_t max_keep_alive_requests = 1000;
+
+    /// Amount of queued response data after which pipelined requests are not
+    /// processed until the client caught up
+    size_t max_pending_output = 1024 * 1024;
+
+    /// Memory used by the file cache for file contents
+    size_t cache_memory_budget = 64 * 1024 * 1024;
+
+    /// Files larger than this are never cached and always sent from disk
+    size_t cache_max_entry_size = 8 * 1024 * 1024;
+
+    /// Number of cached files, larger files keep their descriptor open while cached
+    size_t cache_max_entries = 1024;
+
+    /// Time a request waits for a file transform like faststart to finish
+    /// before it is answered with 503
+    std::chrono::milliseconds transform_timeout {std::chrono::seconds {10}};
+};
+
+} // namespace http
+
+#endif
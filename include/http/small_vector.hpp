@@ -0,0 +1,74 @@
+#ifndef HTTP_SMALL_VECTOR_HPP
+#define HTTP_SMALL_VECTOR_HPP
+
+#include <array>
+#include <vector>
+#include <cstddef>
+
+namespace http
+{
+
+// Sequence of trivially copyable elements with inline storage for the first N elements
+// Only tables growing beyond N move to the heap, typical requests never do
+template<typename T, size_t N>
+class small_vector
+{
+public:
+
+    small_vector() = default;
+    small_vector(const small_vector&) = default;
+    small_vector& operator=(const small_vector&) = default;
+    small_vector(small_vector&&) noexcept = default;
+    small_vector& operator=(small_vector&&) noexcept = default;
+    ~small_vector() = default;
+
+    void push_back(const T& value)
+    {
+        if(m_size < N && m_overflow.empty())
+        {
+            m_inline[m_size++] = value;
+            return;
+        }
+
+        if(m_overflow.empty())
+            m_overflow.assign(m_inline.begin(), m_inline.end());
+        m_overflow.push_back(value);
+        ++m_size;
+    }
+
+    // Keeps the heap capacity of an overflowed vector for reuse
+    void clear()
+    {
+        m_size = 0;
+        m_overflow.clear();
+    }
+
+    T& back() { return data()[m_size - 1]; }
+    const T& back() const { return data()[m_size - 1]; }
+
+    T& operator[](size_t index) { return data()[index]; }
+    const T& operator[](size_t index) const { return data()[index]; }
+
+    T* data() { return (m_overflow.empty()) ? m_inline.data() : m_overflow.data(); }
+    const T* data() const { return (m_overflow.empty()) ? m_inline.data() : m_overflow.data(); }
+
+    T* begin() { return data(); }
+    T* end() { return data() + m_size; }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + m_size; }
+
+    size_t size() const { return m_size; }
+
+    bool empty() const { return m_size == 0; }
+
+private:
+
+    std::array<T, N> m_inline {};
+    size_t m_size = 0;
+    std::vector<T> m_overflow;
+
+};
+
+} // namespace http
+
+#endif
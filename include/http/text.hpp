@@ -0,0 +1,28 @@
+#ifndef HTTP_TEXT_HPP
+#define HTTP_TEXT_HPP
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+namespace http
+{
+
+/**
+ * Removes the spaces and tabs around a header value or list element
+ */
+std::string_view trim(std::string_view value);
+
+/**
+ * Appends the decimal digits of the value to out
+ */
+void append_number(std::string& out, uint64_t value);
+
+/**
+ * Appends seconds with three decimals as playlists list durations
+ */
+void append_duration(std::string& out, double seconds);
+
+} // namespace http
+
+#endif
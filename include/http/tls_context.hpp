@@ -0,0 +1,23 @@
+#ifndef HTTP_TLS_CONTEXT_HPP
+#define HTTP_TLS_CONTEXT_HPP
+
+#include <memory>
+#include <string_view>
+
+#include <openssl/ssl.h>
+
+namespace http
+{
+
+/**
+ * Creates the server context shared by all workers
+ * Uses the same certificate setup as net::tls_acceptor and additionally
+ * enables stateless session tickets, so clients resume their sessions on any
+ * worker, and kernel TLS, so encrypted bodies can still be sent with sendfile
+ * Throws std::runtime_error if the certificate or key can not be loaded
+ */
+std::shared_ptr<SSL_CTX> create_tls_context(std::string_view cert_path, std::string_view key_path);
+
+} // namespace http
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef HTTP_URING_HPP
+#define HTTP_URING_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/io_uring.h>
+
+namespace http
+{
+
+// Minimal io_uring instance on top of the raw system calls
+// Only what the webserver needs: getting submission entries, submitting them
+// together with waiting and walking the completions
+class uring
+{
+public:
+
+    uring() = delete;
+    uring(const uring&) = delete;
+    uring& operator=(const uring&) = delete;
+    uring(uring&&) = delete;
+    uring& operator=(uring&&) = delete;
+    ~uring();
+
+    /**
+     * Sets up the rings with room for entries submissions
+     * Throws std::runtime_error if the kernel does not support io_uring
+     */
+    explicit uring(unsigned entries);
+
+    /**
+     * Returns true if the kernel knows the operation
+     */
+    bool supports(uint8_t opcode) const;
+
+    /**
+     * Returns a cleared submission entry
+     * Pending entries are submitted first if the queue is full
+     */
+    io_uring_sqe& next_sqe();
+
+    /**
+     * Submits all pending entries and waits for at least wait_nr completions
+     */
+    void submit_and_wait(unsigned wait_nr);
+
+    /**
+     * Calls func for every available completion and marks them as seen
+     * The completion is copied, so func may queue new submissions
+     */
+    template<typename FUNC>
+    void for_each_completion(FUNC&& func)
+    {
+        unsigned head = *m_cq_head;
+        while(head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+        {
+            io_uring_cqe cqe = m_cqes[head & m_cq_mask];
+            ++head;
+            __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+            func(cqe);
+        }
+    }
+
+private:
+
+    void submit(unsigned wait_nr);
+
+    io_uring_params m_params {};        /// filled by the setup, initialized before m_fd
+    int m_fd;
+
+    void* m_sq_ring = nullptr;
+    size_t m_sq_ring_size = 0;
+    void* m_cq_ring = nullptr;
+    size_t m_cq_ring_size = 0;
+    io_uring_sqe* m_sqes = nullptr;
+
+    unsigned* m_sq_head = nullptr;
+    unsigned* m_sq_tail = nullptr;
+    unsigned* m_sq_array = nullptr;
+    unsigned m_sq_mask = 0;
+    unsigned m_sq_entries = 0;
+    unsigned m_sq_local_tail = 0;       /// entries handed out but not yet published to the kernel
+    unsigned m_sq_submitted = 0;
+
+    unsigned* m_cq_head = nullptr;
+    unsigned* m_cq_tail = nullptr;
+    io_uring_cqe* m_cqes = nullptr;
+    unsigned m_cq_mask = 0;
+
+    uint8_t m_last_op = 0;              /// highest operation known to the kernel
+    bool m_probed = false;
+    uint64_t m_supported[4] {};         /// bitmap of supported operations
+
+};
+
+} // namespace http
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef HTTP_URING_LOOP_HPP
+#define HTTP_URING_LOOP_HPP
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "socketwrapper.hpp"
+#include "http/event_loop.hpp"
+#include "http/uring.hpp"
+
+namespace http
+{
+
+// Completion based reactor on top of io_uring
+// Accepts, receives, sends and file reads of all connections are queued in one
+// submission ring and handed to the kernel with a single system call per
+// iteration. Every connection has at most one receive or one send in flight
+class uring_loop : public event_loop
+{
+public:
+
+    uring_loop() = delete;
+    uring_loop(const uring_loop&) = delete;
+    uring_loop& operator=(const uring_loop&) = delete;
+    uring_loop(uring_loop&&) = delete;
+    uring_loop& operator=(uring_loop&&) = delete;
+    ~uring_loop() override;
+
+    /**
+     * Throws std::runtime_error if io_uring or one of the needed operations is not available
+     */
+    uring_loop(std::string_view bind_addr, uint16_t port, request_handler handler, const server_config& config = {});
+
+    void run(std::atomic<bool>& run_condition) override;
+
+    std::string_view engine_name() const override
+    {
+        return "io_uring";
+    }
+
+private:
+
+    enum class operation : uint8_t
+    {
+        accept,
+        timeout,
+        recv,
+        send,
+        read_file,
+        wake
+    };
+
+    // Connection together with the state of its operations in flight
+    // Buffers referenced by submissions live here until their completion arrived
+    struct client
+    {
+        std::unique_ptr<connection> conn;
+        unsigned in_flight = 0;
+        bool closing = false;
+
+        output_segment segment;         /// iovecs of the sendmsg in flight
+        msghdr msg {};
+
+        std::string staging;            /// file data read for sending, io_uring has no sendfile
+        size_t staged_offset = 0;
+        size_t staged_length = 0;
+    };
+
+    void arm_accept();
+
+    /**
+     * Arms the accept again if it was paused because descriptors ran out
+     */
+    void resume_accept();
+
+    void arm_timeout();
+
+    void arm_wake();
+
+    /**
+     * Retries all parked requests after the loop was woken
+     */
+    void resume_parked();
+
+    void arm_recv(client& c);
+
+    /**
+     * Queues the next piece of pending output
+     * Returns false if nothing is left to send
+     */
+    bool arm_send(client& c);
+
+    void on_accept(const io_uring_cqe& cqe);
+
+    void on_recv(client& c, int result);
+
+    void on_send(client& c, int result);
+
+    void on_file_read(client& c, int result);
+
+    /**
+     * Answers buffered requests and continues with sending or receiving
+     */
+    void process(client& c);
+
+    /**
+     * Closes the connection once no operation refers to its buffers anymore
+     */
+    void close_client(client& c);
+
+    void close_expired_connections();
+
+    static uint64_t user_data(int fd, operation op);
+
+    net::tcp_acceptor<net::ip_version::v4> m_acceptor;
+
+    sockaddr_in m_accept_addr {};       /// peer address written by the accept in flight
+    socklen_t m_accept_addr_len = sizeof(sockaddr_in);
+    bool m_accept_paused = false;       /// no accept armed until a client closed or the next sweep
+
+    __kernel_timespec m_timeout {};
+
+    uint64_t m_wake_count = 0;          /// eventfd counter read by the wake operation in flight
+
+    std::unordered_map<int, std::unique_ptr<client>> m_clients;
+
+    steady_time m_last_sweep;
+
+    // Declared last so the ring and with it all operations in flight are gone
+    // before the buffers of the clients are released
+    uring m_ring;
+
+};
+
+} // namespace http
+
+#endif
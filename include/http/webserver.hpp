@@ -1,34 +1,98 @@
 #ifndef HTTP_WEBSERVER_HPP
 #define HTTP_WEBSERVER_HPP
 
-#include "socketwrapper.hpp"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
 
-#include "socketwrapper.hpp"
+#include <openssl/ssl.h>
+
+#include "http/event_loop.hpp"
+#include "http/file_cache.hpp"
+#include "http/router.hpp"
+#include "http/server_config.hpp"
 
 namespace http
 {
 
-// TODO Currently without ssl ... need to fix that
+// HTTP server for the media streamed to the receivers
+// Serves HTTPS if server_config::tls is set, plain HTTP otherwise
+//
+// Built-in routes:
+//   /                      static media below server_config::media_root
+//   /metrics               response counters and cache usage in Prometheus text format
+//   /control/status        workers, engine and cache usage as JSON
+//   /control/cache/flush   POST drops all cached files
 class webserver
 {
 public:
     webserver() = delete;
     webserver(const webserver&) = delete;
     webserver& operator=(const webserver&) = delete;
-    webserver(webserver&&) = default;
-    webserver& operator=(webserver&&) = default;
-    ~webserver() = default;
+    webserver(webserver&&) = delete;
+    webserver& operator=(webserver&&) = delete;
+    ~webserver();
+
+    /**
+     * Binds one worker per configured thread to the port
+     * cert_path and key_path are only loaded if TLS is enabled in the config
+     * Throws std::runtime_error if TLS is enabled and the certificate or key
+     * can not be loaded
+     */
+    webserver(uint16_t port, const char* cert_path, const char* key_path, const server_config& config = {});
+
+    /**
+     * Adds a route, only allowed before serve() compiles the route table
+     * Throws std::logic_error afterwards
+     */
+    void add_route(std::string_view pattern, match_kind kind, uint8_t allowed_methods, route_handler handler);
 
-    webserver(uint16_t port, const char* cert_path, const char* key_path)
-        : m_acceptor {"0.0.0.0", port}
-    {}
+    /**
+     * Serves static files of the content type in the layout of the transform,
+     * range requests map back to the stored file
+     * Throws std::logic_error once serve() was called
+     */
+    void add_file_transform(std::string_view content_type, file_transform transform);
 
+    /**
+     * Wakes all workers so requests parked by a handler are retried
+     * Called by producers of content like a live stream, safe from any thread
+     */
+    void notify();
+
+    /**
+     * Runs all worker loops until run_condition is set to false
+     * The first worker runs on the calling thread, every other worker gets
+     * its own thread and the kernel balances new connections between them
+     */
     void serve(std::atomic<bool>& run_condition);
 
 private:
 
-    // socketwrapper::SSLTCPSocket m_sock;
-    net::tcp_acceptor<net::ip_version::v4> m_acceptor;
+    // Responses of one worker by status class, only written by its own thread
+    struct alignas(64) worker_stats
+    {
+        std::atomic<uint64_t> responses[5] {};
+    };
+
+    void serve_metrics(response& res) const;
+
+    void serve_status(response& res) const;
+
+    server_config m_config;
+
+    file_cache m_cache;                 /// shared by all workers
+
+    router m_router;                    /// compiled by serve(), read-only while the workers run
+
+    std::shared_ptr<SSL_CTX> m_tls_context;    /// one context for all workers so session tickets resume everywhere
+
+    std::unique_ptr<worker_stats[]> m_stats;
+
+    std::vector<std::unique_ptr<event_loop>> m_workers;
 
 };
 
@@ -0,0 +1,29 @@
+#ifndef IMAGE_BITMAP_HPP
+#define IMAGE_BITMAP_HPP
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace image
+{
+
+/// Bytes per pixel, red, green, blue and one unused byte
+inline constexpr size_t bytes_per_pixel = 4;
+
+// Decoded image with RGBX pixels, rows follow each other without padding
+struct bitmap
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+
+    size_t stride() const
+    {
+        return static_cast<size_t>(width) * bytes_per_pixel;
+    }
+};
+
+} // namespace image
+
+#endif
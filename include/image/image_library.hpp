@@ -0,0 +1,100 @@
+#ifndef IMAGE_IMAGE_LIBRARY_HPP
+#define IMAGE_IMAGE_LIBRARY_HPP
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include "http/body.hpp"
+#include "http/prepared_cache.hpp"
+#include "http/request.hpp"
+#include "http/response.hpp"
+
+namespace image
+{
+
+struct resolution
+{
+    uint32_t width;
+    uint32_t height;
+};
+
+struct image_config
+{
+    /// Resolutions images are scaled down to fit, the first one is the resolution of
+    /// the receiver. Requests can only choose one of them, so clients can not fill
+    /// the library with versions of arbitrary size
+    std::vector<resolution> resolutions {{1920, 1080}, {1280, 720}, {3840, 2160}};
+
+    /// JPEG quality of scaled images
+    int quality = 85;
+
+    /// Number of scaled images kept in memory
+    size_t max_entries = 32;
+
+    /// Requests wait this long for an image to be scaled before they are answered with 503
+    std::chrono::milliseconds prepare_timeout {std::chrono::seconds {5}};
+};
+
+// JPEG images below the media root scaled to the resolution of the receiver
+// An image is decoded, resampled and encoded again on the first request for
+// a resolution and kept for later requests, so receivers neither have to
+// download nor decode more pixels than they can show. Images are scaled on a
+// thread of the library, requests are parked until their version is ready
+class image_library
+{
+public:
+
+    image_library() = delete;
+    image_library(const image_library&) = delete;
+    image_library& operator=(const image_library&) = delete;
+    image_library(image_library&&) = delete;
+    image_library& operator=(image_library&&) = delete;
+    ~image_library() = default;
+
+    explicit image_library(std::string media_root, const image_config& config = {});
+
+    /**
+     * Answers a request for an image with a version that fits the first resolution
+     * of the configuration or the one selected by the "width" and "height" query parameters
+     * name is the path of the request relative to the route of the library
+     */
+    void serve(std::string_view name, const http::request& req, http::response& res);
+
+    /**
+     * Sets the function called whenever an image was scaled, usually
+     * http::webserver::notify to retry the parked requests
+     */
+    void set_listener(std::function<void()> listener)
+    {
+        m_entries.set_listener(std::move(listener));
+    }
+
+private:
+
+    // Image scaled for one resolution, or the original if it already fits
+    struct entry : http::prepared_file
+    {
+        std::shared_ptr<const std::string> content;
+    };
+
+    /**
+     * Decodes, scales and encodes the image, runs on the thread of the cache
+     * Throws std::runtime_error if the file is no JPEG image
+     */
+    void prepare(entry& e, resolution target, const http::file_handle& file) const;
+
+    std::string m_root;
+    image_config m_config;
+
+    http::prepared_cache<entry> m_entries;              /// by URI of the file and resolution
+
+};
+
+} // namespace image
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef IMAGE_JPEG_HPP
+#define IMAGE_JPEG_HPP
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+#include "image/bitmap.hpp"
+
+namespace image
+{
+
+/**
+ * Reads the size of a JPEG image from its header without decoding it
+ * Throws std::runtime_error if the data is no JPEG image
+ */
+void read_jpeg_size(std::string_view data, uint32_t& width, uint32_t& height);
+
+/**
+ * Decodes a JPEG image. The decoder already scales it down in the DCT as
+ * far as it stays at least min_width x min_height, which saves most of the
+ * decoding work for large photos. 0 x 0 decodes the image at full size
+ * Throws std::runtime_error if the data is no valid JPEG image
+ */
+bitmap decode_jpeg(std::string_view data, uint32_t min_width = 0, uint32_t min_height = 0);
+
+/**
+ * Encodes the image as baseline JPEG with the quality from 1 to 100
+ * Throws std::runtime_error if encoding fails
+ */
+std::string encode_jpeg(const bitmap& image, int quality);
+
+} // namespace image
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef IMAGE_RESAMPLE_HPP
+#define IMAGE_RESAMPLE_HPP
+
+#include <cstdint>
+
+#include "image/bitmap.hpp"
+
+namespace image
+{
+
+/**
+ * Returns the largest size with the aspect ratio of width x height that fits
+ * into max_width x max_height. Images are never enlarged
+ */
+void fit_size(uint32_t width, uint32_t height, uint32_t max_width, uint32_t max_height, uint32_t& out_width,
+    uint32_t& out_height);
+
+/**
+ * Resamples the image to width x height with a separable bicubic filter
+ * that widens with the scale factor, so downscaled images do not alias
+ * Uses AVX2 or SSSE3 kernels if the processor supports them
+ * Throws std::invalid_argument if a size is zero
+ */
+bitmap resize(const bitmap& source, uint32_t width, uint32_t height);
+
+} // namespace image
+
+#endif
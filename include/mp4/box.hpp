@@ -0,0 +1,142 @@
+#ifndef MP4_BOX_HPP
+#define MP4_BOX_HPP
+
+#include <optional>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace mp4
+{
+
+// Header of a box of the ISO base media file format (ISO 14496-12)
+struct box
+{
+    uint32_t type;
+    uint64_t offset;                    /// of the header within the parent
+    uint64_t size;                      /// including the header
+    uint32_t header_size;               /// 8 or 16 bytes
+};
+
+/// Larger moov boxes are not read into memory
+static constexpr uint64_t max_moov_size = 64 * 1024 * 1024;
+
+constexpr uint32_t fourcc(const char (&code)[5])
+{
+    return (static_cast<uint32_t>(static_cast<uint8_t>(code[0])) << 24) |
+        (static_cast<uint32_t>(static_cast<uint8_t>(code[1])) << 16) |
+        (static_cast<uint32_t>(static_cast<uint8_t>(code[2])) << 8) | static_cast<uint8_t>(code[3]);
+}
+
+inline uint16_t read_u16(const uint8_t* p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+inline uint32_t read_u32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+        (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+inline uint64_t read_u64(const uint8_t* p)
+{
+    return (static_cast<uint64_t>(read_u32(p)) << 32) | read_u32(p + 4);
+}
+
+inline void append_u16(std::string& out, uint16_t value)
+{
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+inline void append_u32(std::string& out, uint32_t value)
+{
+    out.push_back(static_cast<char>(value >> 24));
+    out.push_back(static_cast<char>(value >> 16));
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+inline void append_u64(std::string& out, uint64_t value)
+{
+    append_u32(out, static_cast<uint32_t>(value >> 32));
+    append_u32(out, static_cast<uint32_t>(value));
+}
+
+/**
+ * Overwrites four bytes in place, e.g. a size only known after the payload was appended
+ */
+inline void write_u32(char* p, uint32_t value)
+{
+    p[0] = static_cast<char>(value >> 24);
+    p[1] = static_cast<char>(value >> 16);
+    p[2] = static_cast<char>(value >> 8);
+    p[3] = static_cast<char>(value);
+}
+
+/**
+ * Parses the box header at offset, available is the number of readable bytes
+ * at header and remaining the size of the parent from offset on
+ * Returns std::nullopt if the header is truncated or the box exceeds its parent
+ */
+inline std::optional<box> parse_box(const uint8_t* header, size_t available, uint64_t offset, uint64_t remaining)
+{
+    if(available < 8 || remaining < 8)
+        return std::nullopt;
+
+    box b {read_u32(header + 4), offset, read_u32(header), 8};
+    if(b.size == 1)
+    {
+        if(available < 16 || remaining < 16)
+            return std::nullopt;
+        b.size = read_u64(header + 8);
+        b.header_size = 16;
+    }
+    else if(b.size == 0)
+    {
+        b.size = remaining;             // extends to the end of the parent
+    }
+
+    if(b.size < b.header_size || b.size > remaining)
+        return std::nullopt;
+    return b;
+}
+
+/**
+ * Returns the first child box of the type within the payload of a container
+ * Returns std::nullopt if there is none or the children are broken
+ */
+inline std::optional<box> find_box(const uint8_t* payload, uint64_t size, uint32_t type)
+{
+    for(uint64_t offset = 0; offset < size; )
+    {
+        std::optional<box> child = parse_box(payload + offset, size - offset, offset, size - offset);
+        if(!child)
+            return std::nullopt;
+        if(child->type == type)
+            return child;
+        offset += child->size;
+    }
+    return std::nullopt;
+}
+
+/**
+ * Appends a box header for a payload of the given size, the compact form if it fits
+ */
+inline void append_box_header(std::string& out, uint32_t type, uint64_t payload_size)
+{
+    if(payload_size + 8 <= UINT32_MAX)
+    {
+        append_u32(out, static_cast<uint32_t>(payload_size + 8));
+        append_u32(out, type);
+        return;
+    }
+    append_u32(out, 1);
+    append_u32(out, type);
+    append_u64(out, payload_size + 16);
+}
+
+} // namespace mp4
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef MP4_FASTSTART_HPP
+#define MP4_FASTSTART_HPP
+
+#include <memory>
+
+#include "http/body.hpp"
+#include "http/file_cache.hpp"
+
+namespace mp4
+{
+
+/**
+ * Presents an MP4 file with its moov box in front of the media data and the
+ * chunk offsets moved accordingly, so players can start without first
+ * fetching the end of the file. The media data is served from the original file
+ * Returns nullptr if moov already precedes the media data or there is none
+ * Throws std::runtime_error if the box structure is broken
+ * Meant to be added as http::file_transform for video/mp4
+ */
+std::shared_ptr<const http::spliced_file> faststart(const http::cached_file& entry);
+
+} // namespace mp4
+
+#endif
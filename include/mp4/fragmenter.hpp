@@ -0,0 +1,91 @@
+#ifndef MP4_FRAGMENTER_HPP
+#define MP4_FRAGMENTER_HPP
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "http/body.hpp"
+#include "mp4/movie.hpp"
+
+namespace mp4
+{
+
+// Remuxes a progressive MP4 file into fragmented MP4 (CMAF) for HLS
+// The file is cut into fragments at the sync samples of its first track once
+// the target duration elapsed. Every fragment is one moof box followed by its
+// mdat box. Only the boxes are generated, the samples are ranges of the
+// original file and are sent with sendfile. Fragments are generated on their
+// first request and kept for later requests
+class fragmenter
+{
+public:
+
+    fragmenter() = delete;
+    fragmenter(const fragmenter&) = delete;
+    fragmenter& operator=(const fragmenter&) = delete;
+    fragmenter(fragmenter&&) = delete;
+    fragmenter& operator=(fragmenter&&) = delete;
+    ~fragmenter() = default;
+
+    /**
+     * Reads the sample tables and cuts the file into fragments
+     * Throws std::runtime_error if the file is no progressive MP4 file
+     */
+    fragmenter(std::shared_ptr<const http::file_handle> file, std::chrono::milliseconds target);
+
+    /**
+     * Returns the initialization segment referenced by EXT-X-MAP
+     */
+    std::shared_ptr<const std::string> init_segment() const
+    {
+        return m_init;
+    }
+
+    size_t fragment_count() const
+    {
+        return m_cuts.size();
+    }
+
+    /**
+     * Returns the duration of the fragment in seconds
+     */
+    double fragment_duration(size_t index) const
+    {
+        return m_cuts[index].duration;
+    }
+
+    /**
+     * Returns the fragment, generating it on the first request
+     * Throws std::out_of_range if there is no such fragment
+     */
+    std::shared_ptr<const http::spliced_file> fragment(size_t index);
+
+private:
+
+    // Samples of every track that belong to one fragment
+    struct cut
+    {
+        std::vector<size_t> first;      /// first sample per track
+        std::vector<size_t> end;        /// one past the last sample per track
+        double duration;
+    };
+
+    std::shared_ptr<const http::spliced_file> build(size_t index) const;
+
+    std::shared_ptr<const http::file_handle> m_file;
+    movie m_movie;
+    std::shared_ptr<const std::string> m_init;
+    std::vector<cut> m_cuts;
+
+    std::vector<std::shared_ptr<const http::spliced_file>> m_fragments;     /// nullptr until requested
+    std::mutex m_mutex;
+
+};
+
+} // namespace mp4
+
+#endif
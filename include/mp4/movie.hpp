@@ -0,0 +1,56 @@
+#ifndef MP4_MOVIE_HPP
+#define MP4_MOVIE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "http/body.hpp"
+
+namespace mp4
+{
+
+struct sample
+{
+    uint64_t offset;                    /// in the file
+    uint64_t decode_time;               /// in the timescale of the track
+    uint32_t size;
+    uint32_t duration;
+    int32_t composition_offset;
+    bool sync;
+};
+
+// Video or audio track with its sample table expanded to one entry per sample
+struct track
+{
+    uint32_t id;
+    uint32_t handler;                   /// "vide" or "soun"
+    uint32_t timescale;
+
+    // Boxes copied unchanged into the initialization segment
+    std::string tkhd;
+    std::string mdhd;
+    std::string hdlr;
+    std::string media_header;           /// vmhd or smhd
+    std::string stsd;
+
+    std::vector<sample> samples;        /// in decode order
+};
+
+// Structure of a progressive MP4 file
+struct movie
+{
+    uint32_t timescale;
+    std::string mvhd;
+    std::vector<track> tracks;          /// video first, other handlers are skipped
+};
+
+/**
+ * Reads the moov box of the file and expands the sample tables
+ * Throws std::runtime_error if the file is no MP4 file or its tables are broken
+ */
+movie read_movie(const http::file_handle& file);
+
+} // namespace mp4
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef DESK_CAST_OBJECT_POOL_HPP
+#define DESK_CAST_OBJECT_POOL_HPP
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+namespace utils
+{
+
+// Recycles objects that are expensive to allocate, like packet blocks or frame buffers
+// Objects return to the pool when the last reference to them is released,
+// which may happen on any thread. With a capacity at most that many objects
+// exist at once and acquire() fails instead of allocating more
+template<typename T>
+class object_pool
+{
+public:
+
+    using factory = std::function<std::unique_ptr<T>()>;
+
+    object_pool() = delete;
+    object_pool(const object_pool&) = delete;
+    object_pool& operator=(const object_pool&) = delete;
+    object_pool(object_pool&&) = delete;
+    object_pool& operator=(object_pool&&) = delete;
+    ~object_pool() = default;
+
+    /**
+     * Keeps at most max_free unused objects, further released objects are freed
+     * A capacity of zero does not limit the number of objects
+     * Objects are created with create, or default constructed without it
+     */
+    explicit object_pool(size_t max_free, size_t capacity = 0, factory create = {})
+        : m_state {std::make_shared<state>()}, m_capacity {capacity}, m_create {std::move(create)}
+    {
+        m_state->max_free = max_free;
+    }
+
+    /**
+     * Returns an unused object, creates one if none is free
+     * Returns nullptr if the capacity is reached
+     * The object still holds the data of its previous use
+     */
+    std::shared_ptr<T> acquire()
+    {
+        std::unique_ptr<T> object;
+        {
+            std::lock_guard<std::mutex> lock {m_state->mutex};
+            if(!m_state->free.empty())
+            {
+                object = std::move(m_state->free.back());
+                m_state->free.pop_back();
+            }
+            else if(m_capacity > 0 && m_state->allocated >= m_capacity)
+            {
+                return nullptr;
+            }
+            else
+            {
+                ++m_state->allocated;
+            }
+        }
+        if(!object)
+            object = (m_create) ? m_create() : std::make_unique<T>();
+
+        // The deleter keeps the state alive, objects may outlive the pool
+        return std::shared_ptr<T> {object.release(), [state = m_state](T* released) {
+            std::unique_ptr<T> owned {released};
+            std::lock_guard<std::mutex> lock {state->mutex};
+            if(state->free.size() < state->max_free)
+                state->free.push_back(std::move(owned));
+            else
+                --state->allocated;
+        }};
+    }
+
+    /**
+     * Returns the number of unused objects kept for reuse
+     */
+    size_t free_objects() const
+    {
+        std::lock_guard<std::mutex> lock {m_state->mutex};
+        return m_state->free.size();
+    }
+
+private:
+
+    // Outlives the pool as long as objects are in use
+    struct state
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<T>> free;
+        size_t max_free = 0;
+        size_t allocated = 0;           /// objects in use or free
+    };
+
+    std::shared_ptr<state> m_state;
+    size_t m_capacity;
+    factory m_create;
+
+};
+
+} // namespace utils
+
+#endif
@@ -265,8 +265,25 @@ public:
     tcp_connection() = delete;
     tcp_connection(const tcp_connection&) = delete;
     tcp_connection& operator=(const tcp_connection&) = delete;
-    tcp_connection(tcp_connection&&) noexcept = default;
-    tcp_connection& operator=(tcp_connection&&) noexcept = default;
+
+    tcp_connection(tcp_connection&& other) noexcept
+        : m_sockfd {std::exchange(other.m_sockfd, -1)}, m_family {other.m_family}, m_peer {other.m_peer},
+          m_connection {std::exchange(other.m_connection, connection_status::closed)}
+    {}
+
+    tcp_connection& operator=(tcp_connection&& other) noexcept
+    {
+        if(this != &other)
+        {
+            if(m_sockfd >= 0)
+                ::close(m_sockfd);
+            m_sockfd = std::exchange(other.m_sockfd, -1);
+            m_family = other.m_family;
+            m_peer = other.m_peer;
+            m_connection = std::exchange(other.m_connection, connection_status::closed);
+        }
+        return *this;
+    }
 
     tcp_connection(std::string_view conn_addr, uint16_t port_to)
         : m_sockfd {::socket(static_cast<uint8_t>(IP_VER), static_cast<uint8_t>(socket_type::stream), 0)}, m_family {IP_VER}, m_connection {connection_status::closed}
@@ -306,9 +323,10 @@ public:
         }
     }
 
-    ~tcp_connection()
+    virtual ~tcp_connection()
     {
-        ::close(m_sockfd);
+        if(m_sockfd >= 0)
+            ::close(m_sockfd);
     }
 
     template<typename T>
@@ -385,8 +403,23 @@ public:
     tcp_acceptor() = delete;
     tcp_acceptor(const tcp_acceptor&) = delete;
     tcp_acceptor& operator=(const tcp_acceptor&) = delete;
-    tcp_acceptor(tcp_acceptor&&) noexcept = default;
-    tcp_acceptor& operator=(tcp_acceptor&&) noexcept = default;
+
+    tcp_acceptor(tcp_acceptor&& other) noexcept
+        : m_sockfd {std::exchange(other.m_sockfd, -1)}, m_family {other.m_family}, m_sockaddr {other.m_sockaddr}
+    {}
+
+    tcp_acceptor& operator=(tcp_acceptor&& other) noexcept
+    {
+        if(this != &other)
+        {
+            if(m_sockfd >= 0)
+                ::close(m_sockfd);
+            m_sockfd = std::exchange(other.m_sockfd, -1);
+            m_family = other.m_family;
+            m_sockaddr = other.m_sockaddr;
+        }
+        return *this;
+    }
 
     tcp_acceptor(std::string_view bind_addr, uint16_t port, size_t backlog = 5)
         : m_sockfd {::socket(static_cast<uint8_t>(IP_VER), static_cast<uint8_t>(socket_type::stream), 0)}, m_family {IP_VER}
@@ -427,9 +460,10 @@ public:
             throw std::runtime_error {"Failed to initiate listen."};
     }
 
-    ~tcp_acceptor()
+    virtual ~tcp_acceptor()
     {
-        ::close(m_sockfd);
+        if(m_sockfd >= 0)
+            ::close(m_sockfd);
     }
 
     tcp_connection<IP_VER> accept() const
@@ -458,6 +492,16 @@ public:
         }
     }
 
+    /**
+     * Takes ownership of a client socket that was accepted on this acceptor
+     * without accept(), e.g. by an asynchronous accept of an io_uring
+     */
+    template<typename ADDR>
+    tcp_connection<IP_VER> adopt(int sock, const ADDR& client) const
+    {
+        return tcp_connection<IP_VER> {sock, client};
+    }
+
     int get() const
     {
         return m_sockfd;
@@ -483,8 +527,25 @@ public:
     tls_connection() = delete;
     tls_connection(const tls_connection&) = delete;
     tls_connection& operator=(const tls_connection&) = delete;
-    tls_connection(tls_connection&&) noexcept = default;
-    tls_connection& operator=(tls_connection&&) noexcept = default;
+    tls_connection(tls_connection&& other) noexcept
+        : tcp_connection<IP_VER> {std::move(other)}, m_context {std::move(other.m_context)}, m_ssl {std::exchange(other.m_ssl, nullptr)},
+          m_certificate {std::move(other.m_certificate)}, m_private_key {std::move(other.m_private_key)}
+    {}
+
+    tls_connection& operator=(tls_connection&& other) noexcept
+    {
+        if(this != &other)
+        {
+            if(m_ssl != nullptr)
+                SSL_free(m_ssl);
+            tcp_connection<IP_VER>::operator=(std::move(other));
+            m_context = std::move(other.m_context);
+            m_ssl = std::exchange(other.m_ssl, nullptr);
+            m_certificate = std::move(other.m_certificate);
+            m_private_key = std::move(other.m_private_key);
+        }
+        return *this;
+    }
 
     tls_connection(std::string_view cert_path, std::string_view key_path, std::string_view conn_addr, uint16_t port)
         : tcp_connection<IP_VER> {conn_addr, port}, m_certificate {utility::read_file(cert_path)}, m_private_key {utility::read_file(key_path)}
@@ -555,7 +616,7 @@ private:
     }
 
     std::shared_ptr<SSL_CTX> m_context;
-    SSL* m_ssl;
+    SSL* m_ssl = nullptr;
 
     std::string m_certificate;
     std::string m_private_key;
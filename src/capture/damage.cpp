@@ -0,0 +1,188 @@
+#include "capture/damage.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CAPTURE_X86_KERNELS
+#endif
+
+namespace capture
+{
+
+/**
+ * Marks the tiles of one pixel row that differ between a and b
+ * Only whole tiles of tile_bytes are compared, tiles already marked are skipped
+ */
+using row_kernel = void (*)(const uint8_t* a, const uint8_t* b, size_t tile_bytes, uint32_t columns, uint8_t* dirty);
+
+static void compare_row_scalar(const uint8_t* a, const uint8_t* b, size_t tile_bytes, uint32_t columns,
+    uint8_t* dirty)
+{
+    for(uint32_t column = 0; column < columns; ++column)
+    {
+        if(!dirty[column])
+            dirty[column] = std::memcmp(a + column * tile_bytes, b + column * tile_bytes, tile_bytes) != 0;
+    }
+}
+
+#ifdef CAPTURE_X86_KERNELS
+
+/**
+ * XORs of the whole tile are ORed together and tested once, the loop has no
+ * branch per vector. Needs tiles of a multiple of 16 bytes
+ */
+static void compare_row_sse2(const uint8_t* a, const uint8_t* b, size_t tile_bytes, uint32_t columns,
+    uint8_t* dirty)
+{
+    const __m128i zero = _mm_setzero_si128();
+    for(uint32_t column = 0; column < columns; ++column)
+    {
+        if(dirty[column])
+            continue;
+        const uint8_t* pa = a + column * tile_bytes;
+        const uint8_t* pb = b + column * tile_bytes;
+        __m128i diff = zero;
+        for(size_t i = 0; i < tile_bytes; i += 16)
+        {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pa + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pb + i));
+            diff = _mm_or_si128(diff, _mm_xor_si128(va, vb));
+        }
+        dirty[column] = _mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero)) != 0xffff;
+    }
+}
+
+/**
+ * Like compare_row_sse2 with 32 bytes per step, needs tiles of a multiple of 32 bytes
+ */
+__attribute__((target("avx2")))
+static void compare_row_avx2(const uint8_t* a, const uint8_t* b, size_t tile_bytes, uint32_t columns,
+    uint8_t* dirty)
+{
+    for(uint32_t column = 0; column < columns; ++column)
+    {
+        if(dirty[column])
+            continue;
+        const uint8_t* pa = a + column * tile_bytes;
+        const uint8_t* pb = b + column * tile_bytes;
+        __m256i diff = _mm256_setzero_si256();
+        for(size_t i = 0; i < tile_bytes; i += 32)
+        {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pa + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pb + i));
+            diff = _mm256_or_si256(diff, _mm256_xor_si256(va, vb));
+        }
+        dirty[column] = !_mm256_testz_si256(diff, diff);
+    }
+}
+
+#endif
+
+/**
+ * Returns the fastest kernel for the processor and the tile width in bytes
+ */
+static row_kernel select_kernel(size_t tile_bytes)
+{
+#ifdef CAPTURE_X86_KERNELS
+    static const bool has_avx2 = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    if(has_avx2 && tile_bytes % 32 == 0)
+        return compare_row_avx2;
+    if(tile_bytes % 16 == 0)
+        return compare_row_sse2;
+#endif
+    (void)tile_bytes;
+    return compare_row_scalar;
+}
+
+tile_map compare_tiles(const frame_buffer& previous, const frame_buffer& current, uint32_t tile_size)
+{
+    tile_map tiles;
+    tiles.tile_size = std::max<uint32_t>(tile_size, 1);
+    tiles.columns = (current.width + tiles.tile_size - 1) / tiles.tile_size;
+    tiles.rows = (current.height + tiles.tile_size - 1) / tiles.tile_size;
+    tiles.dirty.assign(static_cast<size_t>(tiles.columns) * tiles.rows, 0);
+
+    size_t tile_bytes = static_cast<size_t>(tiles.tile_size) * bytes_per_pixel;
+    uint32_t whole = current.width / tiles.tile_size;
+    size_t tail_offset = whole * tile_bytes;
+    size_t tail_bytes = current.stride() - tail_offset;
+    row_kernel kernel = select_kernel(tile_bytes);
+
+    for(uint32_t row = 0; row < tiles.rows; ++row)
+    {
+        uint8_t* dirty = tiles.dirty.data() + static_cast<size_t>(row) * tiles.columns;
+        uint32_t bottom = std::min((row + 1) * tiles.tile_size, current.height);
+        for(uint32_t y = row * tiles.tile_size; y < bottom; ++y)
+        {
+            const uint8_t* a = previous.row(y);
+            const uint8_t* b = current.row(y);
+            kernel(a, b, tile_bytes, whole, dirty);
+
+            // The narrower tile at the right edge
+            if(tail_bytes > 0 && !dirty[whole])
+                dirty[whole] = std::memcmp(a + tail_offset, b + tail_offset, tail_bytes) != 0;
+
+            // The remaining rows can not change anything once every tile is dirty
+            if(std::memchr(dirty, 0, tiles.columns) == nullptr)
+                break;
+        }
+    }
+    return tiles;
+}
+
+std::vector<rect> damage_rects(const tile_map& tiles, uint32_t width, uint32_t height)
+{
+    std::vector<rect> damage;
+    std::vector<size_t> open;                   /// rectangles ending at the previous tile row
+    std::vector<size_t> next_open;
+
+    for(uint32_t row = 0; row < tiles.rows; ++row)
+    {
+        uint32_t top = row * tiles.tile_size;
+        uint32_t bottom = std::min(top + tiles.tile_size, height);
+        next_open.clear();
+        for(uint32_t column = 0; column < tiles.columns; )
+        {
+            if(!tiles.is_dirty(column, row))
+            {
+                ++column;
+                continue;
+            }
+            uint32_t first = column;
+            while(column < tiles.columns && tiles.is_dirty(column, row))
+                ++column;
+
+            uint32_t left = first * tiles.tile_size;
+            rect span {left, top, std::min(column * tiles.tile_size, width) - left, bottom - top};
+            auto above = std::find_if(open.begin(), open.end(), [&](size_t i) {
+                return damage[i].x == span.x && damage[i].width == span.width;
+            });
+            if(above != open.end())
+            {
+                damage[*above].height += span.height;
+                next_open.push_back(*above);
+            }
+            else
+            {
+                next_open.push_back(damage.size());
+                damage.push_back(span);
+            }
+        }
+        open.swap(next_open);
+    }
+    return damage;
+}
+
+std::vector<rect> diff_frames(const frame_buffer& previous, const frame_buffer& current, uint32_t tile_size)
+{
+    if(previous.width != current.width || previous.height != current.height)
+        return {rect {0, 0, current.width, current.height}};
+    return damage_rects(compare_tiles(previous, current, tile_size), current.width, current.height);
+}
+
+} // namespace capture
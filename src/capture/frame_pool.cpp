@@ -0,0 +1,20 @@
+#include "capture/frame_pool.hpp"
+
+#include <algorithm>
+
+namespace capture
+{
+
+frame_pool::frame_pool(uint32_t width, uint32_t height, size_t capacity)
+    : object_pool {std::max<size_t>(capacity, 1), std::max<size_t>(capacity, 1), [width, height]() {
+          auto buffer = std::make_unique<frame_buffer>();
+          buffer->width = width;
+          buffer->height = height;
+          buffer->pixels.resize(buffer->stride() * height);
+          return buffer;
+      }},
+      m_width {width}, m_height {height}
+{
+}
+
+} // namespace capture
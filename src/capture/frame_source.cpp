@@ -0,0 +1,73 @@
+#include "capture/frame_source.hpp"
+#include "capture/damage.hpp"
+#include "capture/test_pattern_source.hpp"
+#ifdef DESK_CAST_X11
+#include "capture/x11_source.hpp"
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace capture
+{
+
+std::unique_ptr<frame_source> frame_source::create(const capture_config& config)
+{
+    if(config.backend == capture_backend::x11_shm)
+    {
+#ifdef DESK_CAST_X11
+        try {
+            return std::make_unique<x11_source>(config);
+        } catch(std::runtime_error& e) {
+            // Headless machines and Wayland sessions without Xwayland end up here
+            std::cerr << "X11 capture not available (" << e.what() << "), falling back to the test pattern" << std::endl;
+        }
+#else
+        std::cerr << "Built without X11, falling back to the test pattern" << std::endl;
+#endif
+    }
+    return std::make_unique<test_pattern_source>(config);
+}
+
+frame_source::frame_source(uint32_t width, uint32_t height, const capture_config& config)
+    : m_pool {width, height, std::max<size_t>(config.ring_size, 2)}, m_tile_size {config.tile_size}
+{
+}
+
+std::optional<frame> frame_source::capture()
+{
+    std::shared_ptr<frame_buffer> buffer = m_pool.acquire();
+    if(!buffer)
+    {
+        // Later stages are behind, the sequence number shows them the gap
+        ++m_sequence;
+        return std::nullopt;
+    }
+
+    frame f;
+    f.captured = std::chrono::steady_clock::now();
+    grab(*buffer);
+    f.sequence = m_sequence++;
+    if(!m_previous)
+    {
+        f.damage.push_back(rect {0, 0, buffer->width, buffer->height});
+        f.buffer = buffer;
+        m_previous = std::move(buffer);
+        return f;
+    }
+
+    f.tiles = compare_tiles(*m_previous, *buffer, m_tile_size);
+    f.damage = damage_rects(f.tiles, buffer->width, buffer->height);
+    if(f.is_static())
+    {
+        // Skip frame, the new buffer goes straight back to the ring
+        f.buffer = m_previous;
+        return f;
+    }
+    f.buffer = buffer;
+    m_previous = std::move(buffer);
+    return f;
+}
+
+} // namespace capture
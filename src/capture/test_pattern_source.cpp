@@ -0,0 +1,76 @@
+#include "capture/test_pattern_source.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace capture
+{
+
+/// Edge length of the bouncing box
+static constexpr uint32_t box_size = 128;
+
+/// Edge length of one bit of the frame counter
+static constexpr uint32_t counter_cell = 16;
+
+static void fill_rect(frame_buffer& buffer, uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t color)
+{
+    width = std::min(width, buffer.width - std::min(x, buffer.width));
+    height = std::min(height, buffer.height - std::min(y, buffer.height));
+    for(uint32_t row = y; row < y + height; ++row)
+    {
+        uint8_t* p = buffer.row(row) + static_cast<size_t>(x) * bytes_per_pixel;
+        for(uint32_t i = 0; i < width; ++i)
+            std::memcpy(p + i * bytes_per_pixel, &color, sizeof(color));
+    }
+}
+
+/**
+ * Returns the position on an axis of the given length when moving back and
+ * forth by one pixel per step
+ */
+static uint32_t bounce(uint64_t step, uint32_t length)
+{
+    if(length <= 1)
+        return 0;
+    uint64_t period = 2 * static_cast<uint64_t>(length - 1);
+    uint64_t position = step % period;
+    return static_cast<uint32_t>((position < length) ? position : period - position);
+}
+
+test_pattern_source::test_pattern_source(const capture_config& config)
+    : frame_source {std::max<uint32_t>(config.width, 1), std::max<uint32_t>(config.height, 1), config}
+{
+    m_background.resize(static_cast<size_t>(width()) * height() * bytes_per_pixel);
+    for(uint32_t y = 0; y < height(); ++y)
+    {
+        for(uint32_t x = 0; x < width(); ++x)
+        {
+            uint8_t* p = m_background.data() + (static_cast<size_t>(y) * width() + x) * bytes_per_pixel;
+            p[0] = static_cast<uint8_t>(x * 255 / width());
+            p[1] = static_cast<uint8_t>(y * 255 / height());
+            p[2] = 96;
+            p[3] = 0;
+        }
+    }
+}
+
+void test_pattern_source::grab(frame_buffer& buffer)
+{
+    // Recycled buffers hold an older frame, everything is drawn again
+    std::memcpy(buffer.pixels.data(), m_background.data(), m_background.size());
+
+    uint32_t box = std::min({box_size, buffer.width, buffer.height});
+    uint32_t x = bounce(m_count * 4, buffer.width - box + 1);
+    uint32_t y = bounce(m_count * 3, buffer.height - box + 1);
+    fill_rect(buffer, x, y, box, box, 0x00f0f0f0);
+
+    // 16 bits of the frame counter, white for set and black for cleared bits
+    for(uint32_t bit = 0; bit < 16; ++bit)
+    {
+        uint32_t color = ((m_count >> bit) & 1) ? 0x00ffffff : 0x00000000;
+        fill_rect(buffer, bit * counter_cell, 0, counter_cell, counter_cell, color);
+    }
+    ++m_count;
+}
+
+} // namespace capture
@@ -0,0 +1,115 @@
+#ifdef DESK_CAST_X11
+
+#include "capture/x11_source.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+namespace capture
+{
+
+struct x11_source::connection
+{
+    Display* display = nullptr;
+    Window root = 0;
+    XImage* image = nullptr;
+    XShmSegmentInfo shm {};
+    bool attached = false;
+
+    ~connection()
+    {
+        if(attached)
+            XShmDetach(display, &shm);
+        if(image)
+        {
+            // The pixels belong to the shared memory segment, not to Xlib
+            image->data = nullptr;
+            XDestroyImage(image);
+        }
+        if(shm.shmaddr && shm.shmaddr != reinterpret_cast<char*>(-1))
+            ::shmdt(shm.shmaddr);
+        if(display)
+            XCloseDisplay(display);
+    }
+};
+
+std::unique_ptr<x11_source::connection> x11_source::open(const capture_config& config)
+{
+    auto conn = std::make_unique<connection>();
+    conn->display = XOpenDisplay((config.display.empty()) ? nullptr : config.display.c_str());
+    if(!conn->display)
+        throw std::runtime_error {"Can not open X11 display."};
+    if(!XShmQueryExtension(conn->display))
+        throw std::runtime_error {"X11 display without MIT-SHM."};
+
+    int screen = DefaultScreen(conn->display);
+    conn->root = RootWindow(conn->display, screen);
+    XWindowAttributes attributes {};
+    XGetWindowAttributes(conn->display, conn->root, &attributes);
+
+    conn->image = XShmCreateImage(conn->display, DefaultVisual(conn->display, screen), DefaultDepth(conn->display, screen),
+        ZPixmap, nullptr, &conn->shm, attributes.width, attributes.height);
+    if(!conn->image)
+        throw std::runtime_error {"Can not create X11 shared image."};
+    if(conn->image->bits_per_pixel != 32)
+        throw std::runtime_error {"Only 32 bit X11 visuals can be captured."};
+
+    conn->shm.shmid = ::shmget(IPC_PRIVATE, static_cast<size_t>(conn->image->bytes_per_line) * conn->image->height,
+        IPC_CREAT | 0600);
+    if(conn->shm.shmid < 0)
+        throw std::runtime_error {"Can not create shared memory segment."};
+    conn->shm.shmaddr = conn->image->data = static_cast<char*>(::shmat(conn->shm.shmid, nullptr, 0));
+    conn->shm.readOnly = False;
+    if(conn->shm.shmaddr == reinterpret_cast<char*>(-1))
+    {
+        ::shmctl(conn->shm.shmid, IPC_RMID, nullptr);
+        throw std::runtime_error {"Can not attach shared memory segment."};
+    }
+
+    // Removed right after both sides attached, so it never outlives the process
+    conn->attached = XShmAttach(conn->display, &conn->shm);
+    XSync(conn->display, False);
+    ::shmctl(conn->shm.shmid, IPC_RMID, nullptr);
+    if(!conn->attached)
+        throw std::runtime_error {"X11 server can not attach the shared memory segment."};
+    return conn;
+}
+
+x11_source::x11_source(const capture_config& config)
+    : x11_source {config, open(config)}
+{
+}
+
+x11_source::x11_source(const capture_config& config, std::unique_ptr<connection> conn)
+    : frame_source {static_cast<uint32_t>(conn->image->width), static_cast<uint32_t>(conn->image->height), config},
+      m_connection {std::move(conn)}
+{
+}
+
+x11_source::~x11_source() = default;
+
+void x11_source::grab(frame_buffer& buffer)
+{
+    XImage* image = m_connection->image;
+    if(!XShmGetImage(m_connection->display, m_connection->root, image, 0, 0, AllPlanes))
+        throw std::runtime_error {"Failed to capture the X11 root window."};
+
+    // Rows of the shared image may be padded, the buffer rows are not
+    if(static_cast<size_t>(image->bytes_per_line) == buffer.stride())
+    {
+        std::memcpy(buffer.pixels.data(), image->data, buffer.pixels.size());
+        return;
+    }
+    for(uint32_t y = 0; y < buffer.height; ++y)
+        std::memcpy(buffer.row(y), image->data + static_cast<size_t>(y) * image->bytes_per_line, buffer.stride());
+}
+
+} // namespace capture
+
+#endif
@@ -0,0 +1,390 @@
+#include "hls/live_stream.hpp"
+#include "http/conditional.hpp"
+#include "http/file_cache.hpp"
+#include "http/text.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+
+namespace hls
+{
+
+/// Completed segments whose parts are still listed in the playlist, about
+/// three part hold backs behind the live edge
+static constexpr uint64_t listed_part_segments = 2;
+
+/// Completed segments whose parts can still be requested
+static constexpr uint64_t retained_part_segments = 3;
+
+static bool parse_number(std::string_view text, uint64_t& value)
+{
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return !text.empty() && ec == std::errc {} && end == text.data() + text.size();
+}
+
+/**
+ * Parses the name of a segment like "seg42.ts" or of a part like "seg42.3.ts"
+ */
+static bool parse_media_name(std::string_view name, uint64_t& sequence, uint64_t& index, bool& is_part)
+{
+    if(!name.starts_with("seg") || !name.ends_with(".ts"))
+        return false;
+    name = name.substr(3, name.size() - 6);
+
+    size_t dot = name.find('.');
+    is_part = dot != std::string_view::npos;
+    if(!is_part)
+        return parse_number(name, sequence);
+    return parse_number(name.substr(0, dot), sequence) && parse_number(name.substr(dot + 1), index);
+}
+
+static void append_media_uri(std::string& out, uint64_t sequence)
+{
+    out.append("seg");
+    http::append_number(out, sequence);
+    out.append(".ts");
+}
+
+static void append_part_uri(std::string& out, uint64_t sequence, uint64_t index)
+{
+    out.append("seg");
+    http::append_number(out, sequence);
+    out.push_back('.');
+    http::append_number(out, index);
+    out.append(".ts");
+}
+
+live_stream::live_stream(const live_config& config)
+    : m_config {config},
+      m_pool {std::make_shared<packet_pool>(max_free_blocks)},
+      m_segmenter {m_pool, config.target_duration, config.part_target,
+          [this](packet_chain&& packets, double duration, bool discontinuity) {
+              publish_segment(std::move(packets), duration, discontinuity);
+          },
+          [this](packet_chain&& packets, double duration, bool independent, bool discontinuity) {
+              publish_part(std::move(packets), duration, independent, discontinuity);
+          }},
+      m_stream_id {static_cast<uint64_t>(std::time(nullptr))},
+      m_window {std::make_shared<const window>()}
+{
+    m_config.window_size = std::max<size_t>(m_config.window_size, 1);
+    m_config.retained_segments = std::max(m_config.retained_segments, m_config.window_size);
+}
+
+void live_stream::set_listener(std::function<void()> listener)
+{
+    m_listener = std::move(listener);
+}
+
+void live_stream::write(std::string_view data)
+{
+    m_segmenter.write(data);
+}
+
+void live_stream::write(const packet_slice& packets)
+{
+    m_segmenter.write(packets);
+}
+
+void live_stream::end()
+{
+    m_segmenter.flush();
+
+    auto next = std::make_shared<window>(*m_window.load());
+    next->ended = true;
+    store(std::move(next));
+}
+
+void live_stream::publish_segment(packet_chain&& packets, double duration, bool discontinuity)
+{
+    auto seg = std::make_shared<segment>();
+    seg->sequence = m_next_sequence++;
+    seg->duration = duration;
+    seg->discontinuity = discontinuity && seg->sequence > 0;
+    seg->packets = std::move(packets);
+
+    // Only the producer replaces the window, readers keep the one they loaded
+    std::shared_ptr<const window> current = m_window.load();
+    auto next = std::make_shared<window>();
+    size_t keep = std::min(current->segments.size(), m_config.retained_segments - 1);
+    next->segments.reserve(keep + 1);
+    next->segments.assign(current->segments.end() - keep, current->segments.end());
+    next->segments.push_back(std::move(seg));
+    next->discontinuity_sequence = current->discontinuity_sequence;
+    for(auto it = current->segments.begin(); it != current->segments.end() - keep; ++it)
+        next->discontinuity_sequence += (*it)->discontinuity;
+
+    // Parts are only kept close to the live edge, older segments are served whole
+    for(const auto& p : current->parts)
+    {
+        if(p->sequence + retained_part_segments >= m_next_sequence)
+            next->parts.push_back(p);
+    }
+    next->open_sequence = m_next_sequence;
+
+    // The target duration must not change while the stream is running, only
+    // grow it if a segment was longer because key frames came too late
+    uint64_t configured = (m_config.target_duration.count() + 999) / 1000;
+    uint64_t longest = static_cast<uint64_t>(std::lround(duration));
+    next->target_duration = std::max({current->target_duration, configured, longest});
+
+    store(std::move(next));
+}
+
+void live_stream::publish_part(packet_chain&& packets, double duration, bool independent, bool discontinuity)
+{
+    std::shared_ptr<const window> current = m_window.load();
+
+    auto p = std::make_shared<part>();
+    p->sequence = m_next_sequence;
+    p->index = current->open_parts;
+    p->duration = duration;
+    p->independent = independent;
+    p->packets = std::move(packets);
+
+    auto next = std::make_shared<window>(*current);
+    next->parts.push_back(std::move(p));
+    next->open_parts = current->open_parts + 1;
+    next->open_discontinuity = discontinuity && m_next_sequence > 0;
+    next->ended = false;
+    if(next->target_duration == 0)
+        next->target_duration = (m_config.target_duration.count() + 999) / 1000;
+
+    store(std::move(next));
+}
+
+void live_stream::store(std::shared_ptr<window> next)
+{
+    next->published = std::time(nullptr);
+    m_window.store(std::move(next));
+
+    // Parked requests may be answerable now
+    if(m_listener)
+        m_listener();
+}
+
+void live_stream::render(const window& w, std::string& out) const
+{
+    size_t listed = std::min(w.segments.size(), m_config.window_size);
+    auto first = w.segments.end() - listed;
+    uint64_t first_sequence = (listed > 0) ? (*first)->sequence : w.open_sequence;
+
+    out.append((low_latency()) ? "#EXTM3U\n#EXT-X-VERSION:6\n" : "#EXTM3U\n#EXT-X-VERSION:3\n");
+    out.append("#EXT-X-TARGETDURATION:");
+    http::append_number(out, w.target_duration);
+    if(low_latency())
+    {
+        double part_target = m_config.part_target.count() / 1000.0;
+        out.append("\n#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=");
+        http::append_duration(out, 3 * part_target);
+        out.append("\n#EXT-X-PART-INF:PART-TARGET=");
+        http::append_duration(out, part_target);
+    }
+    out.append("\n#EXT-X-MEDIA-SEQUENCE:");
+    http::append_number(out, first_sequence);
+    out.push_back('\n');
+
+    // Players count the discontinuities that left the window to keep timelines aligned
+    uint64_t discontinuities = w.discontinuity_sequence;
+    for(auto it = w.segments.begin(); it != first; ++it)
+        discontinuities += (*it)->discontinuity;
+    if(discontinuities > 0)
+    {
+        out.append("#EXT-X-DISCONTINUITY-SEQUENCE:");
+        http::append_number(out, discontinuities);
+        out.push_back('\n');
+    }
+
+    // Parts are sorted like the segments, so one pass lists them in front of their segment
+    auto part_it = w.parts.begin();
+    auto append_parts = [&](uint64_t sequence) {
+        for(; part_it != w.parts.end() && (*part_it)->sequence <= sequence; ++part_it)
+        {
+            const part& p = **part_it;
+            if(p.sequence < sequence || p.sequence + listed_part_segments < w.open_sequence)
+                continue;
+            out.append("#EXT-X-PART:DURATION=");
+            http::append_duration(out, p.duration);
+            out.append(",URI=\"");
+            append_part_uri(out, p.sequence, p.index);
+            out.append((p.independent) ? "\",INDEPENDENT=YES\n" : "\"\n");
+        }
+    };
+
+    for(auto it = first; it != w.segments.end(); ++it)
+    {
+        if((*it)->discontinuity)
+            out.append("#EXT-X-DISCONTINUITY\n");
+        append_parts((*it)->sequence);
+        out.append("#EXTINF:");
+        http::append_duration(out, (*it)->duration);
+        out.append(",\n");
+        append_media_uri(out, (*it)->sequence);
+        out.push_back('\n');
+    }
+
+    if(w.ended)
+    {
+        out.append("#EXT-X-ENDLIST\n");
+        return;
+    }
+
+    if(low_latency())
+    {
+        if(w.open_discontinuity && w.open_parts > 0)
+            out.append("#EXT-X-DISCONTINUITY\n");
+        append_parts(w.open_sequence);
+        out.append("#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"");
+        append_part_uri(out, w.open_sequence, w.open_parts);
+        out.append("\"\n");
+    }
+}
+
+std::string live_stream::playlist() const
+{
+    std::string out;
+    std::shared_ptr<const window> w = m_window.load();
+    if(!w->segments.empty() || !w->parts.empty())
+        render(*w, out);
+    return out;
+}
+
+std::string live_stream::etag(uint64_t sequence, uint32_t index, char kind) const
+{
+    std::string tag {"\"l"};
+    http::append_number(tag, m_stream_id);
+    tag.push_back('-');
+    http::append_number(tag, sequence);
+    tag.push_back('.');
+    http::append_number(tag, index);
+    tag.push_back(kind);
+    tag.push_back('"');
+    return tag;
+}
+
+void live_stream::serve(std::string_view name, const http::request& req, http::response& res) const
+{
+    std::shared_ptr<const window> w = m_window.load();
+    res.set_header_block(nullptr, http::common_header_block());
+
+    if(name == "index.m3u8")
+        serve_playlist(*w, req, res);
+    else
+        serve_media(*w, name, req, res);
+}
+
+void live_stream::serve_playlist(const window& w, const http::request& req, http::response& res) const
+{
+    // Three target durations as recommended for blocking reloads, the target
+    // grows beyond the configured one if key frames are sparse
+    auto wait_timeout = 3 * std::max<std::chrono::milliseconds>(m_config.target_duration, std::chrono::seconds {w.target_duration});
+
+    // Blocking playlist reload, answered once the requested segment or part exists
+    std::string_view msn_param = req.get_param("_HLS_msn");
+    std::string_view part_param = req.get_param("_HLS_part");
+    if(low_latency() && (!msn_param.empty() || !part_param.empty()))
+    {
+        uint64_t msn = 0;
+        uint64_t part_index = 0;
+        bool has_part = !part_param.empty();
+        if(!parse_number(msn_param, msn) || (has_part && !parse_number(part_param, part_index)) ||
+            msn > w.open_sequence + 1)
+        {
+            res.set_code(400);
+            res.set_body("");
+            return;
+        }
+
+        bool available = msn < w.open_sequence || (has_part && msn == w.open_sequence && part_index < w.open_parts);
+        if(!available && !w.ended)
+        {
+            res.park(wait_timeout);
+            return;
+        }
+    }
+
+    if(w.segments.empty() && w.parts.empty())
+    {
+        // Players retry until the first segment is ready
+        res.set_code(503);
+        res.set_header("Retry-After", "1");
+        res.set_body("");
+        return;
+    }
+
+    std::string tag = etag(w.open_sequence, w.open_parts, (w.ended) ? 'e' : 'l');
+    res.set_header("Content-Type", "application/x-mpegurl");
+    res.set_header("Cache-Control", "no-cache");
+    res.set_header("ETag", tag);
+    if(http::evaluate_conditions(req, tag, w.published) == http::condition_result::not_modified)
+    {
+        res.set_code(304);
+        return;
+    }
+
+    std::string body;
+    render(w, body);
+    res.set_code(200);
+    res.set_body(body);
+}
+
+void live_stream::serve_media(const window& w, std::string_view name, const http::request& req, http::response& res) const
+{
+    uint64_t sequence = 0;
+    uint64_t index = 0;
+    bool is_part = false;
+    if(!parse_media_name(name, sequence, index, is_part))
+    {
+        res.set_code(404);
+        res.set_body("");
+        return;
+    }
+
+    const packet_chain* packets = nullptr;
+    if(is_part)
+    {
+        auto it = std::find_if(w.parts.rbegin(), w.parts.rend(), [sequence, index](const auto& p) {
+            return p->sequence == sequence && p->index == index;
+        });
+        if(it != w.parts.rend())
+            packets = &(*it)->packets;
+    }
+    else if(!w.segments.empty() && sequence >= w.segments.front()->sequence && sequence <= w.segments.back()->sequence)
+    {
+        packets = &w.segments[sequence - w.segments.front()->sequence]->packets;
+    }
+
+    if(packets == nullptr)
+    {
+        // The preload hinted part and the open segment are delivered as soon as they exist
+        bool upcoming = (is_part) ? sequence == w.open_sequence && index == w.open_parts : sequence == w.open_sequence;
+        if(upcoming && low_latency() && !w.ended)
+        {
+            res.park(3 * m_config.target_duration);
+            return;
+        }
+        res.set_code(404);
+        res.set_body("");
+        return;
+    }
+
+    std::string tag = etag(sequence, static_cast<uint32_t>(index), (is_part) ? 'p' : 's');
+    res.set_header("Content-Type", "video/mp2t");
+    res.set_header("Cache-Control", "max-age=60");
+    res.set_header("ETag", tag);
+    if(http::evaluate_conditions(req, tag, w.published) == http::condition_result::not_modified)
+    {
+        res.set_code(304);
+        return;
+    }
+    // Media never changes once published, the body references the pooled packets
+    std::vector<http::body_piece> pieces;
+    pieces.reserve(packets->size());
+    for(const auto& slice : *packets)
+        pieces.push_back(http::memory_body {slice.block, slice.bytes()});
+    res.set_code(200);
+    res.set_body_pieces(std::move(pieces));
+}
+
+} // namespace hls
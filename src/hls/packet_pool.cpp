@@ -0,0 +1,28 @@
+#include "hls/packet_pool.hpp"
+
+namespace hls
+{
+
+void append_packet(packet_chain& chain, const std::shared_ptr<const packet_block>& block, uint32_t index)
+{
+    if(!chain.empty())
+    {
+        packet_slice& last = chain.back();
+        if(last.block == block && last.first + last.count == index)
+        {
+            ++last.count;
+            return;
+        }
+    }
+    chain.push_back(packet_slice {block, index, 1});
+}
+
+size_t chain_size(const packet_chain& chain)
+{
+    size_t packets = 0;
+    for(const auto& slice : chain)
+        packets += slice.count;
+    return packets * ts::packet_size;
+}
+
+} // namespace hls
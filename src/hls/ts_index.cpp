@@ -0,0 +1,204 @@
+#include "hls/ts_index.hpp"
+
+#include <cstring>
+
+namespace hls
+{
+
+/// Timestamps jumping further ahead than this are treated as discontinuity
+static constexpr uint64_t max_timestamp_gap = 60 * ts::pts_clock;
+
+/**
+ * Returns true if the PES packet starting in this packet begins a key frame
+ * Used when the muxer did not set the random access indicator
+ */
+static bool starts_key_frame(const uint8_t* packet, uint8_t stream_type)
+{
+    size_t offset = ts::payload_offset(packet);
+    if(offset + 9 > ts::packet_size)
+        return false;
+    offset += 9 + packet[offset + 8];   // PES header
+
+    for(size_t i = offset; i + 3 < ts::packet_size; ++i)
+    {
+        if(packet[i] != 0x00 || packet[i + 1] != 0x00 || packet[i + 2] != 0x01)
+            continue;
+
+        uint8_t unit = packet[i + 3];
+        switch(stream_type)
+        {
+            case 0x1b:  // H.264 IDR slice or sequence parameter set
+                if((unit & 0x1f) == 5 || (unit & 0x1f) == 7)
+                    return true;
+                break;
+            case 0x24:  // H.265 IRAP picture or video parameter set
+                if(((unit >> 1) & 0x3f) >= 16 && ((unit >> 1) & 0x3f) <= 21)
+                    return true;
+                if(((unit >> 1) & 0x3f) == 32)
+                    return true;
+                break;
+            default:    // MPEG-1/2 sequence header
+                if(unit == 0xb3)
+                    return true;
+                break;
+        }
+        i += 2;
+    }
+    return false;
+}
+
+ts_index scan_transport_stream(std::string_view data)
+{
+    ts_index index;
+    index.size = data.size();
+
+    const auto* begin = reinterpret_cast<const uint8_t*>(data.data());
+    const uint8_t* end = begin + data.size();
+    const uint8_t* p = begin;
+
+    ts::program_map program;
+    uint8_t key_type = 0;
+    bool key_is_video = false;
+    bool has_pts = false;
+    uint64_t last_pts = 0;
+    uint64_t frame_interval = 0;
+    bool pending_discontinuity = false;
+    uint64_t pending_end = 0;
+
+    // PAT and PMT right in front of a key frame belong to its segment
+    const uint8_t* tables_run = nullptr;
+    const uint8_t* last_pat = nullptr;
+
+    while(end - p >= static_cast<ptrdiff_t>(ts::packet_size))
+    {
+        if(p[0] != ts::sync_byte)
+        {
+            const void* sync = std::memchr(p + 1, ts::sync_byte, end - p - 1);
+            p = (sync) ? static_cast<const uint8_t*>(sync) : end;
+            tables_run = nullptr;
+            continue;
+        }
+
+        uint16_t pid = ts::pid(p);
+        if(pid == index.key_pid && ts::payload_unit_start(p))
+        {
+            if(std::optional<uint64_t> pts = ts::pes_pts(p); pts)
+            {
+                if(has_pts)
+                {
+                    uint64_t behind = (last_pts - *pts) & ts::pts_mask;
+                    uint64_t ahead = (*pts - last_pts) & ts::pts_mask;
+                    if((behind < ts::pts_mask / 2 && behind > ts::pts_clock) ||
+                        (ahead < ts::pts_mask / 2 && ahead > max_timestamp_gap))
+                    {
+                        // The previous segment ends with the last frame before the jump
+                        if(!pending_discontinuity)
+                            pending_end = (last_pts + frame_interval) & ts::pts_mask;
+                        pending_discontinuity = true;
+                    }
+                    else if(ahead > 0 && ahead < ts::pts_clock)
+                    {
+                        frame_interval = ahead;
+                    }
+                }
+                else
+                {
+                    index.first_pts = *pts;
+                }
+
+                if(!key_is_video || ts::random_access(p) || starts_key_frame(p, key_type))
+                {
+                    const uint8_t* start = (tables_run != nullptr) ? tables_run : p;
+                    index.keyframes.push_back(ts_keyframe {static_cast<uint64_t>(start - begin), *pts,
+                        pending_discontinuity, pending_end});
+                    pending_discontinuity = false;
+                }
+                has_pts = true;
+                last_pts = *pts;
+            }
+        }
+        else if(pid == ts::pat_pid)
+        {
+            // Only the first program is indexed
+            if(index.pmt_pid == ts::null_pid)
+                index.pmt_pid = ts::parse_pat(p);
+            last_pat = p;
+        }
+        else if(pid == index.pmt_pid && index.key_pid == ts::null_pid && ts::parse_pmt(p, program))
+        {
+            index.pcr_pid = program.pcr_pid;
+            index.key_pid = program.key_pid;
+            index.streams = program.streams;
+            for(const auto& stream : index.streams)
+            {
+                if(stream.pid == index.key_pid)
+                    key_type = stream.stream_type;
+            }
+            key_is_video = program.key_is_video;
+            if(last_pat == p - ts::packet_size)
+            {
+                index.tables_offset = static_cast<uint64_t>(last_pat - begin);
+                index.tables_length = 2 * ts::packet_size;
+            }
+        }
+
+        if(pid == index.pcr_pid)
+        {
+            if(std::optional<uint64_t> pcr = ts::pcr(p); pcr)
+            {
+                if(!index.has_pcr)
+                    index.first_pcr = *pcr;
+                index.last_pcr = *pcr;
+                index.has_pcr = true;
+            }
+        }
+
+        if(pid == ts::pat_pid || (pid == index.pmt_pid && pid != ts::null_pid))
+        {
+            if(tables_run == nullptr)
+                tables_run = p;
+        }
+        else
+        {
+            tables_run = nullptr;
+        }
+        p += ts::packet_size;
+    }
+
+    index.end_pts = (last_pts + frame_interval) & ts::pts_mask;
+    return index;
+}
+
+std::vector<ts_range> cut_segments(const ts_index& index, std::chrono::milliseconds target_duration)
+{
+    std::vector<ts_range> ranges;
+    if(index.size == 0)
+        return ranges;
+
+    auto seconds = [](uint64_t from, uint64_t to) {
+        return static_cast<double>((to - from) & ts::pts_mask) / ts::pts_clock;
+    };
+
+    // Data in front of the first key frame stays in the first segment, so
+    // the ranges cover the file and the tables at its start
+    uint64_t target = static_cast<uint64_t>(target_duration.count()) * ts::pts_clock / 1000;
+    uint64_t start_offset = 0;
+    uint64_t start_pts = (index.keyframes.empty()) ? index.first_pts : index.keyframes.front().pts;
+    bool discontinuity = false;
+    for(size_t i = 1; i < index.keyframes.size(); ++i)
+    {
+        const ts_keyframe& key = index.keyframes[i];
+        uint64_t end_pts = (key.discontinuity) ? key.previous_end : key.pts;
+        if(!key.discontinuity && ((key.pts - start_pts) & ts::pts_mask) < target)
+            continue;
+
+        ranges.push_back(ts_range {start_offset, key.offset - start_offset, seconds(start_pts, end_pts), discontinuity});
+        start_offset = key.offset;
+        start_pts = key.pts;
+        discontinuity = key.discontinuity;
+    }
+    ranges.push_back(ts_range {start_offset, index.size - start_offset, seconds(start_pts, index.end_pts), discontinuity});
+    return ranges;
+}
+
+} // namespace hls
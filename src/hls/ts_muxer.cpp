@@ -0,0 +1,259 @@
+#include "hls/ts_muxer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace hls
+{
+
+static constexpr uint8_t video_stream_id = 0xe0;
+static constexpr uint8_t audio_stream_id = 0xc0;
+
+/// The PCR runs behind the decoding timestamps so decoders can buffer a frame
+static constexpr uint64_t pcr_delay = ts::pts_clock / 10;
+
+/// Access unit delimiter in front of every H.264 access unit as required by HLS
+static constexpr std::array<char, 6> access_unit_delimiter {0x00, 0x00, 0x00, 0x01, 0x09, static_cast<char>(0xf0)};
+
+/**
+ * CRC32 of PSI sections (ISO 13818-1 Annex A), MSB first without final XOR
+ */
+static uint32_t section_crc(const uint8_t* data, size_t length)
+{
+    uint32_t crc = 0xffffffff;
+    for(size_t i = 0; i < length; ++i)
+    {
+        crc ^= static_cast<uint32_t>(data[i]) << 24;
+        for(int bit = 0; bit < 8; ++bit)
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+    }
+    return crc;
+}
+
+/**
+ * Writes a 33 bit timestamp with its four bit prefix and marker bits
+ */
+static void write_timestamp(uint8_t* out, uint8_t prefix, uint64_t ts)
+{
+    ts &= ts::pts_mask;
+    out[0] = static_cast<uint8_t>((prefix << 4) | ((ts >> 29) & 0x0e) | 0x01);
+    out[1] = static_cast<uint8_t>(ts >> 22);
+    out[2] = static_cast<uint8_t>(((ts >> 14) & 0xfe) | 0x01);
+    out[3] = static_cast<uint8_t>(ts >> 7);
+    out[4] = static_cast<uint8_t>(((ts << 1) & 0xfe) | 0x01);
+}
+
+static void write_pcr(uint8_t* out, uint64_t base)
+{
+    base &= ts::pts_mask;
+    out[0] = static_cast<uint8_t>(base >> 25);
+    out[1] = static_cast<uint8_t>(base >> 17);
+    out[2] = static_cast<uint8_t>(base >> 9);
+    out[3] = static_cast<uint8_t>(base >> 1);
+    out[4] = static_cast<uint8_t>(((base & 0x01) << 7) | 0x7e);     // reserved bits, extension is zero
+    out[5] = 0x00;
+}
+
+/**
+ * Returns true if the Annex B data starts with an access unit delimiter NAL unit
+ */
+static bool starts_with_delimiter(std::string_view data)
+{
+    size_t start = (data.starts_with(std::string_view {"\0\0\1", 3})) ? 3 :
+        (data.starts_with(std::string_view {"\0\0\0\1", 4})) ? 4 : 0;
+    return start > 0 && data.size() > start && (data[start] & 0x1f) == 9;
+}
+
+/**
+ * Fills a packet with a complete PSI section, the CRC is appended
+ */
+static void write_section(uint8_t* packet, uint16_t pid, uint8_t& counter, const uint8_t* section, size_t length)
+{
+    packet[0] = ts::sync_byte;
+    packet[1] = static_cast<uint8_t>(0x40 | (pid >> 8));
+    packet[2] = static_cast<uint8_t>(pid);
+    packet[3] = static_cast<uint8_t>(0x10 | (counter++ & 0x0f));
+    packet[4] = 0x00;       // pointer field
+
+    uint8_t* out = packet + 5;
+    std::memcpy(out, section, length);
+    uint32_t crc = section_crc(out, length);
+    out[length] = static_cast<uint8_t>(crc >> 24);
+    out[length + 1] = static_cast<uint8_t>(crc >> 16);
+    out[length + 2] = static_cast<uint8_t>(crc >> 8);
+    out[length + 3] = static_cast<uint8_t>(crc);
+    std::memset(out + length + 4, 0xff, ts::packet_size - 5 - length - 4);
+}
+
+ts_muxer::ts_muxer(std::shared_ptr<packet_pool> pool, packet_callback on_packets, bool with_audio)
+    : m_pool {std::move(pool)}, m_on_packets {std::move(on_packets)}, m_with_audio {with_audio}
+{}
+
+void ts_muxer::write_video(std::string_view access_unit, uint64_t pts, uint64_t dts, bool key_frame)
+{
+    // Players can join at every key frame, so every key frame carries the tables
+    if(key_frame)
+        write_tables();
+
+    std::array<uint8_t, 19> header {0x00, 0x00, 0x01, video_stream_id, 0x00, 0x00, 0x80};
+    size_t header_size = 0;
+    if(((pts - dts) & ts::pts_mask) == 0)
+    {
+        header[7] = 0x80;
+        header[8] = 5;
+        write_timestamp(header.data() + 9, 0x2, pts);
+        header_size = 14;
+    }
+    else
+    {
+        header[7] = 0xc0;
+        header[8] = 10;
+        write_timestamp(header.data() + 9, 0x3, pts);
+        write_timestamp(header.data() + 14, 0x1, dts);
+        header_size = 19;
+    }
+    // Video PES packets are unbounded, the length stays zero
+
+    std::string_view prefix;
+    if(!starts_with_delimiter(access_unit))
+        prefix = std::string_view {access_unit_delimiter.data(), access_unit_delimiter.size()};
+
+    uint64_t pcr = (dts - pcr_delay) & ts::pts_mask;
+    write_pes(video_pid, m_video_counter, {reinterpret_cast<const char*>(header.data()), header_size}, prefix,
+        access_unit, key_frame, &pcr);
+    emit();
+}
+
+void ts_muxer::write_audio(std::string_view frames, uint64_t pts)
+{
+    if(!m_with_audio)
+        return;
+
+    std::array<uint8_t, 14> header {0x00, 0x00, 0x01, audio_stream_id, 0x00, 0x00, 0x80, 0x80, 5};
+    write_timestamp(header.data() + 9, 0x2, pts);
+    size_t length = 8 + frames.size();
+    if(length <= 0xffff)
+    {
+        header[4] = static_cast<uint8_t>(length >> 8);
+        header[5] = static_cast<uint8_t>(length);
+    }
+
+    write_pes(audio_pid, m_audio_counter, {reinterpret_cast<const char*>(header.data()), header.size()}, {},
+        frames, false, nullptr);
+    emit();
+}
+
+void ts_muxer::write_tables()
+{
+    const uint8_t pat[] {
+        0x00, 0xb0, 13,                     // table id, section length
+        0x00, 0x01,                         // transport stream id
+        0xc1, 0x00, 0x00,                   // version 0, current, section 0 of 0
+        0x00, 0x01,                         // program 1
+        static_cast<uint8_t>(0xe0 | (pmt_pid >> 8)), static_cast<uint8_t>(pmt_pid)
+    };
+    write_section(next_packet(), ts::pat_pid, m_pat_counter, pat, sizeof(pat));
+
+    uint8_t section_length = (m_with_audio) ? 23 : 18;
+    const uint8_t pmt[] {
+        0x02, 0xb0, section_length,
+        0x00, 0x01,                         // program 1
+        0xc1, 0x00, 0x00,
+        static_cast<uint8_t>(0xe0 | (video_pid >> 8)), static_cast<uint8_t>(video_pid),   // PCR PID
+        0xf0, 0x00,                         // no program descriptors
+        0x1b, static_cast<uint8_t>(0xe0 | (video_pid >> 8)), static_cast<uint8_t>(video_pid), 0xf0, 0x00,
+        0x0f, static_cast<uint8_t>(0xe0 | (audio_pid >> 8)), static_cast<uint8_t>(audio_pid), 0xf0, 0x00
+    };
+    write_section(next_packet(), pmt_pid, m_pmt_counter, pmt, (m_with_audio) ? sizeof(pmt) : sizeof(pmt) - 5);
+}
+
+void ts_muxer::write_pes(uint16_t pid, uint8_t& counter, std::string_view header, std::string_view prefix,
+    std::string_view payload, bool random_access, const uint64_t* pcr)
+{
+    std::array<std::string_view, 3> pieces {header, prefix, payload};
+    size_t piece = 0;
+    size_t remaining = header.size() + prefix.size() + payload.size();
+    bool first = true;
+
+    while(remaining > 0)
+    {
+        uint8_t* packet = next_packet();
+        packet[0] = ts::sync_byte;
+        packet[1] = static_cast<uint8_t>(((first) ? 0x40 : 0x00) | (pid >> 8));
+        packet[2] = static_cast<uint8_t>(pid);
+
+        // The adaptation field carries the flags of the first packet and
+        // stuffs the last one to the full packet size
+        bool has_adaptation = first && (random_access || pcr != nullptr);
+        size_t adaptation_length = (has_adaptation) ? 1 + ((pcr != nullptr) ? 6 : 0) : 0;
+        uint8_t flags = (has_adaptation) ? static_cast<uint8_t>(((random_access) ? 0x40 : 0x00) | ((pcr != nullptr) ? 0x10 : 0x00)) : 0x00;
+        size_t space = ts::packet_size - 4 - ((has_adaptation) ? 1 + adaptation_length : 0);
+        if(remaining < space)
+        {
+            size_t stuffing = space - remaining;
+            if(has_adaptation)
+                adaptation_length += stuffing;
+            else
+                adaptation_length = stuffing - 1;     // a single stuffing byte is just the length field
+            has_adaptation = true;
+        }
+        packet[3] = static_cast<uint8_t>(((has_adaptation) ? 0x30 : 0x10) | (counter++ & 0x0f));
+
+        uint8_t* out = packet + 4;
+        if(has_adaptation)
+        {
+            *out++ = static_cast<uint8_t>(adaptation_length);
+            uint8_t* adaptation_end = out + adaptation_length;
+            if(adaptation_length > 0)
+            {
+                *out++ = flags;
+                if(first && pcr != nullptr)
+                {
+                    write_pcr(out, *pcr);
+                    out += 6;
+                }
+                std::memset(out, 0xff, adaptation_end - out);
+                out = adaptation_end;
+            }
+        }
+
+        // The only copy of the payload, straight into the pooled packet
+        uint8_t* end = packet + ts::packet_size;
+        while(out < end)
+        {
+            std::string_view& source = pieces[piece];
+            size_t take = std::min<size_t>(end - out, source.size());
+            std::memcpy(out, source.data(), take);
+            source.remove_prefix(take);
+            out += take;
+            remaining -= take;
+            if(source.empty())
+                ++piece;
+        }
+        first = false;
+    }
+}
+
+uint8_t* ts_muxer::next_packet()
+{
+    if(!m_block || m_block_count == packet_block::capacity)
+    {
+        emit();
+        m_block = m_pool->acquire();
+        m_block_count = 0;
+        m_emitted = 0;
+    }
+    return m_block->packet(m_block_count++);
+}
+
+void ts_muxer::emit()
+{
+    if(!m_block || m_emitted == m_block_count)
+        return;
+
+    m_on_packets(packet_slice {m_block, m_emitted, m_block_count - m_emitted});
+    m_emitted = m_block_count;
+}
+
+} // namespace hls
@@ -0,0 +1,218 @@
+#include "hls/ts_segmenter.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace hls
+{
+
+ts_segmenter::ts_segmenter(std::shared_ptr<packet_pool> pool, std::chrono::milliseconds target_duration,
+    segment_callback on_segment)
+    : ts_segmenter {std::move(pool), target_duration, std::chrono::milliseconds {0}, std::move(on_segment), nullptr}
+{}
+
+ts_segmenter::ts_segmenter(std::shared_ptr<packet_pool> pool, std::chrono::milliseconds target_duration,
+    std::chrono::milliseconds part_target, segment_callback on_segment, part_callback on_part)
+    : m_target_duration {static_cast<uint64_t>(target_duration.count()) * ts::pts_clock / 1000},
+      m_part_target {(on_part) ? static_cast<uint64_t>(part_target.count()) * ts::pts_clock / 1000 : 0},
+      m_on_segment {std::move(on_segment)}, m_on_part {std::move(on_part)}, m_pool {std::move(pool)}
+{}
+
+void ts_segmenter::write(std::string_view data)
+{
+    const auto* p = reinterpret_cast<const uint8_t*>(data.data());
+    size_t size = data.size();
+
+    while(size > 0)
+    {
+        size_t in_packet = m_input_size % ts::packet_size;
+        if(in_packet == 0 && p[0] != ts::sync_byte)
+        {
+            const void* sync = std::memchr(p + 1, ts::sync_byte, size - 1);
+            size_t skip = (sync) ? static_cast<const uint8_t*>(sync) - p : size;
+            p += skip;
+            size -= skip;
+            continue;
+        }
+
+        if(!m_input || m_input_size == m_input->data.size())
+        {
+            m_input = m_pool->acquire();
+            m_input_size = 0;
+        }
+
+        // A packet split across two writes is completed in place
+        size_t take = std::min(ts::packet_size - in_packet, size);
+        std::memcpy(m_input->data.data() + m_input_size, p, take);
+        m_input_size += take;
+        p += take;
+        size -= take;
+
+        if(m_input_size % ts::packet_size == 0)
+            handle_packet(m_input, static_cast<uint32_t>(m_input_size / ts::packet_size - 1));
+    }
+}
+
+void ts_segmenter::write(const packet_slice& packets)
+{
+    for(uint32_t i = packets.first; i < packets.first + packets.count; ++i)
+    {
+        if(packets.block->packet(i)[0] == ts::sync_byte)
+            handle_packet(packets.block, i);
+    }
+}
+
+void ts_segmenter::flush()
+{
+    if(m_in_segment)
+    {
+        finish_part(m_last_pts);
+        finish_segment(m_last_pts);
+    }
+    m_in_segment = false;
+    m_discontinuity = true;
+}
+
+void ts_segmenter::handle_packet(const std::shared_ptr<const packet_block>& block, uint32_t index)
+{
+    const uint8_t* packet = block->packet(index);
+    uint16_t pid = ts::pid(packet);
+    if(pid == ts::pat_pid)
+    {
+        // Only the first program is streamed
+        if(uint16_t pmt_pid = ts::parse_pat(packet); pmt_pid != ts::null_pid)
+        {
+            m_pmt_pid = pmt_pid;
+            std::memcpy(m_pat.data(), packet, ts::packet_size);
+            m_has_pat = true;
+        }
+    }
+    else if(pid == m_pmt_pid)
+    {
+        if(ts::parse_pmt(packet, m_program))
+        {
+            std::memcpy(m_pmt.data(), packet, ts::packet_size);
+            m_has_pmt = true;
+        }
+    }
+    else if(pid == m_program.key_pid)
+    {
+        if(std::optional<uint64_t> pts = ts::pes_pts(packet); pts)
+        {
+            // Segments can only start where a decoder can start
+            bool random_access = !m_program.key_is_video || ts::random_access(packet);
+            uint64_t behind = (m_last_pts - *pts) & ts::pts_mask;
+            if(m_in_segment && behind < ts::pts_mask / 2 && behind > ts::pts_clock)
+            {
+                // Timestamps jumped back further than frame reordering explains,
+                // e.g. the encoder restarted
+                finish_part(m_last_pts);
+                finish_segment(m_last_pts);
+                m_in_segment = false;
+                m_discontinuity = true;
+            }
+            if(random_access && m_has_pat && m_has_pmt &&
+                (!m_in_segment || ((*pts - m_segment_start) & ts::pts_mask) >= m_target_duration))
+            {
+                if(m_in_segment)
+                {
+                    finish_part(*pts);
+                    finish_segment(*pts);
+                }
+                start_segment(*pts);
+            }
+            else if(m_in_segment && m_part_target > 0)
+            {
+                // End the part before the next frame would exceed the part target
+                uint64_t part_elapsed = (*pts - m_part_start) & ts::pts_mask;
+                if(part_elapsed > 0 && part_elapsed < ts::pts_mask / 2 && part_elapsed + m_frame_interval > m_part_target)
+                {
+                    finish_part(*pts);
+                    m_part_start = *pts;
+                    m_part_independent = random_access;
+                }
+            }
+
+            uint64_t interval = (*pts - m_last_pts) & ts::pts_mask;
+            if(interval > 0 && interval < ts::pts_clock)
+                m_frame_interval = interval;
+            m_last_pts = *pts;
+        }
+    }
+
+    if(m_in_segment)
+        append(block, index);
+}
+
+void ts_segmenter::append(const std::shared_ptr<const packet_block>& block, uint32_t index)
+{
+    const uint8_t* packet = block->packet(index);
+    uint16_t pid = ts::pid(packet);
+    if(pid == ts::pat_pid || pid == m_pmt_pid)
+    {
+        append_psi(packet, (pid == ts::pat_pid) ? m_pat_counter : m_pmt_counter);
+        return;
+    }
+
+    append_packet(m_segment, block, index);
+    if(m_part_target > 0)
+        append_packet(m_part, block, index);
+}
+
+void ts_segmenter::append_psi(const uint8_t* packet, uint8_t& counter)
+{
+    if(!m_psi || m_psi_count == packet_block::capacity)
+    {
+        m_psi = m_pool->acquire();
+        m_psi_count = 0;
+    }
+
+    // The inserted copies would otherwise break the continuity of the PSI streams
+    uint8_t* copy = m_psi->packet(m_psi_count);
+    std::memcpy(copy, packet, ts::packet_size);
+    ts::set_continuity_counter(copy, counter++);
+
+    std::shared_ptr<const packet_block> block = m_psi;
+    append_packet(m_segment, block, m_psi_count);
+    if(m_part_target > 0)
+        append_packet(m_part, block, m_psi_count);
+    ++m_psi_count;
+}
+
+void ts_segmenter::start_segment(uint64_t pts)
+{
+    m_in_segment = true;
+    m_segment_discontinuity = m_discontinuity;
+    m_discontinuity = false;
+    m_segment_start = pts;
+    m_part.clear();
+    m_part_start = pts;
+    m_part_independent = true;
+    append_psi(m_pat.data(), m_pat_counter);
+    append_psi(m_pmt.data(), m_pmt_counter);
+}
+
+void ts_segmenter::finish_part(uint64_t end_pts)
+{
+    if(m_part_target == 0 || m_part.empty())
+        return;
+
+    double duration = static_cast<double>((end_pts - m_part_start) & ts::pts_mask) / ts::pts_clock;
+    size_t slices = m_part.size();
+    m_on_part(std::move(m_part), duration, m_part_independent, m_segment_discontinuity);
+    m_part = packet_chain {};
+    m_part.reserve(slices);
+}
+
+void ts_segmenter::finish_segment(uint64_t end_pts)
+{
+    double duration = static_cast<double>((end_pts - m_segment_start) & ts::pts_mask) / ts::pts_clock;
+
+    // Segments of a stream have similar sizes, avoid growing the next one from scratch
+    size_t slices = m_segment.size();
+    m_on_segment(std::move(m_segment), duration, m_segment_discontinuity);
+    m_segment = packet_chain {};
+    m_segment.reserve(slices + slices / 4);
+}
+
+} // namespace hls
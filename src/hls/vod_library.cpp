@@ -0,0 +1,244 @@
+#include "hls/vod_library.hpp"
+#include "http/body.hpp"
+#include "http/conditional.hpp"
+#include "http/file_cache.hpp"
+#include "http/text.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include <sys/mman.h>
+
+namespace hls
+{
+
+/**
+ * Maps the file into memory and indexes it
+ */
+static ts_index index_file(const http::file_handle& file)
+{
+    if(file.size() == 0)
+        return ts_index {};
+
+    void* data = ::mmap(nullptr, file.size(), PROT_READ, MAP_PRIVATE, file.get(), 0);
+    if(data == MAP_FAILED)
+        throw std::runtime_error {"Failed to map transport stream file"};
+
+    // The scan reads the file front to back exactly once
+    ::madvise(data, file.size(), MADV_SEQUENTIAL);
+    ts_index index = scan_transport_stream(std::string_view {static_cast<const char*>(data), file.size()});
+    ::munmap(data, file.size());
+    return index;
+}
+
+vod_library::vod_library(std::string media_root, const vod_config& config)
+    : m_root {std::move(media_root)}, m_config {config}, m_entries {config.max_entries, 'v'}
+{
+}
+
+void vod_library::serve(std::string_view name, const http::request& req, http::response& res)
+{
+    // Replaced by the header block of the entry once there is one
+    res.set_header_block(nullptr, http::common_header_block());
+
+    // The fragments of an MP4 file are addressed below the path of the file
+    if(size_t split = name.find(".mp4/"); split != std::string_view::npos)
+    {
+        std::string uri;
+        if(!http::append_normalized(uri, name.substr(0, split + 4)) || !uri.ends_with(".mp4"))
+            return res.reject(404);
+        serve_fragment(uri, name.substr(split + 5), req, res);
+        return;
+    }
+
+    std::string uri;
+    if(!name.ends_with(".m3u8") || !http::append_normalized(uri, name.substr(0, name.size() - 5)) || uri.empty())
+        return res.reject(404);
+
+    // Without a transport stream the MP4 file of the same name is remuxed instead
+    std::shared_ptr<const entry> e;
+    try {
+        e = lookup(uri + ".ts");
+    } catch(std::invalid_argument&) {
+        try {
+            e = lookup(uri + ".mp4");
+        } catch(std::invalid_argument&) {
+            return res.reject(404);
+        }
+    }
+    if(!e)
+        return res.park(m_config.prepare_timeout);
+    if(e->failure != 0)
+        return res.reject(e->failure);
+
+    if(e->index && e->index->keyframes.empty())
+    {
+        // Not a transport stream or nothing a player could start decoding at
+        return res.reject(415);
+    }
+
+    res.set_header_block(e, e->header_block);
+    res.set_header("Content-Type", "application/x-mpegurl");
+    if(http::evaluate_conditions(req, e->etag, e->mtime) == http::condition_result::not_modified)
+    {
+        res.set_code(304);
+        return;
+    }
+    res.set_code(200);
+    res.set_body_shared(e->playlist, *e->playlist);
+}
+
+void vod_library::serve_fragment(const std::string& uri, std::string_view resource, const http::request& req,
+    http::response& res)
+{
+    std::shared_ptr<const entry> e;
+    try {
+        e = lookup(uri);
+    } catch(std::invalid_argument&) {
+        return res.reject(404);
+    }
+    if(!e)
+        return res.park(m_config.prepare_timeout);
+    if(e->failure != 0)
+        return res.reject(e->failure);
+
+    // Fragments change with the file, their tags extend the tag of the file
+    std::string tag {e->etag, 0, e->etag.size() - 1};
+    size_t index = 0;
+    bool init = resource == "init.mp4";
+    if(init)
+    {
+        tag.append("-i");
+    }
+    else
+    {
+        if(!resource.starts_with("seg") || !resource.ends_with(".m4s"))
+            return res.reject(404);
+        std::string_view number = resource.substr(3, resource.size() - 7);
+        auto [end, ec] = std::from_chars(number.data(), number.data() + number.size(), index);
+        if(ec != std::errc {} || end != number.data() + number.size() || index >= e->fragments->fragment_count())
+            return res.reject(404);
+        tag.append("-f");
+        http::append_number(tag, index);
+    }
+    tag.push_back('"');
+
+    res.set_header("Content-Type", (init) ? "video/mp4" : "video/iso.segment");
+    res.set_header("ETag", tag);
+    if(http::evaluate_conditions(req, tag, e->mtime) == http::condition_result::not_modified)
+    {
+        res.set_code(304);
+        return;
+    }
+
+    res.set_code(200);
+    if(init)
+    {
+        std::shared_ptr<const std::string> segment = e->fragments->init_segment();
+        res.set_body_shared(segment, *segment);
+        return;
+    }
+    // The generated boxes are shared, the samples are sent from the file
+    std::shared_ptr<const http::spliced_file> fragment = e->fragments->fragment(index);
+    res.set_body_pieces(std::vector<http::body_piece> {fragment->pieces});
+}
+
+std::shared_ptr<const vod_library::entry> vod_library::lookup(const std::string& uri)
+{
+    return m_entries.lookup(uri, m_root + uri, [this, uri](entry& e, const std::shared_ptr<const http::file_handle>& file) {
+        prepare(e, uri, file);
+    });
+}
+
+void vod_library::prepare(entry& e, const std::string& uri, const std::shared_ptr<const http::file_handle>& file) const
+{
+    if(uri.ends_with(".mp4"))
+    {
+        // The fragmenter keeps the descriptor, fragments are sent from this version of the file
+        e.fragments = std::make_shared<mp4::fragmenter>(file, m_config.target_duration);
+        e.playlist = std::make_shared<const std::string>(render(*e.fragments, uri));
+    }
+    else
+    {
+        e.index = std::make_shared<const ts_index>(index_file(*file));
+        e.playlist = std::make_shared<const std::string>(render(*e.index, uri));
+    }
+}
+
+std::string vod_library::render(const ts_index& index, const std::string& uri) const
+{
+    std::vector<ts_range> ranges = cut_segments(index, m_config.target_duration);
+
+    // The rounded duration of every segment must not exceed the target
+    uint64_t target = (m_config.target_duration.count() + 999) / 1000;
+    for(const auto& range : ranges)
+        target = std::max(target, static_cast<uint64_t>(std::lround(range.duration)));
+
+    std::string out;
+    out.reserve(64 + ranges.size() * (uri.size() + 48));
+    out.append((index.tables_length > 0) ? "#EXTM3U\n#EXT-X-VERSION:6\n" : "#EXTM3U\n#EXT-X-VERSION:4\n");
+    out.append("#EXT-X-TARGETDURATION:");
+    http::append_number(out, target);
+    out.append("\n#EXT-X-PLAYLIST-TYPE:VOD\n#EXT-X-MEDIA-SEQUENCE:0\n");
+
+    // Segments starting in the middle of the file do not carry the tables
+    if(index.tables_length > 0)
+    {
+        out.append("#EXT-X-MAP:URI=\"").append(uri).append("\",BYTERANGE=\"");
+        http::append_number(out, index.tables_length);
+        out.push_back('@');
+        http::append_number(out, index.tables_offset);
+        out.append("\"\n");
+    }
+
+    for(const auto& range : ranges)
+    {
+        if(range.discontinuity)
+            out.append("#EXT-X-DISCONTINUITY\n");
+        out.append("#EXTINF:");
+        http::append_duration(out, range.duration);
+        out.append(",\n#EXT-X-BYTERANGE:");
+        http::append_number(out, range.length);
+        out.push_back('@');
+        http::append_number(out, range.offset);
+        out.push_back('\n');
+        out.append(uri);
+        out.push_back('\n');
+    }
+    out.append("#EXT-X-ENDLIST\n");
+    return out;
+}
+
+std::string vod_library::render(const mp4::fragmenter& fragments, const std::string& uri) const
+{
+    // Fragments are served below the file, relative to the playlist next to it
+    std::string_view name {uri};
+    name.remove_prefix(name.rfind('/') + 1);
+
+    uint64_t target = (m_config.target_duration.count() + 999) / 1000;
+    for(size_t i = 0; i < fragments.fragment_count(); ++i)
+        target = std::max(target, static_cast<uint64_t>(std::lround(fragments.fragment_duration(i))));
+
+    std::string out;
+    out.reserve(128 + fragments.fragment_count() * (name.size() + 32));
+    out.append("#EXTM3U\n#EXT-X-VERSION:7\n#EXT-X-TARGETDURATION:");
+    http::append_number(out, target);
+    out.append("\n#EXT-X-PLAYLIST-TYPE:VOD\n#EXT-X-MEDIA-SEQUENCE:0\n#EXT-X-INDEPENDENT-SEGMENTS\n");
+    out.append("#EXT-X-MAP:URI=\"").append(name).append("/init.mp4\"\n");
+
+    for(size_t i = 0; i < fragments.fragment_count(); ++i)
+    {
+        out.append("#EXTINF:");
+        http::append_duration(out, fragments.fragment_duration(i));
+        out.append(",\n").append(name).append("/seg");
+        http::append_number(out, i);
+        out.append(".m4s\n");
+    }
+    out.append("#EXT-X-ENDLIST\n");
+    return out;
+}
+
+} // namespace hls
@@ -0,0 +1,52 @@
+#include "http/body.hpp"
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace http
+{
+
+file_handle::file_handle(const std::string& path)
+    : m_fd {::open(path.c_str(), O_RDONLY | O_CLOEXEC)}
+{
+    if(m_fd < 0)
+        throw std::invalid_argument {"Requested file not found."};
+
+    struct stat st {};
+    if(::fstat(m_fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        ::close(m_fd);
+        throw std::invalid_argument {"Requested file not found."};
+    }
+
+    m_size = st.st_size;
+    m_mtime = st.st_mtime;
+}
+
+file_handle::file_handle(int fd, size_t size, std::time_t mtime)
+    : m_fd {fd}, m_size {size}, m_mtime {mtime}
+{}
+
+file_handle::~file_handle()
+{
+    ::close(m_fd);
+}
+
+std::string file_handle::read_range(uint64_t offset, size_t length) const
+{
+    std::string out(length, '\0');
+    size_t total = 0;
+    while(total < length)
+    {
+        ssize_t bytes = ::pread(m_fd, out.data() + total, length - total, offset + total);
+        if(bytes <= 0)
+            throw std::runtime_error {"Failed to read file."};
+        total += bytes;
+    }
+    return out;
+}
+
+} // namespace http
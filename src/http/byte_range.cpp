@@ -0,0 +1,153 @@
+#include "http/byte_range.hpp"
+#include "http/field_table.hpp"
+#include "http/text.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <random>
+#include <string>
+
+namespace http
+{
+
+static bool parse_number(std::string_view str, size_t& out)
+{
+    if(str.empty())
+        return false;
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), out);
+    return ec == std::errc {} && ptr == str.data() + str.size();
+}
+
+range_status parse_range_header(std::string_view header, size_t size, range_list& out)
+{
+    out.clear();
+
+    header = trim(header);
+    size_t eq = header.find('=');
+    if(eq == std::string_view::npos || !equals_ignore_case(trim(header.substr(0, eq)), "bytes"))
+        return range_status::none;
+
+    std::string_view specs = header.substr(eq + 1);
+    size_t spec_count = 0;
+    while(!specs.empty())
+    {
+        size_t comma = specs.find(',');
+        std::string_view spec = trim(specs.substr(0, comma));
+        specs = (comma == std::string_view::npos) ? std::string_view {} : specs.substr(comma + 1);
+        if(spec.empty())
+            continue;
+
+        if(++spec_count > max_byte_ranges)
+            return range_status::none;
+
+        size_t hyphen = spec.find('-');
+        if(hyphen == std::string_view::npos)
+            return range_status::none;
+
+        std::string_view first_str = spec.substr(0, hyphen);
+        std::string_view last_str = spec.substr(hyphen + 1);
+        byte_range range;
+
+        if(first_str.empty())
+        {
+            // Suffix range, the last n bytes
+            size_t suffix;
+            if(!parse_number(last_str, suffix))
+                return range_status::none;
+            if(suffix == 0 || size == 0)
+                continue;
+            range.first = size - std::min(suffix, size);
+            range.last = size - 1;
+        }
+        else
+        {
+            if(!parse_number(first_str, range.first))
+                return range_status::none;
+
+            if(last_str.empty())
+            {
+                range.last = (size > 0) ? size - 1 : 0;
+            }
+            else
+            {
+                if(!parse_number(last_str, range.last) || range.last < range.first)
+                    return range_status::none;
+                range.last = std::min(range.last, size - 1);
+            }
+
+            if(range.first >= size)
+                continue;
+        }
+
+        out.push_back(range);
+    }
+
+    if(spec_count == 0)
+        return range_status::none;
+    if(out.empty())
+        return range_status::unsatisfiable;
+
+    // Merge overlapping and adjacent ranges, clients asking for many small
+    // neighbouring pieces get fewer parts
+    if(out.size() > 1)
+    {
+        std::sort(out.begin(), out.end(), [](const byte_range& lhs, const byte_range& rhs) {
+            return lhs.first < rhs.first;
+        });
+
+        size_t merged = 0;
+        for(size_t i = 1; i < out.size(); ++i)
+        {
+            if(out[i].first <= out[merged].last + 1)
+                out[merged].last = std::max(out[merged].last, out[i].last);
+            else
+                out[++merged] = out[i];
+        }
+
+        range_list result;
+        for(size_t i = 0; i <= merged; ++i)
+            result.push_back(out[i]);
+        out = result;
+    }
+
+    return range_status::satisfiable;
+}
+
+std::string_view format_content_range(const byte_range& range, size_t size, char* out)
+{
+    char* end = out + content_range_length;
+    char* pos = std::copy_n("bytes ", 6, out);
+    pos = std::to_chars(pos, end, range.first).ptr;
+    *pos++ = '-';
+    pos = std::to_chars(pos, end, range.last).ptr;
+    *pos++ = '/';
+    pos = std::to_chars(pos, end, size).ptr;
+    return std::string_view {out, static_cast<size_t>(pos - out)};
+}
+
+std::string_view format_unsatisfied_range(size_t size, char* out)
+{
+    char* end = out + content_range_length;
+    char* pos = std::copy_n("bytes */", 8, out);
+    pos = std::to_chars(pos, end, size).ptr;
+    return std::string_view {out, static_cast<size_t>(pos - out)};
+}
+
+std::string_view multipart_boundary()
+{
+    static const std::string boundary = []() {
+        static constexpr std::string_view alphabet = "0123456789abcdefghijklmnopqrstuvwxyz";
+        std::random_device rd;
+        std::mt19937 gen {rd()};
+        std::uniform_int_distribution<size_t> dist {0, alphabet.size() - 1};
+
+        std::string b {"desk_cast_"};
+        for(size_t i = 0; i < 24; ++i)
+            b.push_back(alphabet[dist(gen)]);
+        return b;
+    }();
+    return boundary;
+}
+
+} // namespace http
@@ -0,0 +1,95 @@
+#include "http/conditional.hpp"
+#include "http/http_date.hpp"
+#include "http/text.hpp"
+
+namespace http
+{
+
+static bool is_weak(std::string_view tag)
+{
+    return tag.size() >= 2 && tag[0] == 'W' && tag[1] == '/';
+}
+
+/**
+ * Checks if any tag of a comma separated list matches the entity tag
+ * Weak comparison ignores the W/ prefix, strong comparison never matches weak tags
+ */
+static bool etag_list_matches(std::string_view list, std::string_view etag, bool weak_comparison)
+{
+    list = trim(list);
+    if(list == "*")
+        return true;
+
+    if(is_weak(etag))
+    {
+        if(!weak_comparison)
+            return false;
+        etag.remove_prefix(2);
+    }
+
+    while(!list.empty())
+    {
+        size_t comma = list.find(',');
+        std::string_view tag = trim(list.substr(0, comma));
+        list = (comma == std::string_view::npos) ? std::string_view {} : list.substr(comma + 1);
+
+        if(is_weak(tag))
+        {
+            if(!weak_comparison)
+                continue;
+            tag.remove_prefix(2);
+        }
+
+        if(tag == etag)
+            return true;
+    }
+    return false;
+}
+
+condition_result evaluate_conditions(const request& req, std::string_view etag, std::time_t last_modified)
+{
+    std::time_t date;
+    std::string_view method = req.get_method();
+    bool safe_method = method == "GET" || method == "HEAD";
+
+    if(const field* f = req.get_headers().find("If-Match"); f != nullptr)
+    {
+        if(!etag_list_matches(f->value, etag, false))
+            return condition_result::precondition_failed;
+    }
+    else if(const field* f = req.get_headers().find("If-Unmodified-Since"); f != nullptr)
+    {
+        if(parse_http_date(f->value, date) && last_modified > date)
+            return condition_result::precondition_failed;
+    }
+
+    if(const field* f = req.get_headers().find("If-None-Match"); f != nullptr)
+    {
+        if(etag_list_matches(f->value, etag, true))
+            return (safe_method) ? condition_result::not_modified : condition_result::precondition_failed;
+    }
+    else if(const field* f = req.get_headers().find("If-Modified-Since"); f != nullptr && safe_method)
+    {
+        // Dates in the future are invalid and ignored
+        if(parse_http_date(f->value, date) && date <= std::time(nullptr) && last_modified <= date)
+            return condition_result::not_modified;
+    }
+
+    return condition_result::proceed;
+}
+
+bool if_range_matches(const request& req, std::string_view etag, std::time_t last_modified)
+{
+    const field* f = req.get_headers().find("If-Range");
+    if(f == nullptr)
+        return true;
+
+    std::string_view value = trim(f->value);
+    if(!value.empty() && (value.front() == '"' || is_weak(value)))
+        return !is_weak(value) && !is_weak(etag) && value == etag;
+
+    std::time_t date;
+    return parse_http_date(value, date) && date == last_modified;
+}
+
+} // namespace http
@@ -0,0 +1,416 @@
+#include "http/connection.hpp"
+
+#include <array>
+#include <cerrno>
+#include <algorithm>
+#include <climits>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <openssl/err.h>
+
+namespace http
+{
+
+static constexpr size_t tls_staging_size = 16 * 1024;     /// one maximum sized TLS record
+
+connection::connection(net::tcp_connection<net::ip_version::v4>&& sock, size_t max_request_size, SSL_CTX* tls_context)
+    : m_sock {std::move(sock)}, m_parser {max_request_size}, m_last_activity {std::chrono::steady_clock::now()},
+      m_request_started {m_last_activity}, m_last_send_progress {m_last_activity}
+{
+    int flags = ::fcntl(m_sock.get(), F_GETFL, 0);
+    if(flags < 0 || ::fcntl(m_sock.get(), F_SETFL, flags | O_NONBLOCK) < 0)
+        throw std::runtime_error {"Failed to set connection non-blocking."};
+
+    if(tls_context != nullptr)
+    {
+        m_ssl.reset(SSL_new(tls_context));
+        if(!m_ssl || SSL_set_fd(m_ssl.get(), m_sock.get()) != 1)
+            throw std::runtime_error {"Failed to set up TLS for connection."};
+        SSL_set_accept_state(m_ssl.get());
+    }
+}
+
+void connection::set_send_timeout(std::chrono::milliseconds timeout)
+{
+    unsigned int value = static_cast<unsigned int>(timeout.count());
+    ::setsockopt(m_sock.get(), IPPROTO_TCP, TCP_USER_TIMEOUT, &value, sizeof(value));
+}
+
+bool connection::set_pacing_rate(uint64_t bytes_per_second)
+{
+    // ~0U means unlimited, older kernels only accept 32 bit rates
+    unsigned int value = static_cast<unsigned int>(std::min<uint64_t>(bytes_per_second, UINT_MAX - 1));
+    return ::setsockopt(m_sock.get(), SOL_SOCKET, SO_MAX_PACING_RATE, &value, sizeof(value)) == 0;
+}
+
+bool connection::read_available()
+{
+    if(m_ssl)
+        return read_tls();
+
+    // Input beyond the size limit stays in the socket until the requests in
+    // front of it are handled, a single request can never get that large
+    std::array<char, 4096> buffer;
+    m_input_capped = false;
+    while(true)
+    {
+        size_t room = input_room();
+        if(room == 0)
+        {
+            m_input_capped = true;
+            return true;
+        }
+
+        ssize_t bytes = ::recv(m_sock.get(), buffer.data(), std::min(buffer.size(), room), 0);
+        if(bytes > 0)
+        {
+            m_last_activity = std::chrono::steady_clock::now();
+            if(m_input.empty())
+                m_request_started = m_last_activity;
+            m_input.append(buffer.data(), bytes);
+            continue;
+        }
+
+        if(bytes == 0)
+            return false;
+        if(errno == EINTR)
+            continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+bool connection::flush()
+{
+    if(m_ssl)
+    {
+        if(!m_handshake_done)
+        {
+            if(!handshake())
+                return false;
+            if(!m_handshake_done)
+                return true;
+        }
+
+        // With kernel TLS the records are encrypted below the socket, so the
+        // plain syscalls including sendfile produce valid TLS
+        if(!m_ktls_send)
+            return flush_tls();
+    }
+
+    output_segment segment;
+    while(next_output(segment))
+    {
+        ssize_t bytes = 0;
+        if(segment.iov_count > 0)
+        {
+            // Header block and shared memory leave with a single syscall, the
+            // stack is told about file data following so both share segments
+            msghdr msg {};
+            msg.msg_iov = segment.iov.data();
+            msg.msg_iovlen = segment.iov_count;
+            bytes = ::sendmsg(m_sock.get(), &msg, MSG_NOSIGNAL | ((segment.more) ? MSG_MORE : 0));
+        }
+        else
+        {
+            off_t offset = segment.file->offset;
+            bytes = ::sendfile(m_sock.get(), segment.file->file->get(), &offset, segment.file->length);
+            if(bytes == 0)
+            {
+                // File shrank since the response was built, the client can not
+                // get the announced length anymore
+                return false;
+            }
+        }
+
+        if(bytes < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        consume_output(bytes);
+    }
+    return true;
+}
+
+bool connection::handshake()
+{
+    m_tls_want_write = false;
+    int ret = SSL_do_handshake(m_ssl.get());
+    if(ret == 1)
+    {
+        m_handshake_done = true;
+        m_ktls_send = BIO_get_ktls_send(SSL_get_wbio(m_ssl.get()));
+        return true;
+    }
+
+    switch(SSL_get_error(m_ssl.get(), ret))
+    {
+        case SSL_ERROR_WANT_READ:
+            return true;
+        case SSL_ERROR_WANT_WRITE:
+            m_tls_want_write = true;
+            return true;
+        default:
+            ERR_clear_error();
+            return false;
+    }
+}
+
+bool connection::read_tls()
+{
+    if(!m_handshake_done)
+    {
+        if(!handshake())
+            return false;
+        if(!m_handshake_done)
+            return true;
+    }
+
+    std::array<char, tls_staging_size> buffer;
+    m_input_capped = false;
+    m_tls_want_write = false;
+    while(true)
+    {
+        size_t room = input_room();
+        if(room == 0)
+        {
+            m_input_capped = true;
+            return true;
+        }
+
+        int bytes = SSL_read(m_ssl.get(), buffer.data(), static_cast<int>(std::min(buffer.size(), room)));
+        if(bytes > 0)
+        {
+            m_last_activity = std::chrono::steady_clock::now();
+            if(m_input.empty())
+                m_request_started = m_last_activity;
+            m_input.append(buffer.data(), bytes);
+            continue;
+        }
+
+        switch(SSL_get_error(m_ssl.get(), bytes))
+        {
+            case SSL_ERROR_WANT_READ:
+                return true;
+            case SSL_ERROR_WANT_WRITE:
+                // Renegotiations and key updates send before reading on, the
+                // read is retried once the socket is writable
+                m_tls_want_write = true;
+                return true;
+            case SSL_ERROR_ZERO_RETURN:
+                return false;
+            default:
+                ERR_clear_error();
+                return false;
+        }
+    }
+}
+
+bool connection::flush_tls()
+{
+    output_segment segment;
+    while(next_output(segment))
+    {
+        const char* data = nullptr;
+        size_t length = 0;
+        if(segment.iov_count > 0)
+        {
+            data = static_cast<const char*>(segment.iov[0].iov_base);
+            length = segment.iov[0].iov_len;
+        }
+        else
+        {
+            // Every file byte passes user space once to be encrypted, a
+            // retried write continues with the staged data
+            if(m_staged_offset == m_staged_length)
+            {
+                if(m_staging.empty())
+                    m_staging.resize(tls_staging_size);
+                ssize_t bytes = ::pread(segment.file->file->get(), m_staging.data(),
+                    std::min(segment.file->length, m_staging.size()), segment.file->offset);
+                if(bytes <= 0)
+                    return false;
+                m_staged_offset = 0;
+                m_staged_length = bytes;
+            }
+            data = m_staging.data() + m_staged_offset;
+            length = m_staged_length - m_staged_offset;
+        }
+
+        int bytes = SSL_write(m_ssl.get(), data, static_cast<int>(std::min<size_t>(length, INT_MAX)));
+        if(bytes <= 0)
+        {
+            switch(SSL_get_error(m_ssl.get(), bytes))
+            {
+                case SSL_ERROR_WANT_WRITE:
+                case SSL_ERROR_WANT_READ:
+                    return true;
+                default:
+                    ERR_clear_error();
+                    return false;
+            }
+        }
+
+        if(segment.iov_count == 0)
+            m_staged_offset += bytes;
+        consume_output(bytes);
+    }
+    return true;
+}
+
+bool connection::next_output(output_segment& segment)
+{
+    while(m_output_head < m_output_tail)
+    {
+        output_chunk& chunk = m_output[m_output_head];
+        std::string_view head {chunk.data.data() + chunk.data_offset, chunk.data.size() - chunk.data_offset};
+        const auto* mem = std::get_if<memory_body>(&chunk.body);
+        const auto* file = std::get_if<file_body>(&chunk.body);
+
+        segment = output_segment {};
+        if(!head.empty())
+            segment.iov[segment.iov_count++] = iovec {const_cast<char*>(head.data()), head.size()};
+        if(mem != nullptr && !mem->data.empty())
+            segment.iov[segment.iov_count++] = iovec {const_cast<char*>(mem->data.data()), mem->data.size()};
+
+        if(segment.iov_count > 0)
+        {
+            segment.more = file != nullptr && file->length > 0;
+            return true;
+        }
+
+        if(file != nullptr && file->length > 0)
+        {
+            segment.file = file;
+            return true;
+        }
+
+        // Chunk is done, keep its buffer but release the body right away
+        chunk.data.clear();
+        chunk.data_offset = 0;
+        chunk.body = std::monostate {};
+        ++m_output_head;
+    }
+
+    m_output_head = 0;
+    m_output_tail = 0;
+    return false;
+}
+
+void connection::consume_output(size_t bytes)
+{
+    output_chunk& chunk = m_output[m_output_head];
+    m_pending_bytes -= bytes;
+    m_last_activity = std::chrono::steady_clock::now();
+    m_last_send_progress = m_last_activity;
+
+    size_t from_head = std::min(bytes, chunk.data.size() - chunk.data_offset);
+    chunk.data_offset += from_head;
+    bytes -= from_head;
+
+    if(auto* mem = std::get_if<memory_body>(&chunk.body); mem != nullptr)
+    {
+        mem->data.remove_prefix(bytes);
+    }
+    else if(auto* file = std::get_if<file_body>(&chunk.body); file != nullptr)
+    {
+        file->offset += bytes;
+        file->length -= bytes;
+    }
+}
+
+char* connection::prepare_input(size_t size)
+{
+    m_input_prepared = size;
+    m_input.resize(m_input.size() + size);
+    return m_input.data() + m_input.size() - size;
+}
+
+void connection::commit_input(size_t received)
+{
+    size_t previous = m_input.size() - m_input_prepared;
+    m_input.resize(previous + received);
+    m_input_prepared = 0;
+    if(received > 0)
+    {
+        m_last_activity = std::chrono::steady_clock::now();
+        if(previous == 0)
+            m_request_started = m_last_activity;
+    }
+}
+
+static size_t body_length(const body_source& body)
+{
+    if(const auto* file = std::get_if<file_body>(&body); file != nullptr)
+        return file->length;
+    if(const auto* mem = std::get_if<memory_body>(&body); mem != nullptr)
+        return mem->data.size();
+    return 0;
+}
+
+connection::output_chunk& connection::next_chunk()
+{
+    // Small pipelined responses are merged into one chunk to save syscalls
+    bool merge = m_output_tail > m_output_head && std::holds_alternative<std::monostate>(m_output[m_output_tail - 1].body);
+    if(!merge)
+    {
+        if(m_output_tail == m_output.size())
+            m_output.emplace_back();
+        ++m_output_tail;
+    }
+    return m_output[m_output_tail - 1];
+}
+
+void connection::queue_response(const response& res)
+{
+    // The send timeout counts from the moment output became pending
+    if(m_pending_bytes == 0)
+        m_last_send_progress = std::chrono::steady_clock::now();
+
+    output_chunk& chunk = next_chunk();
+    size_t size_before = chunk.data.size();
+    res.write_to(chunk.data);
+    m_pending_bytes += chunk.data.size() - size_before;
+    ++m_requests_served;
+
+    const body_source& body = res.get_body_source();
+    if(const auto* multipart = std::get_if<multipart_body>(&body); multipart != nullptr)
+    {
+        // Every part header goes out in front of its slice, the trailer is
+        // merged with whatever is queued next
+        for(const auto& part : multipart->parts)
+        {
+            output_chunk& part_chunk = next_chunk();
+            part_chunk.data.append(part.header);
+            std::visit([&part_chunk](const auto& slice) { part_chunk.body = slice; }, part.data);
+            m_pending_bytes += part.header.size() + body_length(part_chunk.body);
+        }
+
+        output_chunk& trailer_chunk = next_chunk();
+        trailer_chunk.data.append(multipart->trailer);
+        m_pending_bytes += multipart->trailer.size();
+        return;
+    }
+
+    chunk.body = body;
+    m_pending_bytes += body_length(body);
+}
+
+void connection::consume_input(size_t bytes)
+{
+    m_input.erase(0, bytes);
+    m_parser.reset();
+
+    // A pipelined request waiting behind the handled one starts its clock now
+    if(!m_input.empty())
+        m_request_started = std::chrono::steady_clock::now();
+}
+
+} // namespace http
@@ -0,0 +1,294 @@
+#include "http/epoll_loop.hpp"
+
+#include <array>
+#include <vector>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+namespace http
+{
+
+static constexpr int poll_interval_ms = 250;
+static constexpr size_t max_events = 64;
+
+epoll_loop::epoll_loop(std::string_view bind_addr, uint16_t port, request_handler handler, const server_config& config,
+    std::shared_ptr<SSL_CTX> tls_context)
+    : event_loop {std::move(handler), config}, m_epollfd {::epoll_create1(EPOLL_CLOEXEC)},
+      m_acceptor {bind_addr, port, SOMAXCONN}, m_tls_context {std::move(tls_context)},
+      m_last_sweep {std::chrono::steady_clock::now()}
+{
+    if(m_epollfd < 0)
+        throw std::runtime_error {"Failed to create epoll instance."};
+
+    int flags = ::fcntl(m_acceptor.get(), F_GETFL, 0);
+    if(flags < 0 || ::fcntl(m_acceptor.get(), F_SETFL, flags | O_NONBLOCK) < 0)
+        throw std::runtime_error {"Failed to set acceptor non-blocking."};
+
+    epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.fd = m_acceptor.get();
+    if(::epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_acceptor.get(), &ev) < 0)
+        throw std::runtime_error {"Failed to register acceptor."};
+
+    ev.data.fd = m_wakeup;
+    if(::epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_wakeup, &ev) < 0)
+        throw std::runtime_error {"Failed to register wake up event."};
+}
+
+epoll_loop::~epoll_loop()
+{
+    // Close client sockets before the epoll instance goes away
+    m_connections.clear();
+    ::close(m_epollfd);
+}
+
+void epoll_loop::run(std::atomic<bool>& run_condition)
+{
+    std::array<epoll_event, max_events> events;
+    while(run_condition.load())
+    {
+        int ready = ::epoll_wait(m_epollfd, events.data(), events.size(), poll_interval_ms);
+        if(ready < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            throw std::runtime_error {"Failed to wait for events."};
+        }
+
+        for(int i = 0; i < ready; ++i)
+        {
+            int fd = events[i].data.fd;
+            if(fd == m_acceptor.get())
+            {
+                accept_connection();
+                continue;
+            }
+            if(fd == m_wakeup)
+            {
+                drain_wakeup();
+                resume_parked();
+                continue;
+            }
+
+            auto it = m_connections.find(fd);
+            if(it != m_connections.end())
+                handle_event(*it->second, events[i].events);
+        }
+
+        close_expired_connections();
+    }
+}
+
+void epoll_loop::accept_connection()
+{
+    sockaddr_in addr {};
+    socklen_t addr_len = sizeof(addr);
+    int fd = ::accept4(m_acceptor.get(), reinterpret_cast<sockaddr*>(&addr), &addr_len, SOCK_CLOEXEC);
+    if(fd < 0)
+    {
+        // Otherwise nothing to accept or the peer already went away
+        if(out_of_descriptors(errno))
+            pause_accept();
+        return;
+    }
+
+    std::unique_ptr<connection> conn;
+    try {
+        auto sock = m_acceptor.adopt(fd, addr);
+        if(m_connections.size() >= m_config.max_connections)
+        {
+            refuse_connection(sock.get(), m_tls_context != nullptr);
+            return;
+        }
+        conn = std::make_unique<connection>(std::move(sock), m_config.max_request_size, m_tls_context.get());
+        configure_connection(*conn);
+    } catch(std::runtime_error&) {
+        // The socket was closed by the connection that failed to set up
+        return;
+    }
+
+    epoll_event ev {};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = conn->get();
+    if(::epoll_ctl(m_epollfd, EPOLL_CTL_ADD, conn->get(), &ev) < 0)
+        return;
+
+    conn->set_events(ev.events);
+    m_connections.emplace(conn->get(), std::move(conn));
+}
+
+void epoll_loop::pause_accept()
+{
+    epoll_event ev {};
+    ev.data.fd = m_acceptor.get();
+    if(::epoll_ctl(m_epollfd, EPOLL_CTL_MOD, m_acceptor.get(), &ev) == 0)
+        m_accept_paused = true;
+}
+
+void epoll_loop::resume_accept()
+{
+    if(!m_accept_paused)
+        return;
+
+    epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.fd = m_acceptor.get();
+    if(::epoll_ctl(m_epollfd, EPOLL_CTL_MOD, m_acceptor.get(), &ev) == 0)
+        m_accept_paused = false;
+}
+
+void epoll_loop::handle_event(connection& conn, uint32_t events)
+{
+    int fd = conn.get();
+    if(events & (EPOLLERR | EPOLLHUP))
+    {
+        close_connection(fd);
+        return;
+    }
+
+    // Only a hang up is watched while a request is parked, it ends the
+    // connection like the end of input does while reading
+    if((events & EPOLLRDHUP) && conn.parked())
+    {
+        close_connection(fd);
+        return;
+    }
+
+    // A TLS read that has to send first continues on writability
+    bool readable = (events & EPOLLIN) || ((events & EPOLLOUT) && conn.tls_wants_write());
+    if(readable && !conn.read_available())
+    {
+        close_connection(fd);
+        return;
+    }
+
+    while(true)
+    {
+        bool handled = process_requests(conn);
+
+        if(!conn.flush())
+        {
+            close_connection(fd);
+            return;
+        }
+
+        // Wait until the socket is writable again, pipelined requests stay in
+        // the input buffer until then
+        if(conn.wants_write())
+            break;
+
+        if(conn.close_after_flush())
+        {
+            close_connection(fd);
+            return;
+        }
+
+        // Input held back by the size limit follows once the requests in front
+        // of it are handled, TLS may have it buffered without the socket
+        // becoming readable again
+        if(handled && conn.input_capped())
+        {
+            if(!conn.read_available())
+            {
+                close_connection(fd);
+                return;
+            }
+            continue;
+        }
+
+        // Everything is sent, continue only if requests may have been held back
+        if(!handled || conn.get_input().empty())
+            break;
+    }
+
+    // A peer that half-closed may still read the response. EPOLLRDHUP stays
+    // set while level triggered, so it is only watched while reading.
+    // Pipelined input behind a parked request or beyond the size limit can not
+    // be read until the requests in front of it are answered, level triggered
+    // EPOLLIN would keep firing meanwhile. Waking the loop or the park deadline
+    // handles the connection again and watches EPOLLIN once it can read
+    uint32_t watched = EPOLLIN | EPOLLRDHUP;
+    if(conn.wants_write())
+        watched = EPOLLOUT;
+    else if(conn.parked() || conn.input_capped())
+        watched = EPOLLRDHUP;
+    update_events(conn, watched);
+}
+
+void epoll_loop::close_expired_connections()
+{
+    steady_time now = std::chrono::steady_clock::now();
+    if(now - m_last_sweep < std::chrono::milliseconds {poll_interval_ms})
+        return;
+    m_last_sweep = now;
+
+    // Descriptors may have been freed outside of this loop
+    resume_accept();
+
+    std::vector<int> expired;
+    for(const auto& [fd, conn] : m_connections)
+    {
+        if(timed_out(*conn, now))
+            expired.push_back(fd);
+    }
+
+    for(int fd : expired)
+        close_connection(fd);
+
+    // Parked requests whose content did not show up in time get a 503
+    std::vector<int> waiting;
+    for(const auto& [fd, conn] : m_connections)
+    {
+        if(conn->parked() && now >= conn->park_deadline())
+            waiting.push_back(fd);
+    }
+
+    for(int fd : waiting)
+    {
+        connection& conn = *m_connections.at(fd);
+        expire_parked(conn, now);
+        handle_event(conn, 0);
+    }
+}
+
+void epoll_loop::resume_parked()
+{
+    std::vector<int> parked;
+    for(const auto& [fd, conn] : m_connections)
+    {
+        if(conn->parked())
+            parked.push_back(fd);
+    }
+
+    // Handling may close connections, so look every one up again
+    for(int fd : parked)
+    {
+        if(auto it = m_connections.find(fd); it != m_connections.end())
+            handle_event(*it->second, 0);
+    }
+}
+
+void epoll_loop::close_connection(int fd)
+{
+    ::epoll_ctl(m_epollfd, EPOLL_CTL_DEL, fd, nullptr);
+    m_connections.erase(fd);
+    resume_accept();
+}
+
+void epoll_loop::update_events(connection& conn, uint32_t events)
+{
+    if(conn.get_events() == events)
+        return;
+
+    epoll_event ev {};
+    ev.events = events;
+    ev.data.fd = conn.get();
+    if(::epoll_ctl(m_epollfd, EPOLL_CTL_MOD, conn.get(), &ev) == 0)
+        conn.set_events(events);
+}
+
+} // namespace http
@@ -0,0 +1,219 @@
+#include "http/event_loop.hpp"
+#include "http/epoll_loop.hpp"
+#include "http/uring_loop.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+namespace http
+{
+
+static bool wants_keep_alive(const request& req)
+{
+    std::string_view conn_hdr = req.get_header("Connection");
+    if(req.get_protocol() == "HTTP/1.0")
+        return equals_ignore_case(conn_hdr, "keep-alive");
+    return !equals_ignore_case(conn_hdr, "close");
+}
+
+std::unique_ptr<event_loop> event_loop::create(std::string_view bind_addr, uint16_t port, request_handler handler,
+    const server_config& config, std::shared_ptr<SSL_CTX> tls_context)
+{
+    if(config.engine == io_engine::io_uring)
+    {
+        // Handshakes and records of the io_uring engine would need memory BIOs
+        if(tls_context)
+            throw std::invalid_argument {"TLS is only served by the epoll engine."};
+
+        try {
+            return std::make_unique<uring_loop>(bind_addr, port, handler, config);
+        } catch(std::runtime_error& e) {
+            // Old kernels, seccomp filters or io_uring_disabled end up here
+            std::cerr << "io_uring not available (" << e.what() << "), falling back to epoll" << std::endl;
+        }
+    }
+    return std::make_unique<epoll_loop>(bind_addr, port, std::move(handler), config, std::move(tls_context));
+}
+
+event_loop::event_loop(request_handler handler, const server_config& config)
+    : m_handler {std::move(handler)}, m_config {config}, m_wakeup {::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)}
+{
+    if(m_wakeup < 0)
+        throw std::runtime_error {"Failed to create wake up event."};
+}
+
+event_loop::~event_loop()
+{
+    ::close(m_wakeup);
+}
+
+void event_loop::wake()
+{
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t written = ::write(m_wakeup, &one, sizeof(one));
+}
+
+void event_loop::drain_wakeup()
+{
+    uint64_t count;
+    [[maybe_unused]] ssize_t bytes = ::read(m_wakeup, &count, sizeof(count));
+}
+
+void event_loop::configure_connection(connection& conn) const
+{
+    conn.set_send_timeout(m_config.send_timeout);
+
+    if(m_config.stream_bitrate > 0)
+    {
+        auto rate = static_cast<uint64_t>(m_config.stream_bitrate / 8 * m_config.pacing_factor);
+        static std::atomic<bool> warned {false};
+        if(!conn.set_pacing_rate(rate) && !warned.exchange(true))
+            std::cerr << "Kernel does not support SO_MAX_PACING_RATE, segments are sent unpaced" << std::endl;
+    }
+}
+
+bool event_loop::process_requests(connection& conn)
+{
+    bool handled = false;
+
+    // A parked request blocks the requests pipelined behind it
+    if(conn.parked())
+    {
+        request req = conn.unpark();
+        if(!handle_request(conn, req))
+        {
+            conn.park(std::move(req), conn.park_deadline());
+            return false;
+        }
+        handled = true;
+    }
+
+    while(!conn.close_after_flush() && conn.pending_output() < m_config.max_pending_output)
+    {
+        request req;
+        parse_status status = conn.get_parser().parse(conn.get_input(), req);
+        switch(status)
+        {
+            case parse_status::need_more:
+                return handled;
+
+            case parse_status::error:
+            case parse_status::too_large:
+                m_response.clear();
+                if(status == parse_status::error)
+                    m_response.set_code(400);
+                else
+                    m_response.set_code((conn.get_parser().headers_complete()) ? 413 : 431);
+                m_response.set_header("Connection", "close");
+                conn.queue_response(m_response);
+                conn.set_close_after_flush();
+                return true;
+
+            case parse_status::complete:
+                // The request points into the input buffer, answer it before
+                // the buffer is consumed
+                if(!handle_request(conn, req))
+                {
+                    size_t consumed = conn.get_parser().consumed();
+                    req.own(conn.get_input().substr(0, consumed));
+                    conn.park(std::move(req), std::chrono::steady_clock::now() + m_response.park_timeout());
+                    conn.consume_input(consumed);
+                    return handled;
+                }
+                conn.consume_input(conn.get_parser().consumed());
+                handled = true;
+                break;
+        }
+    }
+    return handled;
+}
+
+bool event_loop::handle_request(connection& conn, const request& req)
+{
+    m_response.clear();
+    try {
+        m_handler(req, m_response);
+    } catch(std::invalid_argument&) {
+        // Malformed input the handler could not parse
+        m_response.clear();
+        m_response.set_code(400);
+    } catch(std::exception& e) {
+        // Unreadable files and other failures on the server side
+        std::cerr << "Failed to answer " << req.get_path() << " (" << e.what() << ")" << std::endl;
+        m_response.clear();
+        m_response.set_code(500);
+    } catch(...) {
+        m_response.clear();
+        m_response.set_code(500);
+    }
+
+    if(m_response.parked())
+        return false;
+
+    finish_response(conn, req);
+    return true;
+}
+
+void event_loop::finish_response(connection& conn, const request& req)
+{
+    bool keep_alive = wants_keep_alive(req) && conn.requests_served() + 1 < m_config.max_keep_alive_requests;
+
+    // HEAD is handled like GET, only the body is not sent
+    if(req.get_method() == "HEAD")
+        m_response.omit_body();
+
+    m_response.set_header("Connection", keep_alive ? "keep-alive" : "close");
+    conn.queue_response(m_response);
+    if(!keep_alive)
+        conn.set_close_after_flush();
+}
+
+bool event_loop::expire_parked(connection& conn, steady_time now)
+{
+    if(!conn.parked() || now < conn.park_deadline())
+        return false;
+
+    request req = conn.unpark();
+    m_response.clear();
+    m_response.set_code(503);
+    m_response.set_header("Retry-After", "1");
+    m_response.set_body("");
+    finish_response(conn, req);
+    return true;
+}
+
+bool event_loop::timed_out(const connection& conn, steady_time now) const
+{
+    // Parked requests wait for the server, not for the client
+    if(conn.parked())
+        return false;
+
+    // A stalled receiver is dropped without holding up the other connections
+    if(conn.has_pending_output())
+        return now - conn.last_send_progress() > m_config.send_timeout;
+    if(conn.reading_request())
+        return now - conn.request_started() > m_config.header_timeout;
+    return now - conn.last_activity() > m_config.keep_alive_timeout;
+}
+
+void event_loop::refuse_connection(int fd, bool tls)
+{
+    static constexpr std::string_view busy = "HTTP/1.1 503 Service Unavailable\r\n"
+        "Content-Length: 0\r\nConnection: close\r\nRetry-After: 1\r\n\r\n";
+
+    // Best effort, a TLS client would need a handshake first
+    if(!tls)
+        ::send(fd, busy.data(), busy.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+bool event_loop::out_of_descriptors(int error)
+{
+    return error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM;
+}
+
+} // namespace http
@@ -0,0 +1,448 @@
+#include "http/file_cache.hpp"
+#include "http/http_date.hpp"
+
+#include <array>
+#include <stdexcept>
+#include <cstdio>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+
+namespace http
+{
+
+std::string_view content_type_of(std::string_view path)
+{
+    static constexpr std::array<std::pair<std::string_view, std::string_view>, 11> types {{
+        {".m3u8", "application/x-mpegurl"},
+        {".ts", "video/mp2t"},
+        {".mp4", "video/mp4"},
+        {".m4s", "video/iso.segment"},
+        {".aac", "audio/aac"},
+        {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".png", "image/png"},
+        {".html", "text/html; charset=UTF-8"},
+        {".json", "application/json"},
+        {".txt", "text/plain; charset=UTF-8"}
+    }};
+
+    size_t dot = path.rfind('.');
+    if(dot != std::string_view::npos)
+    {
+        std::string_view ext = path.substr(dot);
+        for(const auto& [e, type] : types)
+        {
+            if(e == ext)
+                return type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+std::string_view common_header_block()
+{
+    return "Server: localhost\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Access-Control-Allow-Methods: OPTIONS, GET, HEAD\r\n";
+}
+
+void format_header_block(std::string& out, std::string_view etag)
+{
+    out.append(common_header_block());
+    out.append("ETag: ").append(etag).append("\r\n");
+}
+
+void format_header_block(cached_file& entry)
+{
+    entry.header_block.clear();
+    format_header_block(entry.header_block, entry.etag);
+    entry.header_block.append("Last-Modified: ").append(entry.last_modified);
+    entry.header_block.append("\r\nAccept-Ranges: bytes\r\n");
+}
+
+bool append_normalized(std::string& out, std::string_view path)
+{
+    while(!path.empty())
+    {
+        size_t end = path.find('/');
+        std::string_view segment = path.substr(0, end);
+        path.remove_prefix((end == std::string_view::npos) ? path.size() : end + 1);
+
+        if(segment.empty() || segment == ".")
+            continue;
+        if(segment == "..")
+            return false;
+        out.push_back('/');
+        out.append(segment);
+    }
+    return true;
+}
+
+/**
+ * Returns the memory held by the entry that counts against the budget
+ */
+static size_t memory_of(const cached_file& entry)
+{
+    return ((entry.content) ? entry.size : 0) + ((entry.spliced) ? entry.spliced->memory : 0);
+}
+
+static bool same_version(const cached_file& entry, const struct stat& st)
+{
+    return entry.size == static_cast<size_t>(st.st_size) && entry.mtime.tv_sec == st.st_mtim.tv_sec &&
+        entry.mtime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+static constexpr uint32_t watch_mask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO |
+    IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+file_cache::file_cache(size_t memory_budget, size_t max_entry_size, size_t max_entries)
+    : m_memory_budget {memory_budget}, m_max_entry_size {std::min(max_entry_size, memory_budget)},
+      m_max_entries {max_entries}
+{
+    m_inotify = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_wakeup = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(m_inotify < 0 || m_wakeup < 0)
+    {
+        // Entries are revalidated with stat on every lookup instead
+        std::cerr << "inotify not available, revalidating cached files on every request" << std::endl;
+        if(m_inotify >= 0)
+            ::close(m_inotify);
+        if(m_wakeup >= 0)
+            ::close(m_wakeup);
+        m_inotify = m_wakeup = -1;
+        return;
+    }
+    m_watcher = std::thread {&file_cache::watch_changes, this};
+}
+
+file_cache::~file_cache()
+{
+    if(m_watcher.joinable())
+    {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t written = ::write(m_wakeup, &one, sizeof(one));
+        m_watcher.join();
+    }
+    if(m_inotify >= 0)
+        ::close(m_inotify);
+    if(m_wakeup >= 0)
+        ::close(m_wakeup);
+}
+
+std::shared_ptr<const cached_file> file_cache::get(const std::string& path)
+{
+    std::shared_ptr<const cached_file> checked;
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        if(auto it = m_index.find(path); it != m_index.end())
+        {
+            if(it->second->watched)
+                return use(it->second);
+            checked = it->second->entry;
+        }
+    }
+
+    // Revalidate without holding the lock so hits of other workers are not delayed
+    bool current = false;
+    if(checked)
+    {
+        struct stat st {};
+        current = ::stat(path.c_str(), &st) == 0 && same_version(*checked, st);
+    }
+
+    bool watched = false;
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        if(auto it = m_index.find(path); it != m_index.end())
+        {
+            // Another worker may have replaced the entry in the meantime,
+            // only the checked version is served without loading the file
+            if(it->second->watched || (current && it->second->entry == checked))
+                return use(it->second);
+            if(it->second->entry == checked)
+                erase(it->second);
+        }
+
+        // The watch has to exist before the file is read, otherwise a change
+        // in between would never invalidate the new entry
+        watched = watch_directory(path);
+        ++m_loads[path].count;
+    }
+
+    // Read the file without holding the lock so hits of other workers are not delayed
+    std::shared_ptr<const cached_file> entry;
+    try {
+        entry = load(path);
+    } catch(...) {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        finish_load(path);
+        throw;
+    }
+
+    std::lock_guard<std::mutex> lock {m_mutex};
+    bool stale = finish_load(path);
+    if(!has_transform(*entry))
+    {
+        if(!stale)
+            insert(entry, watched);
+        return entry;
+    }
+
+    // The transform reads most of the file, it must not block the event loop.
+    // A stale result is dropped by the job, the retried request loads the file again
+    if(!stale)
+        insert(entry, watched, true);
+    queue_transform(std::move(entry));
+    return nullptr;
+}
+
+std::shared_ptr<const cached_file> file_cache::use(lru_list::iterator it)
+{
+    m_lru.splice(m_lru.begin(), m_lru, it);
+    if(!it->transforming)
+        return it->entry;
+
+    // Queued again in case an earlier job of the path dropped its result
+    queue_transform(it->entry);
+    return nullptr;
+}
+
+size_t file_cache::memory_usage() const
+{
+    std::lock_guard<std::mutex> lock {m_mutex};
+    return m_memory_usage;
+}
+
+void file_cache::add_transform(std::string_view content_type, file_transform transform)
+{
+    m_transforms[std::string {content_type}] = std::move(transform);
+}
+
+void file_cache::clear()
+{
+    std::lock_guard<std::mutex> lock {m_mutex};
+    m_index.clear();
+    m_lru.clear();
+    m_memory_usage = 0;
+    for(auto& [p, load] : m_loads)
+        load.stale = true;
+}
+
+bool file_cache::finish_load(const std::string& path)
+{
+    auto it = m_loads.find(path);
+    bool stale = it->second.stale;
+    if(--it->second.count == 0)
+        m_loads.erase(it);
+    return stale;
+}
+
+std::shared_ptr<const cached_file> file_cache::load(const std::string& path) const
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        throw std::invalid_argument {"Requested file not found."};
+
+    struct stat st {};
+    if(::fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        ::close(fd);
+        throw std::invalid_argument {"Requested file not found."};
+    }
+
+    auto entry = std::make_shared<cached_file>();
+    entry->path = path;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtim;
+    entry->content_type = content_type_of(path);
+
+    std::array<char, 64> etag;
+    int len = std::snprintf(etag.data(), etag.size(), "\"%zx-%llx-%lx\"", entry->size,
+        static_cast<unsigned long long>(st.st_mtim.tv_sec), static_cast<unsigned long>(st.st_mtim.tv_nsec));
+    entry->etag.assign(etag.data(), len);
+    entry->last_modified.resize(http_date_length);
+    format_http_date(st.st_mtim.tv_sec, entry->last_modified.data());
+    format_header_block(*entry);
+
+    if(entry->size <= m_max_entry_size)
+    {
+        auto content = std::make_shared<std::string>();
+        content->resize(entry->size);
+        size_t total = 0;
+        while(total < entry->size)
+        {
+            ssize_t bytes = ::pread(fd, content->data() + total, entry->size - total, total);
+            if(bytes <= 0)
+                break;
+            total += bytes;
+        }
+
+        // Only keep complete reads, a truncated file is served from disk
+        if(total == entry->size)
+        {
+            entry->content = std::move(content);
+            ::close(fd);
+            return entry;
+        }
+    }
+
+    // The descriptor is shared by all responses, sendfile never moves its offset
+    entry->file = std::make_shared<const file_handle>(fd, entry->size, st.st_mtime);
+    return entry;
+}
+
+bool file_cache::has_transform(const cached_file& entry) const
+{
+    return m_transforms.contains(std::string {entry.content_type});
+}
+
+void file_cache::apply_transform(cached_file& entry) const
+{
+    auto it = m_transforms.find(std::string {entry.content_type});
+    if(it == m_transforms.end())
+        return;
+
+    // A file the transform can not handle is still served as stored
+    try {
+        entry.spliced = it->second(entry);
+    } catch(std::exception& e) {
+        std::cerr << "Serving " << entry.path << " unchanged: " << e.what() << std::endl;
+    }
+}
+
+void file_cache::queue_transform(std::shared_ptr<const cached_file> entry)
+{
+    std::string key = entry->path;
+    m_jobs.post(std::move(key), [this, entry = std::move(entry)]() {
+        auto transformed = std::make_shared<cached_file>(*entry);
+        apply_transform(*transformed);
+
+        std::lock_guard<std::mutex> lock {m_mutex};
+        auto it = m_index.find(entry->path);
+        if(it == m_index.end() || it->second->entry != entry)
+            return;
+        bool watched = it->second->watched;
+        insert(std::move(transformed), watched);
+    });
+}
+
+void file_cache::insert(std::shared_ptr<const cached_file> entry, bool watched, bool transforming)
+{
+    // Another worker may have loaded the same file in the meantime
+    if(auto it = m_index.find(entry->path); it != m_index.end())
+        erase(it->second);
+
+    m_memory_usage += memory_of(*entry);
+    m_lru.push_front(slot {std::move(entry), watched, transforming});
+    m_index.emplace(m_lru.front().entry->path, m_lru.begin());
+
+    while((m_memory_usage > m_memory_budget || m_lru.size() > m_max_entries) && !m_lru.empty())
+        erase(std::prev(m_lru.end()));
+}
+
+void file_cache::erase(lru_list::iterator it)
+{
+    m_memory_usage -= memory_of(*it->entry);
+    m_index.erase(it->entry->path);
+    m_lru.erase(it);
+}
+
+bool file_cache::watch_directory(std::string_view path)
+{
+    if(m_inotify < 0)
+        return false;
+
+    size_t slash = path.rfind('/');
+    std::string dir {(slash == std::string_view::npos) ? std::string_view {"."} : path.substr(0, slash)};
+    if(m_watched_dirs.contains(dir))
+        return true;
+
+    int wd = ::inotify_add_watch(m_inotify, dir.c_str(), watch_mask);
+    if(wd < 0)
+        return false;
+    m_watches[wd] = dir;
+    m_watched_dirs.emplace(std::move(dir), wd);
+    return true;
+}
+
+void file_cache::watch_changes()
+{
+    alignas(inotify_event) std::array<char, 4096> buffer;
+    std::string path;
+    std::array<pollfd, 2> fds {{{m_inotify, POLLIN, 0}, {m_wakeup, POLLIN, 0}}};
+    while(true)
+    {
+        if(::poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return;
+        }
+        if(fds[1].revents != 0)
+            return;
+
+        ssize_t bytes;
+        while((bytes = ::read(m_inotify, buffer.data(), buffer.size())) > 0)
+        {
+            std::lock_guard<std::mutex> lock {m_mutex};
+            for(ssize_t pos = 0; pos < bytes; )
+            {
+                const auto* event = reinterpret_cast<const inotify_event*>(buffer.data() + pos);
+                pos += sizeof(inotify_event) + event->len;
+
+                if((event->mask & IN_Q_OVERFLOW) != 0)
+                {
+                    // Lost events, nothing cached can be trusted anymore
+                    m_index.clear();
+                    m_lru.clear();
+                    m_memory_usage = 0;
+                    for(auto& [p, load] : m_loads)
+                        load.stale = true;
+                    continue;
+                }
+
+                auto dir = m_watches.find(event->wd);
+                if(dir == m_watches.end())
+                    continue;
+
+                if((event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) != 0)
+                {
+                    // The paths of all entries below the directory changed
+                    for(auto it = m_lru.begin(); it != m_lru.end(); )
+                    {
+                        auto next = std::next(it);
+                        if(it->entry->path.starts_with(dir->second) && it->entry->path[dir->second.size()] == '/')
+                            erase(it);
+                        it = next;
+                    }
+                    for(auto& [p, load] : m_loads)
+                    {
+                        if(p.starts_with(dir->second) && p[dir->second.size()] == '/')
+                            load.stale = true;
+                    }
+                    if((event->mask & IN_IGNORED) == 0)
+                        ::inotify_rm_watch(m_inotify, event->wd);
+                    m_watched_dirs.erase(dir->second);
+                    m_watches.erase(dir);
+                    continue;
+                }
+
+                if(event->len == 0)
+                    continue;
+                path.assign(dir->second).append("/").append(event->name);
+                if(auto it = m_index.find(path); it != m_index.end())
+                    erase(it->second);
+                if(auto it = m_loads.find(path); it != m_loads.end())
+                    it->second.stale = true;
+            }
+        }
+    }
+}
+
+} // namespace http
@@ -0,0 +1,95 @@
+#include "http/http_date.hpp"
+
+#include <array>
+
+namespace http
+{
+
+// strftime and strptime would depend on the locale, HTTP dates are always english
+static constexpr std::array<const char*, 7> days {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static constexpr std::array<const char*, 12> months {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+void format_http_date(std::time_t time, char* out)
+{
+    std::tm tm {};
+    ::gmtime_r(&time, &tm);
+
+    auto two_digits = [](char* dest, int value) {
+        dest[0] = '0' + (value / 10) % 10;
+        dest[1] = '0' + value % 10;
+    };
+
+    const char* day = days[tm.tm_wday];
+    const char* month = months[tm.tm_mon];
+    int year = tm.tm_year + 1900;
+
+    out[0] = day[0]; out[1] = day[1]; out[2] = day[2];
+    out[3] = ','; out[4] = ' ';
+    two_digits(out + 5, tm.tm_mday);
+    out[7] = ' ';
+    out[8] = month[0]; out[9] = month[1]; out[10] = month[2];
+    out[11] = ' ';
+    two_digits(out + 12, year / 100);
+    two_digits(out + 14, year % 100);
+    out[16] = ' ';
+    two_digits(out + 17, tm.tm_hour);
+    out[19] = ':';
+    two_digits(out + 20, tm.tm_min);
+    out[22] = ':';
+    two_digits(out + 23, tm.tm_sec);
+    out[25] = ' '; out[26] = 'G'; out[27] = 'M'; out[28] = 'T';
+}
+
+bool parse_http_date(std::string_view date, std::time_t& out)
+{
+    if(date.size() != http_date_length || date.substr(3, 2) != ", " || date.substr(25) != " GMT"
+        || date[7] != ' ' || date[11] != ' ' || date[16] != ' ' || date[19] != ':' || date[22] != ':')
+        return false;
+
+    auto digits = [date](size_t pos, size_t count, int& value) {
+        value = 0;
+        for(size_t i = pos; i < pos + count; ++i)
+        {
+            if(date[i] < '0' || date[i] > '9')
+                return false;
+            value = value * 10 + (date[i] - '0');
+        }
+        return true;
+    };
+
+    std::tm tm {};
+    int year = 0;
+    if(!digits(5, 2, tm.tm_mday) || !digits(12, 4, year) || !digits(17, 2, tm.tm_hour)
+        || !digits(20, 2, tm.tm_min) || !digits(23, 2, tm.tm_sec))
+        return false;
+
+    tm.tm_mon = -1;
+    for(size_t i = 0; i < months.size(); ++i)
+    {
+        if(date.substr(8, 3) == months[i])
+            tm.tm_mon = static_cast<int>(i);
+    }
+    if(tm.tm_mon < 0 || tm.tm_mday < 1 || tm.tm_mday > 31 || tm.tm_hour > 23 || tm.tm_min > 59 || tm.tm_sec > 60)
+        return false;
+
+    tm.tm_year = year - 1900;
+    out = ::timegm(&tm);
+    return out != static_cast<std::time_t>(-1);
+}
+
+std::string_view current_http_date()
+{
+    thread_local std::time_t cached_second = -1;
+    thread_local std::array<char, http_date_length> cached_date;
+
+    std::time_t now = std::time(nullptr);
+    if(now != cached_second)
+    {
+        format_http_date(now, cached_date.data());
+        cached_second = now;
+    }
+    return std::string_view {cached_date.data(), cached_date.size()};
+}
+
+} // namespace http
@@ -0,0 +1,70 @@
+#include "http/job_queue.hpp"
+
+namespace http
+{
+
+job_queue::job_queue()
+    : m_worker {&job_queue::run, this}
+{}
+
+job_queue::~job_queue()
+{
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        m_stopping = true;
+        m_jobs.clear();
+    }
+    m_wakeup.notify_one();
+    m_worker.join();
+}
+
+void job_queue::set_listener(std::function<void()> listener)
+{
+    std::lock_guard<std::mutex> lock {m_listener_mutex};
+    m_listener = std::move(listener);
+}
+
+bool job_queue::post(std::string key, std::function<void()> work)
+{
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        if(m_stopping || !m_pending.insert(key).second)
+            return false;
+        m_jobs.push_back(job {std::move(key), std::move(work)});
+    }
+    m_wakeup.notify_one();
+    return true;
+}
+
+void job_queue::run()
+{
+    std::unique_lock<std::mutex> lock {m_mutex};
+    while(true)
+    {
+        m_wakeup.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+        if(m_stopping)
+            return;
+
+        job next = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        lock.unlock();
+        try {
+            next.work();
+        } catch(...) {
+        }
+        lock.lock();
+
+        // The key is released before the listener runs, a retried request
+        // either finds the result or posts a new job
+        m_pending.erase(next.key);
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> listener_lock {m_listener_mutex};
+            if(m_listener)
+                m_listener();
+        }
+        lock.lock();
+    }
+}
+
+} // namespace http
@@ -1,15 +1,22 @@
 #include "http/request.hpp"
+#include "http/request_parser.hpp"
 
-#include <charconv>
+#include <sstream>
+#include <iterator>
+#include <vector>
+#include <stdexcept>
 
 namespace http
 {
 
 request::request(const char* unparsed_request)
 {
-    try {
-        parse(unparsed_request);
-    } catch(const std::invalid_argument& ia) { throw ia; }
+    parse(unparsed_request);
+}
+
+request::request(const request& other)
+{
+    *this = other;
 }
 
 request::request(request&& other) noexcept
@@ -17,98 +24,63 @@ request::request(request&& other) noexcept
     *this = std::move(other);
 }
 
-request& request::operator=(request&& other)
+request& request::operator=(const request& other)
 {
-    this->m_request = std::move(other.m_request);
-    this->m_method = std::move(other.m_method);
-    this->m_protocol = std::move(other.m_protocol);
-    this->m_resource = std::move(other.m_resource);
-    this->m_path = std::move(other.m_path);
-    this->m_fragment = std::move(other.m_fragment);
-    this->m_query_params = std::move(other.m_query_params);
-    this->m_headers = std::move(other.m_headers);
-    this->m_cookies = std::move(other.m_cookies);
-    this->m_body_params = std::move(m_body_params);
-
-    other.m_method = std::string_view {other.m_request.data()};
-    other.m_protocol = std::string_view {other.m_request.data()};
-    other.m_resource = std::string_view {other.m_request.data()};
-    other.m_path = std::string_view {other.m_request.data()};
-    other.m_fragment = std::string_view {other.m_request.data()};
-    other.m_query_params.clear();
-    other.m_headers.clear();
-    other.m_cookies.clear();
-    other.m_body_params.clear();
+    if(this == &other)
+        return *this;
+
+    m_request = other.m_request;
+    m_method = other.m_method;
+    m_protocol = other.m_protocol;
+    m_resource = other.m_resource;
+    m_path = other.m_path;
+    m_fragment = other.m_fragment;
+    m_query_params = other.m_query_params;
+    m_headers = other.m_headers;
+    m_body_params = other.m_body_params;
+
+    // Views of an owning request have to point into the new copy
+    if(!m_request.empty())
+        rebase(other.m_request.data(), other.m_request.size());
 
     return *this;
 }
 
-void request::parse(const char* request)
+request& request::operator=(request&& other) noexcept
 {
-    size_t pos_q;
-    m_request = std::string {request};
-
-    /* extract the request line */
-    // std::istringstream request_stringstream(m_request);
-    // std::string request_line;
-    // getline(request_stringstream, request_line);
-    // this->parse_requestline(request_line);
-
-    // std::string_view full_request_view(m_request);
-    pos_q = m_request.find("\r\n");
-    if(pos_q == std::string::npos)
-        throw std::invalid_argument("invalid_request");
-    this->parse_requestline(std::string_view {m_request.data(), pos_q + 1});
-
-    /* Parse resource to path and params */
-    if((pos_q = m_resource.find('?')) == std::string::npos)
-    {
-        m_path = m_resource;
-    }
-    else
-    {
-        m_path = std::string_view {m_resource.data(), pos_q};
-        request::parse_params(std::string_view (m_resource.data() + pos_q + 1, m_protocol.data() - (m_resource.data() + pos_q + 1) - 1), m_query_params);
-    }
+    if(this == &other)
+        return *this;
+
+    // Short strings are copied on move, so the views may need to follow
+    const char* old_base = other.m_request.data();
+    size_t old_size = other.m_request.size();
+
+    m_request = std::move(other.m_request);
+    m_method = other.m_method;
+    m_protocol = other.m_protocol;
+    m_resource = other.m_resource;
+    m_path = other.m_path;
+    m_fragment = other.m_fragment;
+    m_query_params = std::move(other.m_query_params);
+    m_headers = std::move(other.m_headers);
+    m_body_params = std::move(other.m_body_params);
 
-    /* Read and parse request headers */
-    size_t start_pos = m_request.find("\r\n") + 2, mid_pos, end_pos;
-    std::string_view headerline {m_request.data() + start_pos};
-    while(headerline != "\r\n" || headerline != "\r" || headerline != "\n")
-    {
-        mid_pos = headerline.find(':');
-        end_pos = headerline.find("\r\n");
-        if(end_pos == 0)
-            break;
-
-        if(start_pos == std::string_view::npos || mid_pos == std::string_view::npos || end_pos == std::string_view::npos)
-            throw std::invalid_argument {"invalid_request"};
-
-        m_headers.insert({ std::string_view {headerline.data(), mid_pos}, std::string_view {headerline.data() + mid_pos + 2, end_pos - (mid_pos + 2)} });
- 
-        start_pos = end_pos;
-        headerline = std::string_view {headerline.data() + end_pos + 2};
-    }
+    if(!m_request.empty())
+        rebase(old_base, old_size);
 
-    /* Read cookies and put it in m_cookies */
-    auto it = m_headers.find("Cookie");
-    if(it != m_headers.end())
-    {
-        this->parse_cookies(it->second.data());
-    }
+    other.m_request.clear();
+    other.clear();
 
-    /* Parse POST parameters */
-    if(m_method == "POST" || m_method == "post")
-    {
-        int length = 0;
-        std::string_view hdr = get_header("Content-Length");
-        auto res = std::from_chars(hdr.data(), hdr.data() + hdr.size(), length);
-        if(res.ec != std::errc::invalid_argument && length > 0)
-        {
-            std::string_view body {headerline.data() + end_pos + 2};
-            request::parse_params(body, m_body_params);
-        }
-    }
+    return *this;
+}
+
+void request::parse(const char* request)
+{
+    m_request = request;
+
+    request_parser parser {m_request.size()};
+    if(parser.parse(m_request, *this) != parse_status::complete)
+        throw std::invalid_argument {"invalid_request"};
 }
 
 std::string request::to_string() const
@@ -116,132 +88,121 @@ std::string request::to_string() const
     if(!m_request.empty())
         return m_request;
 
-    // TODO Fix this to work with string_view
-
-    std::string request {m_method.data()};
-    ((request += " ") += m_path.data()) += "?";
-    for(const auto& it : m_query_params)
-        (((request += it.first.data()) += "=") += it.second.data()) += "&";
-
-    request.pop_back();
+    std::string request {m_method};
+    (request += " ") += m_resource;
     // TODO append fragment to headerline (#...)
     request += " HTTP/1.1\r\n";
-   
-    for(const auto& it : m_headers)
-        (((request += it.first.data()) += ": ") += it.second.data()) += "\r\n";
+
+    for(const auto& f : m_headers)
+        (((request += f.name) += ": ") += f.value) += "\r\n";
 
     request += "\r\n";
 
-    for(const auto& it : m_body_params)
-        (((request += it.first.data()) += "=") += it.second.data()) += "&";
+    for(const auto& f : m_body_params)
+        (((request += f.name) += "=") += f.value) += "&";
+
+    if(!m_body_params.empty())
+        request.pop_back();
 
-    request.pop_back();
-    
     return request;
 }
 
-cookie request::get_cookie(const std::string& cookie_name) const
+std::map<std::string, cookie> request::get_cookies() const
 {
-    try
-    {
-        return m_cookies.at(cookie_name);
-    }
-    catch(std::out_of_range& e)
-    {
-        throw std::out_of_range {"No matching cookie found"};
-    }
-}
+    std::map<std::string, cookie> cookies;
+    std::string_view cookie_hdr = m_headers.get("Cookie");
+    if(cookie_hdr.empty())
+        return cookies;
 
-void request::parse_requestline(std::string_view requestline)
-{
-    uint32_t last_index = 0, vec_index = 0;
-    std::string_view tmp_store[3];
-    for(uint32_t i = 0; i < requestline.size() && vec_index < 3; i++)
+    std::istringstream iss {std::string {cookie_hdr}};
+    std::vector<std::string> cookies_split {(std::istream_iterator<std::string> {iss}),
+                                          std::istream_iterator<std::string> {}};
+
+    for(auto& it : cookies_split)
     {
-        if(requestline[i] == ' ' || i + 1 == requestline.size())
-        {
-            tmp_store[vec_index] = std::string_view {requestline.data() + last_index, i - last_index};
-            last_index = i + 1;
-            vec_index++;
-        }
+        if(it.find(';') != string::npos)
+            it = it.substr(0, it.length() - 1);
+
+        size_t pos = it.find('=');
+        cookie c(it.substr(0, pos), it.substr(pos + 1));
+        cookies.insert(std::pair<std::string, cookie> {it.substr(0, pos), c});
     }
 
-    if(vec_index != 3)
-        throw std::invalid_argument {"invalid_requestline"};
+    return cookies;
+}
 
-    this->m_method = tmp_store[0];
-    this->m_resource = tmp_store[1];
-    this->m_protocol = tmp_store[2];
+cookie request::get_cookie(const std::string& cookie_name) const
+{
+    std::map<std::string, cookie> cookies = get_cookies();
+    auto it = cookies.find(cookie_name);
+    if(it == cookies.end())
+        throw std::out_of_range {"No matching cookie found"};
+    return it->second;
 }
 
-void request::parse_params(std::string_view param_string, std::map<std::string_view, std::string_view>& param_container)
+void request::parse_params(std::string_view param_string, param_table& param_container)
 {
     uint32_t offset = 0;
     for(uint32_t i = 0; i <= param_string.length(); i++)
     {
-        if(param_string[i] == '&' || param_string[i] == '#' || i == param_string.length())
+        if(i == param_string.length() || param_string[i] == '&' || param_string[i] == '#')
         {
-           std::string_view param {param_string.data() + offset, i - offset};
-            size_t pos = param_string.find('=');
+            std::string_view param {param_string.data() + offset, i - offset};
+            size_t pos = param.find('=');
             if(pos != std::string::npos)
-            {
-                param_container.insert({ std::string_view {param.data(), pos}, 
-                    std::string_view {param.data() + pos + 1, i - offset - pos - 1} });
-            }
+                param_container.add(param.substr(0, pos), param.substr(pos + 1));
             offset = i + 1;
         }
     }
 }
 
-void request::parse_cookies(const std::string& cookies)
+void request::own(std::string_view source)
 {
-    std::istringstream iss {cookies};
-    std::vector<std::string> cookies_split {(std::istream_iterator<std::string> {iss}),
-                                          std::istream_iterator<std::string> {}};
-
-    for(auto& it : cookies_split)
-    {
-        if(it.find(';') != string::npos)
-            it = it.substr(0, it.length() - 1);
-
-        size_t pos = it.find('=');
-        cookie c(it.substr(0, pos), it.substr(pos + 1));
-        m_cookies.insert(std::pair<std::string, cookie> {it.substr(0, pos), c});
-    }
-
-}
-
-bool request::check_header(const std::string& key) const
-{
-    auto it = m_headers.find(key);
-    return it != m_headers.end();
+    if(!m_request.empty())
+        return;
+    m_request.assign(source);
+    rebase(source.data(), source.size());
 }
 
-std::string_view request::get_header(const std::string& key) const
+void request::rebase(const char* old_base, size_t old_size)
 {
-    try {
-        return m_headers.at(key);
-    } catch(std::out_of_range& e) {
-        return "";
+    auto move_view = [this, old_base, old_size](std::string_view& view) {
+        if(view.data() >= old_base && view.data() <= old_base + old_size)
+            view = std::string_view {m_request.data() + (view.data() - old_base), view.size()};
+    };
+
+    move_view(m_method);
+    move_view(m_protocol);
+    move_view(m_resource);
+    move_view(m_path);
+    move_view(m_fragment);
+
+    for(auto* table : {&m_query_params, &m_body_params})
+    {
+        for(auto& f : *table)
+        {
+            move_view(f.name);
+            move_view(f.value);
+        }
     }
-}
 
-std::string_view request::get_param(const std::string& key) const
-{
-    try {
-        return m_query_params.at(key);
-    } catch(std::out_of_range& e) {
-        return "";
+    for(auto& f : m_headers)
+    {
+        move_view(f.name);
+        move_view(f.value);
     }
 }
 
-std::string_view request::get_post_param(const std::string& key) const
+void request::clear()
 {
-    try {
-        return m_body_params.at(key);
-    } catch(std::out_of_range& e) {
-        return "";
-    }
+    m_method = std::string_view {};
+    m_protocol = std::string_view {};
+    m_resource = std::string_view {};
+    m_path = std::string_view {};
+    m_fragment = std::string_view {};
+    m_query_params.clear();
+    m_headers.clear();
+    m_body_params.clear();
 }
 
 } // namespace http
@@ -0,0 +1,264 @@
+#include "http/request_parser.hpp"
+
+#include <charconv>
+
+namespace http
+{
+
+// Characters allowed in methods and header names (RFC 7230 tchar)
+static bool is_token_char(char c)
+{
+    if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+        return true;
+
+    switch(c)
+    {
+        case '!': case '#': case '$': case '%': case '&': case '\'': case '*': case '+':
+        case '-': case '.': case '^': case '_': case '`': case '|': case '~':
+            return true;
+        default:
+            return false;
+    }
+}
+
+parse_status request_parser::parse(std::string_view data, request& req)
+{
+    parse_status status = scan(data);
+    if(status == parse_status::complete)
+        fill_request(data, req);
+    return status;
+}
+
+void request_parser::reset()
+{
+    m_state = state::method;
+    m_pos = 0;
+    m_body_length = 0;
+    m_method = token {};
+    m_target = token {};
+    m_version = token {};
+    m_headers.clear();
+}
+
+parse_status request_parser::scan(std::string_view data)
+{
+    while(m_state != state::done)
+    {
+        if(m_state == state::body)
+        {
+            if(data.size() - m_pos < m_body_length)
+                break;
+            m_pos += m_body_length;
+            m_state = state::done;
+            continue;
+        }
+
+        // The header block alone must not exceed the limit, no matter whether
+        // the rest of the request already arrived
+        if(m_pos >= m_max_request_size)
+            return parse_status::too_large;
+
+        if(m_pos >= data.size())
+            break;
+
+        char c = data[m_pos];
+        switch(m_state)
+        {
+            case state::method:
+                if(c == ' ' && m_pos > m_method.start)
+                {
+                    m_method.end = m_pos;
+                    m_target.start = m_pos + 1;
+                    m_state = state::target;
+                }
+                else if(!is_token_char(c))
+                {
+                    return parse_status::error;
+                }
+                break;
+
+            case state::target:
+                if(c == ' ' && m_pos > m_target.start)
+                {
+                    m_target.end = m_pos;
+                    m_version.start = m_pos + 1;
+                    m_state = state::version;
+                }
+                else if(c <= ' ' || c == 0x7f)
+                {
+                    return parse_status::error;
+                }
+                break;
+
+            case state::version:
+                if(c == '\r' || c == '\n')
+                {
+                    m_version.end = m_pos;
+                    std::string_view version = data.substr(m_version.start, m_version.end - m_version.start);
+                    if(version.size() != 8 || version.substr(0, 7) != "HTTP/1.")
+                        return parse_status::error;
+                    m_state = (c == '\r') ? state::request_line_end : state::header_start;
+                }
+                else if(c <= ' ')
+                {
+                    return parse_status::error;
+                }
+                break;
+
+            case state::request_line_end:
+            case state::header_line_end:
+                if(c != '\n')
+                    return parse_status::error;
+                m_state = state::header_start;
+                break;
+
+            case state::header_start:
+                if(c == '\r')
+                {
+                    m_state = state::headers_end;
+                }
+                else if(c == '\n')
+                {
+                    if(parse_status status = prepare_body(data); status != parse_status::need_more)
+                        return status;
+                }
+                else if(is_token_char(c))
+                {
+                    m_headers.push_back(header_token {token {static_cast<uint32_t>(m_pos), 0}, token {}});
+                    m_state = state::header_name;
+                }
+                else
+                {
+                    // Also rejects obsolete line folding
+                    return parse_status::error;
+                }
+                break;
+
+            case state::header_name:
+                if(c == ':')
+                {
+                    m_headers.back().name.end = m_pos;
+                    m_state = state::header_value_start;
+                }
+                else if(!is_token_char(c))
+                {
+                    return parse_status::error;
+                }
+                break;
+
+            case state::header_value_start:
+                if(c == ' ' || c == '\t')
+                    break;
+                m_headers.back().value.start = m_pos;
+                m_headers.back().value.end = m_pos;
+                m_state = state::header_value;
+                [[fallthrough]];
+
+            case state::header_value:
+                if(c == '\r' || c == '\n')
+                {
+                    m_state = (c == '\r') ? state::header_line_end : state::header_start;
+                }
+                else if(c == ' ' || c == '\t')
+                {
+                    // Trailing whitespace is not part of the value
+                }
+                else if(static_cast<unsigned char>(c) < ' ' || c == 0x7f)
+                {
+                    return parse_status::error;
+                }
+                else
+                {
+                    m_headers.back().value.end = m_pos + 1;
+                }
+                break;
+
+            case state::headers_end:
+                if(c != '\n')
+                    return parse_status::error;
+                if(parse_status status = prepare_body(data); status != parse_status::need_more)
+                    return status;
+                break;
+
+            default:
+                return parse_status::error;
+        }
+
+        ++m_pos;
+    }
+
+    if(m_state == state::done)
+        return parse_status::complete;
+
+    // An incomplete request filling the whole limit can never complete
+    return (data.size() >= m_max_request_size) ? parse_status::too_large : parse_status::need_more;
+}
+
+parse_status request_parser::prepare_body(std::string_view data)
+{
+    m_body_length = 0;
+    bool has_length = false;
+    for(const auto& hdr : m_headers)
+    {
+        std::string_view name = data.substr(hdr.name.start, hdr.name.end - hdr.name.start);
+        std::string_view value = data.substr(hdr.value.start, hdr.value.end - hdr.value.start);
+        if(equals_ignore_case(name, "Content-Length"))
+        {
+            size_t length = 0;
+            auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), length);
+            if(ec != std::errc {} || ptr != value.data() + value.size())
+                return parse_status::error;
+
+            // Differing lengths leave the end of the body ambiguous, a proxy
+            // in front may have picked another one (request smuggling)
+            if(has_length && length != m_body_length)
+                return parse_status::error;
+            m_body_length = length;
+            has_length = true;
+        }
+        else if(equals_ignore_case(name, "Transfer-Encoding"))
+        {
+            // Chunked request bodies are not supported
+            return parse_status::error;
+        }
+    }
+
+    // m_pos still points at the final line feed and is below the limit
+    size_t header_length = m_pos + 1;
+    m_state = state::body;
+    if(m_body_length > m_max_request_size - header_length)
+        return parse_status::too_large;
+    return parse_status::need_more;
+}
+
+void request_parser::fill_request(std::string_view data, request& req) const
+{
+    auto view = [data](token t) {
+        return data.substr(t.start, t.end - t.start);
+    };
+
+    // Keep the raw request of the caller, the views may point into it
+    req.clear();
+
+    req.m_method = view(m_method);
+    req.m_resource = view(m_target);
+    req.m_protocol = view(m_version);
+
+    if(size_t pos_q = req.m_resource.find('?'); pos_q == std::string_view::npos)
+    {
+        req.m_path = req.m_resource;
+    }
+    else
+    {
+        req.m_path = req.m_resource.substr(0, pos_q);
+        request::parse_params(req.m_resource.substr(pos_q + 1), req.m_query_params);
+    }
+
+    for(const auto& hdr : m_headers)
+        req.m_headers.add(view(hdr.name), view(hdr.value));
+
+    if(m_body_length > 0 && (req.m_method == "POST" || req.m_method == "post"))
+        request::parse_params(data.substr(m_pos - m_body_length, m_body_length), req.m_body_params);
+}
+
+} // namespace http
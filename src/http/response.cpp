@@ -1,62 +1,115 @@
 #include <fstream>
 #include <sstream>
+#include <type_traits>
 
 #include "http/response.hpp"
+#include "http/field_table.hpp"
+#include "http/http_date.hpp"
+#include "http/text.hpp"
 
 namespace http
 {
 
 std::mutex response::c_file_mutex;
 
-static std::string get_http_phrase(int status_code)
+static std::string_view get_http_phrase(int status_code)
 {
-    // TODO
-    return "OK";
+    switch(status_code)
+    {
+        case 100: return "Continue";
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 412: return "Precondition Failed";
+        case 413: return "Payload Too Large";
+        case 414: return "URI Too Long";
+        case 415: return "Unsupported Media Type";
+        case 416: return "Range Not Satisfiable";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+    }
 }
 
-std::string response::to_string()
+void response::write_to(std::string& out) const
 {
-    std::string response;
-
-    /* Set some response fields if missing */
-    if(m_code == 0)
-    {
-        m_code = 200;
-    }
-    if(m_headers.find("Content-Type") == m_headers.end())
-    {
-        m_headers.insert(std::pair<string, string> {"Content-Type", "text/html; charset=UTF-8"});
-    }
-    std::time_t now {std::chrono::system_clock::to_time_t(std::chrono::system_clock::now())};
+    int code = (m_code == 0) ? 200 : m_code;
 
     /* Begin with response line */
-    if(m_phrase.empty())
-        response.append("HTTP/1.1 " + std::to_string(m_code) + " " + get_http_phrase(m_code) + "\r\n" + "Date: " + std::ctime(&now));
-    else
-        response.append("HTTP/1.1 " + std::to_string(m_code) + " " + m_phrase + "\r\n" + "Date: " + std::ctime(&now));
+    out.append("HTTP/1.1 ");
+    append_number(out, code);
+    out.push_back(' ');
+    out.append((m_phrase.empty()) ? get_http_phrase(code) : std::string_view {m_phrase});
+    out.append("\r\nDate: ");
+    out.append(current_http_date());
+    out.append("\r\n");
 
     /* Append all cookies to response */
-    for(auto& it : m_cookies) //TODO auto& or auto?
+    for(const auto& it : m_cookies)
     {
-        response.append(it.second.build_header() + "\r\n");
+        out.append(cookie {it.second}.build_header());
+        out.append("\r\n");
     }
 
     /* Append all headers to response */
-    for(auto& it : m_headers) //TODO auto& or auto
+    for(size_t i = 0; i < m_header_count; ++i)
     {
-        response.append(it.first + ": " + it.second + "\r\n");
+        out.append(m_headers[i].name);
+        out.append(": ");
+        out.append(m_headers[i].value);
+        out.append("\r\n");
     }
+    out.append(m_header_block);
 
-    /* Append body to response line */
-    response.append("\r\n");
-    if(!m_body.empty())
+    /* Set some response fields if missing, responses without content get none */
+    bool has_content = code >= 200 && code != 204 && code != 304;
+    if(has_content && !has_header("Content-Type"))
+        out.append("Content-Type: text/html; charset=UTF-8\r\n");
+    if(has_content && !has_header("Content-Length"))
     {
-        response.append(m_body);
+        // Persistent connections need the length to find the end of the response
+        out.append("Content-Length: ");
+        append_number(out, m_body.size());
+        out.append("\r\n");
     }
 
+    /* Append body to response line */
+    out.append("\r\n");
+    out.append(m_body);
+}
+
+std::string response::to_string() const
+{
+    std::string response;
+    write_to(response);
     return response;
 }
 
+void response::clear()
+{
+    m_code = 0;
+    m_parked = false;
+    m_phrase.clear();
+    m_body.clear();
+    m_body_source = std::monostate {};
+    m_header_count = 0;
+    m_header_block_owner.reset();
+    m_header_block = std::string_view {};
+    m_cookies.clear();
+}
+
 void response::set_body_from_file(const std::string &bodyFile)
 {
     /* Open template file and read it into a string if found */
@@ -79,16 +132,73 @@ void response::set_body_from_file(const std::string &bodyFile)
     this->set_body(sstr.str());
 }
 
-void response::set_body(const std::string& body)
+void response::set_body(std::string_view body)
+{
+    m_body.assign(body);
+    m_body_source = std::monostate {};
+    set_header("Content-Length", m_body.size());
+}
+
+void response::set_body_file(std::shared_ptr<const file_handle> file, size_t offset, size_t length)
+{
+    m_body.clear();
+    m_body_source = file_body {std::move(file), offset, length};
+    set_header("Content-Length", length);
+}
+
+void response::set_body_shared(std::shared_ptr<const void> owner, std::string_view data)
+{
+    m_body.clear();
+    m_body_source = memory_body {std::move(owner), data};
+    set_header("Content-Length", data.size());
+}
+
+void response::set_body_multipart(multipart_body&& body)
 {
-    m_body = body;
-    set_header("Content-Length", std::to_string(m_body.size()));
+    size_t length = body.trailer.size();
+    for(const auto& part : body.parts)
+    {
+        length += part.header.size();
+        std::visit([&length](const auto& slice) {
+            if constexpr(std::is_same_v<std::decay_t<decltype(slice)>, file_body>)
+                length += slice.length;
+            else
+                length += slice.data.size();
+        }, part.data);
+    }
+
+    m_body.clear();
+    m_body_source = std::move(body);
+    set_header("Content-Length", length);
 }
 
-void response::set_body(std::string&& body)
+void response::set_body_pieces(std::vector<body_piece>&& pieces)
 {
-    m_body = std::move(body);
-    set_header("Content-Length", std::to_string(m_body.size()));
+    if(pieces.size() == 1)
+    {
+        std::visit([this](auto&& piece) {
+            if constexpr(std::is_same_v<std::decay_t<decltype(piece)>, file_body>)
+                set_body_file(std::move(piece.file), piece.offset, piece.length);
+            else
+                set_body_shared(std::move(piece.owner), piece.data);
+        }, pieces.front());
+        return;
+    }
+
+    // Sent like a multipart body whose parts have no headers
+    multipart_body body;
+    body.parts.reserve(pieces.size());
+    for(auto& piece : pieces)
+        body.parts.push_back(body_part {std::string {}, std::move(piece)});
+    set_body_multipart(std::move(body));
+}
+
+void response::omit_body()
+{
+    if(!has_header("Content-Length"))
+        set_header("Content-Length", m_body.size());
+    m_body.clear();
+    m_body_source = std::monostate {};
 }
 
 void response::send_redirect(const std::string& url)
@@ -97,14 +207,48 @@ void response::send_redirect(const std::string& url)
     this->set_code(302);
 }
 
-void response::set_header(const std::string& key, const std::string& value)
+response::header& response::header_slot(std::string_view key)
 {
-    m_headers[key] = value;
+    for(size_t i = 0; i < m_header_count; ++i)
+    {
+        if(equals_ignore_case(m_headers[i].name, key))
+            return m_headers[i];
+    }
+
+    if(m_header_count == m_headers.size())
+        m_headers.emplace_back();
+
+    header& slot = m_headers[m_header_count++];
+    slot.name.assign(key);
+    return slot;
+}
+
+void response::set_header(std::string_view key, std::string_view value)
+{
+    header_slot(key).value.assign(value);
+}
+
+void response::set_header(std::string_view key, uint64_t value)
+{
+    header& slot = header_slot(key);
+    slot.value.clear();
+    append_number(slot.value, value);
+}
+
+bool response::has_header(std::string_view key) const
+{
+    for(size_t i = 0; i < m_header_count; ++i)
+    {
+        if(equals_ignore_case(m_headers[i].name, key))
+            return true;
+    }
+    return false;
 }
 
-void response::set_header(const std::string& key, std::string&& value)
+void response::set_header_block(std::shared_ptr<const void> owner, std::string_view block)
 {
-    m_headers[key] = std::move(value);
+    m_header_block_owner = std::move(owner);
+    m_header_block = block;
 }
 
 void response::add_cookie(cookie&& cookie)
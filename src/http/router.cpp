@@ -0,0 +1,142 @@
+#include "http/router.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <utility>
+
+namespace http
+{
+
+namespace methods
+{
+
+static constexpr std::array<std::pair<std::string_view, uint8_t>, 6> names {{
+    {"GET", get}, {"HEAD", head}, {"POST", post}, {"PUT", put}, {"DELETE", del}, {"OPTIONS", options}
+}};
+
+uint8_t from_string(std::string_view method)
+{
+    for(const auto& [name, bit] : names)
+    {
+        if(name == method)
+            return bit;
+    }
+    return 0;
+}
+
+} // namespace methods
+
+static std::string allow_header(uint8_t allowed_methods)
+{
+    std::string allow;
+    for(const auto& [name, bit] : methods::names)
+    {
+        if((allowed_methods & bit) == 0)
+            continue;
+        if(!allow.empty())
+            allow.append(", ");
+        allow.append(name);
+    }
+    return allow;
+}
+
+void router::add(std::string_view pattern, match_kind kind, uint8_t allowed_methods, route_handler handler)
+{
+    if(m_compiled)
+        throw std::logic_error {"Routes can not be added to a compiled router."};
+
+    uint32_t current = 0;
+    for(char c : pattern)
+    {
+        auto [it, inserted] = m_children[current].try_emplace(static_cast<unsigned char>(c),
+            static_cast<uint32_t>(m_nodes.size()));
+        if(inserted)
+        {
+            m_nodes.emplace_back();
+            m_children.emplace_back();
+        }
+        current = it->second;
+    }
+
+    int32_t& slot = (kind == match_kind::exact) ? m_nodes[current].exact : m_nodes[current].prefix;
+    route r {allowed_methods, allow_header(allowed_methods), std::move(handler)};
+    if(slot >= 0)
+    {
+        m_routes[slot] = std::move(r);
+        return;
+    }
+    slot = static_cast<int32_t>(m_routes.size());
+    m_routes.push_back(std::move(r));
+}
+
+void router::compile()
+{
+    if(m_compiled)
+        return;
+
+    // Node indices stay the same, only the edges of every node are laid out
+    // next to each other so a lookup touches one small sorted range per byte
+    m_edges.clear();
+    for(size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        m_nodes[i].first_edge = static_cast<uint32_t>(m_edges.size());
+        m_nodes[i].edge_count = static_cast<uint32_t>(m_children[i].size());
+        for(const auto& [byte, target] : m_children[i])
+            m_edges.push_back(edge {byte, target});
+    }
+
+    m_children.clear();
+    m_children.shrink_to_fit();
+    m_compiled = true;
+}
+
+int32_t router::find(std::string_view path) const
+{
+    uint32_t current = 0;
+    int32_t best = m_nodes[0].prefix;
+    for(char c : path)
+    {
+        const node& n = m_nodes[current];
+        auto first = m_edges.begin() + n.first_edge;
+        auto last = first + n.edge_count;
+        auto byte = static_cast<unsigned char>(c);
+        auto it = std::lower_bound(first, last, byte, [](const edge& e, unsigned char b) {
+            return e.byte < b;
+        });
+        if(it == last || it->byte != byte)
+            return best;
+
+        current = it->target;
+        if(m_nodes[current].prefix >= 0)
+            best = m_nodes[current].prefix;
+    }
+
+    if(m_nodes[current].exact >= 0)
+        return m_nodes[current].exact;
+    return best;
+}
+
+void router::dispatch(const request& req, response& res) const
+{
+    int32_t index = find(req.get_path());
+    if(index < 0)
+    {
+        res.set_code(404);
+        res.set_body("");
+        return;
+    }
+
+    const route& r = m_routes[index];
+    if((r.allowed_methods & methods::from_string(req.get_method())) == 0)
+    {
+        res.set_code(405);
+        res.set_header("Allow", r.allow);
+        res.set_body("");
+        return;
+    }
+
+    r.handler(req, res);
+}
+
+} // namespace http
@@ -0,0 +1,32 @@
+#include "http/text.hpp"
+
+#include <array>
+#include <charconv>
+
+namespace http
+{
+
+std::string_view trim(std::string_view value)
+{
+    while(!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+        value.remove_prefix(1);
+    while(!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+        value.remove_suffix(1);
+    return value;
+}
+
+void append_number(std::string& out, uint64_t value)
+{
+    std::array<char, 20> buffer;
+    auto [end, ec] = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+    out.append(buffer.data(), end - buffer.data());
+}
+
+void append_duration(std::string& out, double seconds)
+{
+    std::array<char, 32> buffer;
+    auto [end, ec] = std::to_chars(buffer.data(), buffer.data() + buffer.size(), seconds, std::chars_format::fixed, 3);
+    out.append(buffer.data(), end - buffer.data());
+}
+
+} // namespace http
@@ -0,0 +1,44 @@
+#include "http/tls_context.hpp"
+
+#include "socketwrapper.hpp"
+
+namespace http
+{
+
+static constexpr std::string_view session_id_context = "desk_cast";
+
+std::shared_ptr<SSL_CTX> create_tls_context(std::string_view cert_path, std::string_view key_path)
+{
+    net::utility::init_ssl_system();
+
+    std::shared_ptr<SSL_CTX> ctx;
+    net::utility::configure_ssl_ctx(ctx, cert_path, key_path, true);
+
+    if(SSL_CTX_check_private_key(ctx.get()) != 1)
+        throw std::runtime_error {"Private key does not match the certificate."};
+
+    SSL_CTX_set_min_proto_version(ctx.get(), TLS1_2_VERSION);
+
+    // Writes on non-blocking sockets return after every record, retries may
+    // pass the remaining data from a different address
+    SSL_CTX_set_mode(ctx.get(), SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+
+    // Receivers reconnect for every segment on some platforms, resumed
+    // sessions skip the key exchange. The ticket keys belong to the context,
+    // which is shared by all workers
+    SSL_CTX_clear_options(ctx.get(), SSL_OP_NO_TICKET);
+    SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_id_context(ctx.get(), reinterpret_cast<const unsigned char*>(session_id_context.data()),
+        session_id_context.size());
+    SSL_CTX_set_timeout(ctx.get(), 3600);
+
+#ifdef SSL_OP_ENABLE_KTLS
+    // Record encryption moves into the kernel once the handshake finished if
+    // the kernel and the negotiated cipher support it
+    SSL_CTX_set_options(ctx.get(), SSL_OP_ENABLE_KTLS);
+#endif
+
+    return ctx;
+}
+
+} // namespace http
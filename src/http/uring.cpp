@@ -0,0 +1,169 @@
+#include "http/uring.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace http
+{
+
+static int io_uring_setup(unsigned entries, io_uring_params* params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+uring::uring(unsigned entries)
+    : m_fd {io_uring_setup(entries, &m_params)}
+{
+    if(m_fd < 0)
+        throw std::runtime_error {"Failed to set up io_uring."};
+
+    m_sq_ring_size = m_params.sq_off.array + m_params.sq_entries * sizeof(unsigned);
+    m_cq_ring_size = m_params.cq_off.cqes + m_params.cq_entries * sizeof(io_uring_cqe);
+
+    // Newer kernels map both rings with a single mmap
+    bool single_mmap = m_params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap)
+        m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+
+    m_sq_ring = ::mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if(m_sq_ring == MAP_FAILED)
+    {
+        m_sq_ring = nullptr;
+        ::close(m_fd);
+        throw std::runtime_error {"Failed to map submission queue."};
+    }
+
+    if(single_mmap)
+    {
+        m_cq_ring = m_sq_ring;
+    }
+    else
+    {
+        m_cq_ring = ::mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if(m_cq_ring == MAP_FAILED)
+        {
+            m_cq_ring = nullptr;
+            ::munmap(m_sq_ring, m_sq_ring_size);
+            ::close(m_fd);
+            throw std::runtime_error {"Failed to map completion queue."};
+        }
+    }
+
+    void* sqes = ::mmap(nullptr, m_params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED)
+    {
+        if(m_cq_ring != m_sq_ring)
+            ::munmap(m_cq_ring, m_cq_ring_size);
+        ::munmap(m_sq_ring, m_sq_ring_size);
+        ::close(m_fd);
+        throw std::runtime_error {"Failed to map submission entries."};
+    }
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    auto* sq = static_cast<char*>(m_sq_ring);
+    m_sq_head = reinterpret_cast<unsigned*>(sq + m_params.sq_off.head);
+    m_sq_tail = reinterpret_cast<unsigned*>(sq + m_params.sq_off.tail);
+    m_sq_array = reinterpret_cast<unsigned*>(sq + m_params.sq_off.array);
+    m_sq_mask = *reinterpret_cast<unsigned*>(sq + m_params.sq_off.ring_mask);
+    m_sq_entries = *reinterpret_cast<unsigned*>(sq + m_params.sq_off.ring_entries);
+    m_sq_local_tail = m_sq_submitted = *m_sq_tail;
+
+    auto* cq = static_cast<char*>(m_cq_ring);
+    m_cq_head = reinterpret_cast<unsigned*>(cq + m_params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned*>(cq + m_params.cq_off.tail);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + m_params.cq_off.cqes);
+    m_cq_mask = *reinterpret_cast<unsigned*>(cq + m_params.cq_off.ring_mask);
+
+    // Kernels without probing support only know the oldest operations
+    std::vector<char> buffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+    auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+    if(io_uring_register(m_fd, IORING_REGISTER_PROBE, probe, 256) == 0)
+    {
+        m_probed = true;
+        m_last_op = probe->last_op;
+        for(unsigned i = 0; i < probe->ops_len && i < 256; ++i)
+        {
+            if(probe->ops[i].flags & IO_URING_OP_SUPPORTED)
+                m_supported[probe->ops[i].op / 64] |= uint64_t {1} << (probe->ops[i].op % 64);
+        }
+    }
+}
+
+uring::~uring()
+{
+    ::munmap(m_sqes, m_params.sq_entries * sizeof(io_uring_sqe));
+    if(m_cq_ring != m_sq_ring)
+        ::munmap(m_cq_ring, m_cq_ring_size);
+    ::munmap(m_sq_ring, m_sq_ring_size);
+    ::close(m_fd);
+}
+
+bool uring::supports(uint8_t opcode) const
+{
+    return m_probed && opcode <= m_last_op && (m_supported[opcode / 64] & (uint64_t {1} << (opcode % 64)));
+}
+
+io_uring_sqe& uring::next_sqe()
+{
+    if(m_sq_local_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries)
+        submit(0);
+
+    unsigned index = m_sq_local_tail & m_sq_mask;
+    io_uring_sqe& sqe = m_sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    m_sq_array[index] = index;
+    ++m_sq_local_tail;
+    return sqe;
+}
+
+void uring::submit_and_wait(unsigned wait_nr)
+{
+    submit(wait_nr);
+}
+
+void uring::submit(unsigned wait_nr)
+{
+    __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+
+    while(true)
+    {
+        unsigned to_submit = m_sq_local_tail - m_sq_submitted;
+        if(to_submit == 0 && wait_nr == 0)
+            return;
+
+        int ret = io_uring_enter(m_fd, to_submit, wait_nr, (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0);
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            // Completion queue is full, the caller has to reap before more can be submitted
+            if(errno == EBUSY || errno == EAGAIN)
+                return;
+            throw std::runtime_error {"Failed to submit to io_uring."};
+        }
+
+        m_sq_submitted += ret;
+        if(static_cast<unsigned>(ret) >= to_submit)
+            return;
+    }
+}
+
+} // namespace http
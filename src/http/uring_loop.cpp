@@ -0,0 +1,395 @@
+#include "http/uring_loop.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+
+#include <sys/socket.h>
+
+namespace http
+{
+
+static constexpr unsigned ring_entries = 256;
+static constexpr int poll_interval_ms = 250;
+static constexpr size_t recv_size = 16 * 1024;
+static constexpr size_t staging_size = 64 * 1024;
+
+uint64_t uring_loop::user_data(int fd, operation op)
+{
+    return (static_cast<uint64_t>(static_cast<uint32_t>(fd)) << 8) | static_cast<uint8_t>(op);
+}
+
+uring_loop::uring_loop(std::string_view bind_addr, uint16_t port, request_handler handler, const server_config& config)
+    : event_loop {std::move(handler), config}, m_acceptor {bind_addr, port, SOMAXCONN},
+      m_last_sweep {std::chrono::steady_clock::now()}, m_ring {ring_entries}
+{
+    for(uint8_t op : {IORING_OP_ACCEPT, IORING_OP_TIMEOUT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_SEND, IORING_OP_READ})
+    {
+        if(!m_ring.supports(op))
+            throw std::runtime_error {"Kernel lacks io_uring operations."};
+    }
+
+    m_timeout.tv_sec = 0;
+    m_timeout.tv_nsec = poll_interval_ms * 1000000L;
+
+    arm_accept();
+    arm_timeout();
+    arm_wake();
+}
+
+uring_loop::~uring_loop() = default;
+
+void uring_loop::run(std::atomic<bool>& run_condition)
+{
+    while(run_condition.load())
+    {
+        // Everything queued while handling the previous completions goes to
+        // the kernel together with the wait
+        m_ring.submit_and_wait(1);
+
+        m_ring.for_each_completion([this](const io_uring_cqe& cqe) {
+            auto op = static_cast<operation>(cqe.user_data & 0xff);
+            int fd = static_cast<int>(cqe.user_data >> 8);
+
+            switch(op)
+            {
+                case operation::accept:
+                    on_accept(cqe);
+                    return;
+                case operation::timeout:
+                    arm_timeout();
+                    return;
+                case operation::wake:
+                    arm_wake();
+                    resume_parked();
+                    return;
+                default:
+                    break;
+            }
+
+            auto it = m_clients.find(fd);
+            if(it == m_clients.end())
+                return;
+
+            client& c = *it->second;
+            --c.in_flight;
+            if(c.closing)
+            {
+                close_client(c);
+                return;
+            }
+
+            switch(op)
+            {
+                case operation::recv:
+                    on_recv(c, cqe.res);
+                    break;
+                case operation::send:
+                    on_send(c, cqe.res);
+                    break;
+                case operation::read_file:
+                    on_file_read(c, cqe.res);
+                    break;
+                default:
+                    break;
+            }
+        });
+
+        close_expired_connections();
+    }
+}
+
+void uring_loop::arm_accept()
+{
+    m_accept_addr_len = sizeof(m_accept_addr);
+    io_uring_sqe& sqe = m_ring.next_sqe();
+    sqe.opcode = IORING_OP_ACCEPT;
+    sqe.fd = m_acceptor.get();
+    sqe.addr = reinterpret_cast<uint64_t>(&m_accept_addr);
+    sqe.addr2 = reinterpret_cast<uint64_t>(&m_accept_addr_len);
+    sqe.accept_flags = SOCK_CLOEXEC;
+    sqe.user_data = user_data(m_acceptor.get(), operation::accept);
+}
+
+void uring_loop::resume_accept()
+{
+    if(!m_accept_paused)
+        return;
+    m_accept_paused = false;
+    arm_accept();
+}
+
+void uring_loop::arm_timeout()
+{
+    // Wakes the loop to check the run condition and to close idle connections
+    io_uring_sqe& sqe = m_ring.next_sqe();
+    sqe.opcode = IORING_OP_TIMEOUT;
+    sqe.fd = -1;
+    sqe.addr = reinterpret_cast<uint64_t>(&m_timeout);
+    sqe.len = 1;
+    sqe.user_data = user_data(0, operation::timeout);
+}
+
+void uring_loop::arm_wake()
+{
+    io_uring_sqe& sqe = m_ring.next_sqe();
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = m_wakeup;
+    sqe.addr = reinterpret_cast<uint64_t>(&m_wake_count);
+    sqe.len = sizeof(m_wake_count);
+    sqe.user_data = user_data(0, operation::wake);
+}
+
+void uring_loop::arm_recv(client& c)
+{
+    // Only armed behind an incomplete request, which is below the size limit
+    size_t size = std::min(recv_size, c.conn->input_room());
+    char* buffer = c.conn->prepare_input(size);
+    io_uring_sqe& sqe = m_ring.next_sqe();
+    sqe.opcode = IORING_OP_RECV;
+    sqe.fd = c.conn->get();
+    sqe.addr = reinterpret_cast<uint64_t>(buffer);
+    sqe.len = size;
+    sqe.user_data = user_data(c.conn->get(), operation::recv);
+    ++c.in_flight;
+}
+
+bool uring_loop::arm_send(client& c)
+{
+    int fd = c.conn->get();
+
+    // Send the rest of the staged file data first
+    if(c.staged_offset < c.staged_length)
+    {
+        io_uring_sqe& sqe = m_ring.next_sqe();
+        sqe.opcode = IORING_OP_SEND;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(c.staging.data() + c.staged_offset);
+        sqe.len = c.staged_length - c.staged_offset;
+        sqe.msg_flags = MSG_NOSIGNAL;
+        sqe.user_data = user_data(fd, operation::send);
+        ++c.in_flight;
+        return true;
+    }
+
+    if(!c.conn->next_output(c.segment))
+        return false;
+
+    io_uring_sqe& sqe = m_ring.next_sqe();
+    if(c.segment.iov_count > 0)
+    {
+        c.msg = msghdr {};
+        c.msg.msg_iov = c.segment.iov.data();
+        c.msg.msg_iovlen = c.segment.iov_count;
+        sqe.opcode = IORING_OP_SENDMSG;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(&c.msg);
+        sqe.len = 1;
+        sqe.msg_flags = MSG_NOSIGNAL | ((c.segment.more) ? MSG_MORE : 0);
+        sqe.user_data = user_data(fd, operation::send);
+    }
+    else
+    {
+        // File bodies are read into the staging buffer and sent from there
+        if(c.staging.empty())
+            c.staging.resize(staging_size);
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = c.segment.file->file->get();
+        sqe.addr = reinterpret_cast<uint64_t>(c.staging.data());
+        sqe.len = std::min(c.segment.file->length, c.staging.size());
+        sqe.off = c.segment.file->offset;
+        sqe.user_data = user_data(fd, operation::read_file);
+    }
+    ++c.in_flight;
+    return true;
+}
+
+void uring_loop::on_accept(const io_uring_cqe& cqe)
+{
+    if(cqe.res < 0 && out_of_descriptors(-cqe.res))
+    {
+        m_accept_paused = true;
+        return;
+    }
+
+    if(cqe.res >= 0)
+    {
+        try {
+            auto sock = m_acceptor.adopt(cqe.res, m_accept_addr);
+            if(m_clients.size() >= m_config.max_connections)
+            {
+                refuse_connection(sock.get(), false);
+                arm_accept();
+                return;
+            }
+
+            auto c = std::make_unique<client>();
+            c->conn = std::make_unique<connection>(std::move(sock), m_config.max_request_size);
+            configure_connection(*c->conn);
+            arm_recv(*c);
+            m_clients.emplace(cqe.res, std::move(c));
+        } catch(std::runtime_error&) {
+            // The socket was closed by the connection that failed to set up
+        }
+    }
+
+    arm_accept();
+}
+
+void uring_loop::on_recv(client& c, int result)
+{
+    if(result == -EINTR || result == -EAGAIN)
+    {
+        c.conn->commit_input(0);
+        arm_recv(c);
+        return;
+    }
+
+    if(result <= 0)
+    {
+        close_client(c);
+        return;
+    }
+
+    c.conn->commit_input(result);
+    process(c);
+}
+
+void uring_loop::on_send(client& c, int result)
+{
+    if(result == -EINTR || result == -EAGAIN)
+    {
+        arm_send(c);
+        return;
+    }
+
+    if(result < 0)
+    {
+        close_client(c);
+        return;
+    }
+
+    if(c.staged_offset < c.staged_length)
+        c.staged_offset += result;
+    c.conn->consume_output(result);
+
+    if(arm_send(c))
+        return;
+
+    if(c.conn->close_after_flush())
+    {
+        close_client(c);
+        return;
+    }
+
+    // Requests held back while the output was pending may be answered now
+    process(c);
+}
+
+void uring_loop::on_file_read(client& c, int result)
+{
+    if(result <= 0)
+    {
+        // File shrank since the response was built or could not be read
+        close_client(c);
+        return;
+    }
+
+    c.staged_offset = 0;
+    c.staged_length = result;
+    arm_send(c);
+}
+
+void uring_loop::process(client& c)
+{
+    process_requests(*c.conn);
+
+    // Pipelined requests stay in the input buffer until the output is sent,
+    // the send completion continues with them
+    if(arm_send(c))
+        return;
+
+    if(c.conn->close_after_flush())
+    {
+        close_client(c);
+        return;
+    }
+
+    // Nothing is armed for a parked request, waking the loop or the deadline continues it
+    if(c.conn->parked())
+        return;
+
+    arm_recv(c);
+}
+
+void uring_loop::close_client(client& c)
+{
+    int fd = c.conn->get();
+    if(c.in_flight > 0)
+    {
+        // Pending receives and sends complete right away on a shut down socket
+        if(!c.closing)
+            ::shutdown(fd, SHUT_RDWR);
+        c.closing = true;
+        return;
+    }
+
+    m_clients.erase(fd);
+    resume_accept();
+}
+
+void uring_loop::close_expired_connections()
+{
+    steady_time now = std::chrono::steady_clock::now();
+    if(now - m_last_sweep < std::chrono::milliseconds {poll_interval_ms})
+        return;
+    m_last_sweep = now;
+
+    // Descriptors may have been freed outside of this loop
+    resume_accept();
+
+    std::vector<client*> expired;
+    for(const auto& [fd, c] : m_clients)
+    {
+        if(!c->closing && timed_out(*c->conn, now))
+            expired.push_back(c.get());
+    }
+
+    for(client* c : expired)
+        close_client(*c);
+
+    // Parked requests whose content did not show up in time get a 503
+    std::vector<client*> waiting;
+    for(const auto& [fd, c] : m_clients)
+    {
+        if(!c->closing && c->in_flight == 0 && c->conn->parked() && now >= c->conn->park_deadline())
+            waiting.push_back(c.get());
+    }
+
+    for(client* c : waiting)
+    {
+        expire_parked(*c->conn, now);
+        process(*c);
+    }
+}
+
+void uring_loop::resume_parked()
+{
+    std::vector<int> parked;
+    for(const auto& [fd, c] : m_clients)
+    {
+        // Parked clients with output in flight continue with its completion
+        if(!c->closing && c->in_flight == 0 && c->conn->parked())
+            parked.push_back(fd);
+    }
+
+    // Handling may close clients, so look every one up again
+    for(int fd : parked)
+    {
+        if(auto it = m_clients.find(fd); it != m_clients.end())
+            process(*it->second);
+    }
+}
+
+} // namespace http
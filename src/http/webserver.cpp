@@ -1,6 +1,11 @@
 #include "http/webserver.hpp"
 #include "http/request.hpp"
 #include "http/response.hpp"
+#include "http/body.hpp"
+#include "http/byte_range.hpp"
+#include "http/conditional.hpp"
+#include "http/tls_context.hpp"
+#include "http/router.hpp"
 
 #include <memory>
 #include <thread>
@@ -9,107 +14,326 @@
 #include <string>
 #include <string_view>
 #include <algorithm>
-#include <fstream>
 #include <atomic>
-#include <charconv>
+#include <array>
+#include <variant>
+#include <type_traits>
+#include <stdexcept>
 
 #include <iostream>
 
 namespace http
 {
 
-static std::vector<char> file_to_binary(std::string_view path)
+/**
+ * Appends the pieces covering a range of the spliced layout
+ */
+static void append_spliced(std::vector<body_piece>& out, const spliced_file& spliced, size_t offset, size_t length)
 {
-    std::ifstream ifs(path.data(), std::ios::binary);
+    for(const auto& piece : spliced.pieces)
+    {
+        if(length == 0)
+            return;
 
-    return std::vector<char> {(std::istreambuf_iterator<char>(ifs)),
-        (std::istreambuf_iterator<char>())};
+        size_t piece_size = std::visit([](const auto& p) -> size_t {
+            if constexpr(std::is_same_v<std::decay_t<decltype(p)>, file_body>)
+                return p.length;
+            else
+                return p.data.size();
+        }, piece);
+        if(offset >= piece_size)
+        {
+            offset -= piece_size;
+            continue;
+        }
+
+        size_t take = std::min(piece_size - offset, length);
+        std::visit([&out, offset, take](const auto& p) {
+            if constexpr(std::is_same_v<std::decay_t<decltype(p)>, file_body>)
+                out.push_back(file_body {p.file, p.offset + offset, take});
+            else
+                out.push_back(memory_body {p.owner, p.data.substr(offset, take)});
+        }, piece);
+        offset = 0;
+        length -= take;
+    }
 }
 
-static void serve_hls_stream(net::tcp_connection<net::ip_version::v4>&& conn)
+/**
+ * Answers the request with a cached file
+ */
+static void serve_entry(const std::shared_ptr<const cached_file>& entry, const request& req, response& res)
 {
-    request req;
-    try {
-        std::array<char, 4096> buffer;
-        conn.read(net::span {buffer});
-        req.parse(buffer.data());
-    } catch(...) {
-        response res;
-        res.set_code(400, "Bad Request");
-        conn.send(net::span {res.to_string()});
-        return;
+    const std::shared_ptr<const file_handle>& file = entry->file;
+    const spliced_file* spliced = entry->spliced.get();
+    size_t size = (spliced) ? spliced->size : (file) ? file->size() : entry->size;
+
+    // Validators and CORS headers are formatted once per version of the entry
+    res.set_header_block(entry, entry->header_block);
+    res.set_header("Content-Type", entry->content_type);
+
+    // Receivers poll the playlist, unchanged content is answered without body
+    switch(evaluate_conditions(req, entry->etag, entry->mtime.tv_sec))
+    {
+        case condition_result::not_modified:
+            res.set_code(304);
+            return;
+        case condition_result::precondition_failed:
+            res.set_code(412);
+            res.set_body("");
+            return;
+        case condition_result::proceed:
+            break;
+    }
+
+    // Every slice of the body is a view into the cache entry or a file range,
+    // the content is never copied for a range request. Ranges of a spliced
+    // layout map back to the pieces of the original file
+    auto slice = [&](size_t offset, size_t length) {
+        std::vector<body_piece> pieces;
+        if(spliced)
+            append_spliced(pieces, *spliced, offset, length);
+        else if(file)
+            pieces.push_back(file_body {file, offset, length});
+        else
+            pieces.push_back(memory_body {entry->content, std::string_view {*entry->content}.substr(offset, length)});
+        return pieces;
+    };
+
+    range_list ranges;
+    range_status status = range_status::none;
+    if(req.check_header("Range") && if_range_matches(req, entry->etag, entry->mtime.tv_sec))
+        status = parse_range_header(req.get_header("Range"), size, ranges);
+
+    std::array<char, content_range_length> content_range;
+    if(status == range_status::unsatisfiable)
+    {
+        res.set_code(416);
+        res.set_header("Content-Range", format_unsatisfied_range(size, content_range.data()));
+        res.set_body("");
+    }
+    else if(status == range_status::satisfiable && ranges.size() == 1)
+    {
+        res.set_code(206);
+        res.set_header("Content-Range", format_content_range(ranges[0], size, content_range.data()));
+        res.set_body_pieces(slice(ranges[0].first, ranges[0].length()));
     }
+    else if(status == range_status::satisfiable)
+    {
+        std::string_view boundary = multipart_boundary();
+        multipart_body body;
+        body.parts.reserve(ranges.size());
+        for(const auto& range : ranges)
+        {
+            // The part header goes in front of the first piece of the range
+            size_t first = body.parts.size();
+            for(auto& piece : slice(range.first, range.length()))
+                body.parts.push_back(body_part {{}, std::move(piece)});
+            std::string& header = body.parts[first].header;
+            header.append("\r\n--").append(boundary);
+            header.append("\r\nContent-Type: ").append(entry->content_type);
+            header.append("\r\nContent-Range: ").append(format_content_range(range, size, content_range.data()));
+            header.append("\r\n\r\n");
+        }
+        body.trailer.append("\r\n--").append(boundary).append("--\r\n");
 
-    // std::cout << "[DEBUG]:\n" << req.to_string() << std::endl;
+        std::string content_type {"multipart/byteranges; boundary="};
+        content_type.append(boundary);
+        res.set_code(206);
+        res.set_header("Content-Type", content_type);
+        res.set_body_multipart(std::move(body));
+    }
+    else
+    {
+        res.set_code(200);
+        if(spliced)
+            res.set_body_pieces(slice(0, size));
+        else if(file)
+            res.set_body_file(file, 0, size);
+        else
+            res.set_body_shared(entry->content, *entry->content);
+    }
+}
 
+static void serve_static_file(file_cache& cache, const server_config& config, const request& req, response& res)
+{
+    std::string_view root = config.media_root;
     std::string_view pv = req.get_path();
     std::string path;
-    path.reserve(11 + pv.size());
-    path.assign("./test_data");
-    std::copy(pv.begin(), pv.end(), std::back_inserter(path));
+    path.reserve(root.size() + pv.size() + 1);
+    path.assign(root);
+    if(!append_normalized(path, pv))
+    {
+        res.set_code(400);
+        res.set_body("");
+        return;
+    }
 
-    // Read file
-    std::vector<char> img = file_to_binary(path.data());
-    if(img.size() <= 0) 
+    // Hot files cost no open or stat, small ones come from memory and
+    // everything else is sent with sendfile from the cached descriptor
+    std::shared_ptr<const cached_file> entry;
+    try {
+        entry = cache.get(path);
+    } catch(std::invalid_argument&) {
+        res.set_code(404);
+        res.set_body("");
+        return;
+    }
+    if(!entry)
     {
-        response res;
-        res.set_code(400, "Bad Request");
-        std::string res_str = res.to_string();
-        conn.send(net::span {res.to_string()});
+        // Retried once the transform of the file finished
+        res.park(config.transform_timeout);
         return;
     }
+    serve_entry(entry, req, res);
+}
 
-    response res {req};
-    res.set_header("Server", "localhost");
-    res.set_header("Content-Type", "application/x-mpegurl");
+static void append_metric(std::string& out, std::string_view name, std::string_view labels, uint64_t value)
+{
+    out.append(name);
+    if(!labels.empty())
+        out.append("{").append(labels).append("}");
+    out.append(" ").append(std::to_string(value)).append("\n");
+}
 
-    if(req.check_header("Range"))
+webserver::webserver(uint16_t port, const char* cert_path, const char* key_path, const server_config& config)
+    : m_config {config}, m_cache {config.cache_memory_budget, config.cache_max_entry_size, config.cache_max_entries}
+{
+    if(m_config.tls)
     {
-        size_t start = 0, end = img.size();
-        std::string_view hdr = req.get_header("Range");
-        size_t hyphen_pos = hdr.find("-");
+        if(cert_path == nullptr || key_path == nullptr)
+            throw std::runtime_error {"TLS enabled without certificate and key."};
+        m_tls_context = create_tls_context(cert_path, key_path);
 
-        if(hdr.find("bytes=") != std::string::npos && hyphen_pos != std::string::npos)
+        // Decided once here instead of by every worker, the status route
+        // reports the engine that actually runs
+        if(m_config.engine == io_engine::io_uring)
         {
-            std::from_chars(hdr.data() + 6, hdr.data() + hyphen_pos, start);
-            std::from_chars(hdr.data() + hyphen_pos + 1, hdr.data() + hdr.size(), end);
+            std::cerr << "TLS is only served by the epoll engine, using epoll instead of io_uring" << std::endl;
+            m_config.engine = io_engine::epoll;
         }
+    }
+
+    m_cache.set_listener([this]() { notify(); });
 
-        res.set_code(206, "Partial Content");
-        res.set_header("Content-Range", "bytes " + std::to_string(start) + '-' + 
-            std::to_string(end - start - 1) + '/' + std::to_string(img.size()));
-        res.set_body(std::string {img.begin() + start, img.begin() + end});
+    size_t workers = config.workers;
+    if(workers == 0)
+        workers = std::max(1u, std::thread::hardware_concurrency());
+
+    // Every worker binds its own socket to the same port, SO_REUSEPORT lets
+    // the kernel spread incoming connections across them
+    m_stats = std::make_unique<worker_stats[]>(workers);
+    m_workers.reserve(workers);
+    for(size_t i = 0; i < workers; ++i)
+    {
+        m_workers.push_back(event_loop::create("0.0.0.0", port, [this, &stats = m_stats[i]](const request& req, response& res) {
+            m_router.dispatch(req, res);
+            int status_class = res.get_code() / 100;
+            if(status_class >= 1 && status_class <= 5)
+                stats.responses[status_class - 1].fetch_add(1, std::memory_order_relaxed);
+        }, m_config, m_tls_context));
     }
-    else
+
+    m_router.add("/", match_kind::prefix, methods::read, [this](const request& req, response& res) {
+        serve_static_file(m_cache, m_config, req, res);
+    });
+    m_router.add("/metrics", match_kind::exact, methods::get | methods::head, [this](const request&, response& res) {
+        serve_metrics(res);
+    });
+    m_router.add("/control/status", match_kind::exact, methods::get | methods::head, [this](const request&, response& res) {
+        serve_status(res);
+    });
+    m_router.add("/control/cache/flush", match_kind::exact, methods::post, [this](const request&, response& res) {
+        m_cache.clear();
+        res.set_code(204);
+    });
+}
+
+webserver::~webserver()
+{
+    // Transforms still running must not wake the workers destroyed before the cache
+    m_cache.set_listener(nullptr);
+}
+
+void webserver::add_route(std::string_view pattern, match_kind kind, uint8_t allowed_methods, route_handler handler)
+{
+    m_router.add(pattern, kind, allowed_methods, std::move(handler));
+}
+
+void webserver::add_file_transform(std::string_view content_type, file_transform transform)
+{
+    if(m_router.compiled())
+        throw std::logic_error {"File transforms can not be added while serving."};
+    m_cache.add_transform(content_type, std::move(transform));
+}
+
+void webserver::notify()
+{
+    for(auto& worker : m_workers)
+        worker->wake();
+}
+
+void webserver::serve_metrics(response& res) const
+{
+    static constexpr std::array<std::string_view, 5> classes {"code=\"1xx\"", "code=\"2xx\"", "code=\"3xx\"",
+        "code=\"4xx\"", "code=\"5xx\""};
+
+    std::string out;
+    out.append("# TYPE desk_cast_http_responses_total counter\n");
+    for(size_t c = 0; c < classes.size(); ++c)
     {
-        res.set_code(200);
-        res.set_header("Content-Length", std::to_string(img.size()));
-        res.set_body(std::string {img.begin(), img.end()});
+        uint64_t total = 0;
+        for(size_t i = 0; i < m_workers.size(); ++i)
+            total += m_stats[i].responses[c].load(std::memory_order_relaxed);
+        append_metric(out, "desk_cast_http_responses_total", classes[c], total);
     }
-    
-    // CORS
-    res.set_header("Accept-Ranges", "bytes");
-    res.set_header("Access-Control-Allow-Origin", "*");
-    res.set_header("Access-Control-Allow-Methods", "OPTIONS, GET, HEAD");
+    out.append("# TYPE desk_cast_file_cache_bytes gauge\n");
+    append_metric(out, "desk_cast_file_cache_bytes", {}, m_cache.memory_usage());
+    out.append("# TYPE desk_cast_workers gauge\n");
+    append_metric(out, "desk_cast_workers", {}, m_workers.size());
 
-    conn.send(net::span {res.to_string()});
+    res.set_code(200);
+    res.set_header("Content-Type", "text/plain; version=0.0.4");
+    res.set_header("Cache-Control", "no-store");
+    res.set_body(out);
+}
+
+void webserver::serve_status(response& res) const
+{
+    std::string out;
+    out.append("{\"workers\":").append(std::to_string(m_workers.size()));
+    out.append(",\"engine\":\"").append(m_workers.front()->engine_name()).append("\"");
+    out.append(",\"tls\":").append((m_tls_context) ? "true" : "false");
+    out.append(",\"cache_bytes\":").append(std::to_string(m_cache.memory_usage()));
+    out.append("}");
+
+    res.set_code(200);
+    res.set_header("Content-Type", "application/json");
+    res.set_header("Cache-Control", "no-store");
+    res.set_body(out);
 }
 
 void webserver::serve(std::atomic<bool>& run_condition)
 {
-    std::cout << "Webserver serving ..." << std::endl;
-    while(run_condition.load())
-    {
-        try {
-            // Because this webserver only serves one client, here we dont need
-            // more than one thread handling requests at the moment
+    std::cout << "Webserver serving with " << m_workers.size() << " " << m_workers.front()->engine_name()
+        << " worker(s)" << ((m_tls_context) ? " over TLS" : "") << " ..." << std::endl;
 
-            // TODO Parse request here and go to correct service function when supoorting multiple protocols
+    m_router.compile();
 
-            serve_hls_stream(m_acceptor.accept());
-        } catch(std::runtime_error&) {}
+    std::vector<std::thread> threads;
+    threads.reserve(m_workers.size() - 1);
+    for(size_t i = 1; i < m_workers.size(); ++i)
+    {
+        threads.emplace_back([&loop = *m_workers[i], &run_condition]() {
+            loop.run(run_condition);
+        });
     }
 
+    m_workers.front()->run(run_condition);
+
+    for(auto& t : threads)
+        t.join();
+
     std::cout << "Webserver closing" << std::endl;
 }
 
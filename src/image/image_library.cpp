@@ -0,0 +1,136 @@
+#include "image/image_library.hpp"
+#include "image/jpeg.hpp"
+#include "image/resample.hpp"
+#include "http/body.hpp"
+#include "http/conditional.hpp"
+#include "http/file_cache.hpp"
+#include "http/text.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+
+namespace image
+{
+
+/// Larger source files are rejected instead of being decoded
+static constexpr uint64_t max_source_size = 64 * 1024 * 1024;
+
+/// Configured resolutions are limited so a scaled image stays a reasonable size
+static constexpr uint32_t max_dimension = 8192;
+
+/**
+ * Parses a dimension from the query, out stays 0 if the parameter is missing
+ * Returns false if the value is no number
+ */
+static bool parse_dimension(std::string_view value, uint32_t& out)
+{
+    if(value.empty())
+        return true;
+    auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), out);
+    return ec == std::errc {} && end == value.data() + value.size() && out != 0;
+}
+
+static std::string read_file(const http::file_handle& file)
+{
+    if(file.size() > max_source_size)
+        throw std::runtime_error {"Image file too large"};
+    return file.read_range(0, file.size());
+}
+
+image_library::image_library(std::string media_root, const image_config& config)
+    : m_root {std::move(media_root)}, m_config {config}, m_entries {config.max_entries, 'i'}
+{
+    if(m_config.resolutions.empty())
+        throw std::invalid_argument {"No image resolution configured."};
+    for(const auto& r : m_config.resolutions)
+    {
+        if(r.width == 0 || r.height == 0 || r.width > max_dimension || r.height > max_dimension)
+            throw std::invalid_argument {"Invalid image resolution configured."};
+    }
+    m_config.quality = std::clamp(m_config.quality, 1, 100);
+}
+
+void image_library::serve(std::string_view name, const http::request& req, http::response& res)
+{
+    res.set_header_block(nullptr, http::common_header_block());
+
+    std::string uri;
+    if(!http::append_normalized(uri, name) || uri.empty())
+        return res.reject(404);
+    if(http::content_type_of(uri) != "image/jpeg")
+        return res.reject(415);
+
+    // The query selects one of the configured resolutions, a single parameter the first one matching it
+    uint32_t width = 0;
+    uint32_t height = 0;
+    if(!parse_dimension(req.get_param("width"), width) || !parse_dimension(req.get_param("height"), height))
+        return res.reject(400);
+    auto target = std::find_if(m_config.resolutions.begin(), m_config.resolutions.end(), [&](const resolution& r) {
+        return (width == 0 || r.width == width) && (height == 0 || r.height == height);
+    });
+    if(target == m_config.resolutions.end())
+        return res.reject(400);
+
+    std::string key {uri};
+    key.push_back('@');
+    http::append_number(key, target->width);
+    key.push_back('x');
+    http::append_number(key, target->height);
+
+    std::shared_ptr<const entry> e;
+    try {
+        e = m_entries.lookup(key, m_root + uri, [this, size = *target](entry& next,
+            const std::shared_ptr<const http::file_handle>& file) {
+            prepare(next, size, *file);
+        });
+    } catch(std::invalid_argument&) {
+        return res.reject(404);
+    }
+    if(!e)
+        return res.park(m_config.prepare_timeout);
+    if(e->failure != 0)
+        return res.reject(e->failure);
+
+    res.set_header_block(e, e->header_block);
+    res.set_header("Content-Type", "image/jpeg");
+    if(http::evaluate_conditions(req, e->etag, e->mtime) == http::condition_result::not_modified)
+    {
+        res.set_code(304);
+        return;
+    }
+    res.set_code(200);
+    res.set_body_shared(e->content, *e->content);
+}
+
+void image_library::prepare(entry& e, resolution target, const http::file_handle& file) const
+{
+    std::string source = read_file(file);
+    uint32_t source_width = 0;
+    uint32_t source_height = 0;
+    read_jpeg_size(source, source_width, source_height);
+    uint32_t target_width = 0;
+    uint32_t target_height = 0;
+    fit_size(source_width, source_height, target.width, target.height, target_width, target_height);
+
+    // Versions of one file differ by their size
+    e.etag.push_back('-');
+    http::append_number(e.etag, target_width);
+    e.etag.push_back('x');
+    http::append_number(e.etag, target_height);
+
+    if(target_width == source_width && target_height == source_height)
+    {
+        // Already small enough, the original is served without recompressing it
+        e.content = std::make_shared<const std::string>(std::move(source));
+        return;
+    }
+
+    // The decoder does the coarse reduction, the resampler the exact one
+    bitmap decoded = decode_jpeg(source, target_width, target_height);
+    if(decoded.width != target_width || decoded.height != target_height)
+        decoded = resize(decoded, target_width, target_height);
+    e.content = std::make_shared<const std::string>(encode_jpeg(decoded, m_config.quality));
+}
+
+} // namespace image
@@ -0,0 +1,140 @@
+#include "image/jpeg.hpp"
+
+#include <array>
+#include <stdexcept>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#include <jpeglib.h>
+
+namespace image
+{
+
+/**
+ * Replaces the default handler of libjpeg, which would exit the process
+ */
+[[noreturn]] static void throw_error(j_common_ptr info)
+{
+    std::array<char, JMSG_LENGTH_MAX> message;
+    (*info->err->format_message)(info, message.data());
+    throw std::runtime_error {message.data()};
+}
+
+/**
+ * Drops warnings about recoverable corruption, the image is decoded anyway
+ */
+static void ignore_message(j_common_ptr)
+{
+}
+
+// libjpeg decompressor that is released even if decoding throws
+struct decompressor
+{
+    jpeg_decompress_struct info {};
+    jpeg_error_mgr error {};
+
+    explicit decompressor(std::string_view data)
+    {
+        info.err = jpeg_std_error(&error);
+        error.error_exit = throw_error;
+        error.output_message = ignore_message;
+        jpeg_create_decompress(&info);
+        jpeg_mem_src(&info, reinterpret_cast<const unsigned char*>(data.data()), data.size());
+    }
+
+    ~decompressor()
+    {
+        jpeg_destroy_decompress(&info);
+    }
+};
+
+// libjpeg compressor writing into memory that is released even if encoding throws
+struct compressor
+{
+    jpeg_compress_struct info {};
+    jpeg_error_mgr error {};
+    unsigned char* buffer = nullptr;
+    unsigned long size = 0;
+
+    compressor()
+    {
+        info.err = jpeg_std_error(&error);
+        error.error_exit = throw_error;
+        jpeg_create_compress(&info);
+        jpeg_mem_dest(&info, &buffer, &size);
+    }
+
+    ~compressor()
+    {
+        jpeg_destroy_compress(&info);
+        std::free(buffer);
+    }
+};
+
+void read_jpeg_size(std::string_view data, uint32_t& width, uint32_t& height)
+{
+    decompressor d {data};
+    jpeg_read_header(&d.info, TRUE);
+    width = d.info.image_width;
+    height = d.info.image_height;
+}
+
+bitmap decode_jpeg(std::string_view data, uint32_t min_width, uint32_t min_height)
+{
+    decompressor d {data};
+    jpeg_read_header(&d.info, TRUE);
+    d.info.out_color_space = JCS_EXT_RGBX;
+    d.info.dct_method = JDCT_ISLOW;
+
+    // libjpeg-turbo scales by num / 8 while computing the inverse DCT
+    d.info.scale_denom = 8;
+    d.info.scale_num = 8;
+    if(min_width > 0 || min_height > 0)
+    {
+        for(d.info.scale_num = 1; d.info.scale_num < 8; ++d.info.scale_num)
+        {
+            jpeg_calc_output_dimensions(&d.info);
+            if(d.info.output_width >= min_width && d.info.output_height >= min_height)
+                break;
+        }
+    }
+
+    jpeg_start_decompress(&d.info);
+    bitmap out {d.info.output_width, d.info.output_height, {}};
+    out.pixels.resize(out.stride() * out.height);
+    while(d.info.output_scanline < d.info.output_height)
+    {
+        JSAMPROW row = out.pixels.data() + d.info.output_scanline * out.stride();
+        jpeg_read_scanlines(&d.info, &row, 1);
+    }
+    jpeg_finish_decompress(&d.info);
+    return out;
+}
+
+std::string encode_jpeg(const bitmap& image, int quality)
+{
+    if(image.width == 0 || image.height == 0)
+        throw std::runtime_error {"Empty images can not be encoded."};
+
+    compressor c;
+    c.info.image_width = image.width;
+    c.info.image_height = image.height;
+    c.info.input_components = bytes_per_pixel;
+    c.info.in_color_space = JCS_EXT_RGBX;
+    jpeg_set_defaults(&c.info);
+    jpeg_set_quality(&c.info, quality, TRUE);
+    c.info.optimize_coding = TRUE;
+
+    std::vector<JSAMPROW> rows(image.height);
+    for(uint32_t y = 0; y < image.height; ++y)
+        rows[y] = const_cast<JSAMPROW>(image.pixels.data() + y * image.stride());
+
+    jpeg_start_compress(&c.info, TRUE);
+    while(c.info.next_scanline < c.info.image_height)
+        jpeg_write_scanlines(&c.info, rows.data() + c.info.next_scanline, c.info.image_height - c.info.next_scanline);
+    jpeg_finish_compress(&c.info);
+    return std::string {reinterpret_cast<const char*>(c.buffer), c.size};
+}
+
+} // namespace image
@@ -0,0 +1,362 @@
+#include "image/resample.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IMAGE_X86_KERNELS
+#endif
+
+namespace image
+{
+
+/// Weights are fixed point numbers with this many fractional bits
+static constexpr int weight_bits = 14;
+static constexpr int32_t weight_one = 1 << weight_bits;
+static constexpr int32_t weight_round = 1 << (weight_bits - 1);
+
+// Contributions of the source pixels to every output pixel along one axis
+struct filter_table
+{
+    uint32_t taps = 0;                  /// weights per output, a multiple of 4 if vectorizable
+    bool vectorizable = false;          /// the source is at least taps pixels wide
+    std::vector<uint32_t> first;        /// first source pixel per output
+    std::vector<int16_t> weights;       /// taps weights per output
+};
+
+/**
+ * Keys bicubic kernel with a = -0.5, its support is [-2, 2]
+ */
+static double cubic(double x)
+{
+    x = std::abs(x);
+    if(x < 1.0)
+        return (1.5 * x - 2.5) * x * x + 1.0;
+    if(x < 2.0)
+        return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+    return 0.0;
+}
+
+static filter_table make_table(uint32_t in, uint32_t out)
+{
+    double scale = static_cast<double>(in) / out;
+    double stretch = std::max(scale, 1.0);
+    double support = 2.0 * stretch;
+
+    // The window of every output is moved into the source, so the vector
+    // kernels can always read all taps without bounds checks
+    filter_table table;
+    uint32_t needed = static_cast<uint32_t>(std::ceil(support)) * 2 + 1;
+    table.taps = (needed + 3) & ~3u;
+    table.vectorizable = table.taps <= in;
+    if(!table.vectorizable)
+        table.taps = in;
+    table.first.resize(out);
+    table.weights.assign(static_cast<size_t>(out) * table.taps, 0);
+
+    std::vector<double> w;
+    for(uint32_t i = 0; i < out; ++i)
+    {
+        double center = (i + 0.5) * scale;
+        auto lo = static_cast<uint32_t>(std::max(0.0, std::floor(center - support + 0.5)));
+        auto hi = static_cast<uint32_t>(std::min<double>(in, std::floor(center + support + 0.5)));
+        hi = std::max(hi, lo + 1);
+        uint32_t start = std::min(lo, in - table.taps);
+
+        w.assign(hi - lo, 0.0);
+        double sum = 0.0;
+        for(uint32_t j = lo; j < hi; ++j)
+            sum += w[j - lo] = cubic((j + 0.5 - center) / stretch);
+
+        // The weights of every output sum up to exactly one, flat areas keep their color
+        int16_t* dst = &table.weights[static_cast<size_t>(i) * table.taps];
+        int32_t total = 0;
+        uint32_t largest = lo;
+        for(uint32_t j = lo; j < hi; ++j)
+        {
+            auto q = static_cast<int16_t>(std::lround(w[j - lo] / sum * weight_one));
+            dst[j - start] = q;
+            total += q;
+            if(q > dst[largest - start])
+                largest = j;
+        }
+        dst[largest - start] = static_cast<int16_t>(dst[largest - start] + weight_one - total);
+        table.first[i] = start;
+    }
+    return table;
+}
+
+static uint8_t clamp_pixel(int32_t value)
+{
+    return static_cast<uint8_t>(std::clamp((value + weight_round) >> weight_bits, 0, 255));
+}
+
+/**
+ * Filters every row of src along the x axis into dst
+ */
+static void horizontal_scalar(const bitmap& src, bitmap& dst, const filter_table& table)
+{
+    for(uint32_t y = 0; y < src.height; ++y)
+    {
+        const uint8_t* row = src.pixels.data() + y * src.stride();
+        uint8_t* out = dst.pixels.data() + y * dst.stride();
+        for(uint32_t x = 0; x < dst.width; ++x)
+        {
+            const uint8_t* p = row + static_cast<size_t>(table.first[x]) * bytes_per_pixel;
+            const int16_t* w = &table.weights[static_cast<size_t>(x) * table.taps];
+            int32_t acc[bytes_per_pixel] {};
+            for(uint32_t k = 0; k < table.taps; ++k)
+            {
+                for(size_t c = 0; c < bytes_per_pixel; ++c)
+                    acc[c] += p[k * bytes_per_pixel + c] * w[k];
+            }
+            for(size_t c = 0; c < bytes_per_pixel; ++c)
+                out[x * bytes_per_pixel + c] = clamp_pixel(acc[c]);
+        }
+    }
+}
+
+/**
+ * Filters the bytes of the rows first to first + taps of src along the y axis
+ * into out, starting at byte begin of the rows
+ */
+static void vertical_scalar(const bitmap& src, uint8_t* out, uint32_t first, const int16_t* w, uint32_t taps,
+    size_t begin)
+{
+    const uint8_t* base = src.pixels.data() + first * src.stride();
+    for(size_t i = begin; i < src.stride(); ++i)
+    {
+        int32_t acc = 0;
+        for(uint32_t k = 0; k < taps; ++k)
+            acc += base[k * src.stride() + i] * w[k];
+        out[i] = clamp_pixel(acc);
+    }
+}
+
+#ifdef IMAGE_X86_KERNELS
+
+/**
+ * Two taps per step, the channels of both pixels are interleaved so that
+ * pmaddwd multiplies and adds them with their weights at once
+ */
+__attribute__((target("ssse3")))
+static void horizontal_ssse3(const bitmap& src, bitmap& dst, const filter_table& table)
+{
+    const __m128i pairs = _mm_setr_epi8(0, -1, 4, -1, 1, -1, 5, -1, 2, -1, 6, -1, 3, -1, 7, -1);
+    const __m128i round = _mm_set1_epi32(weight_round);
+    for(uint32_t y = 0; y < src.height; ++y)
+    {
+        const uint8_t* row = src.pixels.data() + y * src.stride();
+        uint8_t* out = dst.pixels.data() + y * dst.stride();
+        for(uint32_t x = 0; x < dst.width; ++x)
+        {
+            const uint8_t* p = row + static_cast<size_t>(table.first[x]) * bytes_per_pixel;
+            const int16_t* w = &table.weights[static_cast<size_t>(x) * table.taps];
+            __m128i acc = round;
+            for(uint32_t k = 0; k < table.taps; k += 2)
+            {
+                __m128i pixels = _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + k * 4)), pairs);
+                int32_t weight_pair;
+                std::memcpy(&weight_pair, w + k, sizeof(weight_pair));
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(pixels, _mm_set1_epi32(weight_pair)));
+            }
+            acc = _mm_srai_epi32(acc, weight_bits);
+            acc = _mm_packus_epi16(_mm_packs_epi32(acc, acc), acc);
+            int32_t pixel = _mm_cvtsi128_si32(acc);
+            std::memcpy(out + x * bytes_per_pixel, &pixel, sizeof(pixel));
+        }
+    }
+}
+
+/**
+ * Four taps per step, the lower lane filters the first two pixels and the upper lane the other two
+ */
+__attribute__((target("avx2")))
+static void horizontal_avx2(const bitmap& src, bitmap& dst, const filter_table& table)
+{
+    const __m256i pairs = _mm256_setr_epi8(0, -1, 4, -1, 1, -1, 5, -1, 2, -1, 6, -1, 3, -1, 7, -1,
+        8, -1, 12, -1, 9, -1, 13, -1, 10, -1, 14, -1, 11, -1, 15, -1);
+    const __m256i spread = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+    const __m128i round = _mm_set1_epi32(weight_round);
+    for(uint32_t y = 0; y < src.height; ++y)
+    {
+        const uint8_t* row = src.pixels.data() + y * src.stride();
+        uint8_t* out = dst.pixels.data() + y * dst.stride();
+        for(uint32_t x = 0; x < dst.width; ++x)
+        {
+            const uint8_t* p = row + static_cast<size_t>(table.first[x]) * bytes_per_pixel;
+            const int16_t* w = &table.weights[static_cast<size_t>(x) * table.taps];
+            __m256i acc = _mm256_setzero_si256();
+            for(uint32_t k = 0; k < table.taps; k += 4)
+            {
+                __m128i four = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k * 4));
+                __m256i pixels = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(four), pairs);
+                __m128i weights = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(w + k));
+                __m256i weight_pairs = _mm256_permutevar8x32_epi32(_mm256_castsi128_si256(weights), spread);
+                acc = _mm256_add_epi32(acc, _mm256_madd_epi16(pixels, weight_pairs));
+            }
+            __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+            sum = _mm_srai_epi32(_mm_add_epi32(sum, round), weight_bits);
+            sum = _mm_packus_epi16(_mm_packs_epi32(sum, sum), sum);
+            int32_t pixel = _mm_cvtsi128_si32(sum);
+            std::memcpy(out + x * bytes_per_pixel, &pixel, sizeof(pixel));
+        }
+    }
+}
+
+/**
+ * Two rows per step, 16 bytes of the row at once
+ */
+static void vertical_sse2(const bitmap& src, uint8_t* out, uint32_t first, const int16_t* w, uint32_t taps,
+    size_t begin)
+{
+    const size_t stride = src.stride();
+    const uint8_t* base = src.pixels.data() + first * stride;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(weight_round);
+    size_t i = begin;
+    for(; i + 16 <= stride; i += 16)
+    {
+        __m128i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+        for(uint32_t k = 0; k < taps; k += 2)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + k * stride + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + (k + 1) * stride + i));
+            int32_t weight_pair;
+            std::memcpy(&weight_pair, w + k, sizeof(weight_pair));
+            __m128i weights = _mm_set1_epi32(weight_pair);
+            __m128i lo = _mm_unpacklo_epi8(a, b);
+            __m128i hi = _mm_unpackhi_epi8(a, b);
+            acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), weights));
+            acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), weights));
+            acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), weights));
+            acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), weights));
+        }
+        __m128i lo = _mm_packs_epi32(_mm_srai_epi32(acc0, weight_bits), _mm_srai_epi32(acc1, weight_bits));
+        __m128i hi = _mm_packs_epi32(_mm_srai_epi32(acc2, weight_bits), _mm_srai_epi32(acc3, weight_bits));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(lo, hi));
+    }
+    vertical_scalar(src, out, first, w, taps, i);
+}
+
+/**
+ * Like vertical_sse2 with 32 bytes of the row at once, all shuffles stay
+ * within their lane so the packed result is in order again
+ */
+__attribute__((target("avx2")))
+static void vertical_avx2(const bitmap& src, uint8_t* out, uint32_t first, const int16_t* w, uint32_t taps,
+    size_t begin)
+{
+    const size_t stride = src.stride();
+    const uint8_t* base = src.pixels.data() + first * stride;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i round = _mm256_set1_epi32(weight_round);
+    size_t i = begin;
+    for(; i + 32 <= stride; i += 32)
+    {
+        __m256i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+        for(uint32_t k = 0; k < taps; k += 2)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(base + k * stride + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(base + (k + 1) * stride + i));
+            int32_t weight_pair;
+            std::memcpy(&weight_pair, w + k, sizeof(weight_pair));
+            __m256i weights = _mm256_set1_epi32(weight_pair);
+            __m256i lo = _mm256_unpacklo_epi8(a, b);
+            __m256i hi = _mm256_unpackhi_epi8(a, b);
+            acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), weights));
+            acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), weights));
+            acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), weights));
+            acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), weights));
+        }
+        __m256i lo = _mm256_packs_epi32(_mm256_srai_epi32(acc0, weight_bits), _mm256_srai_epi32(acc1, weight_bits));
+        __m256i hi = _mm256_packs_epi32(_mm256_srai_epi32(acc2, weight_bits), _mm256_srai_epi32(acc3, weight_bits));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_packus_epi16(lo, hi));
+    }
+    vertical_sse2(src, out, first, w, taps, i);
+}
+
+#endif
+
+using horizontal_kernel = void (*)(const bitmap&, bitmap&, const filter_table&);
+using vertical_kernel = void (*)(const bitmap&, uint8_t*, uint32_t, const int16_t*, uint32_t, size_t);
+
+// Kernels for the processor the server runs on, chosen once
+struct kernel_set
+{
+    horizontal_kernel horizontal;
+    vertical_kernel vertical;
+};
+
+static kernel_set select_kernels()
+{
+#ifdef IMAGE_X86_KERNELS
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return kernel_set {horizontal_avx2, vertical_avx2};
+    if(__builtin_cpu_supports("ssse3"))
+        return kernel_set {horizontal_ssse3, vertical_sse2};
+#endif
+    return kernel_set {horizontal_scalar, vertical_scalar};
+}
+
+void fit_size(uint32_t width, uint32_t height, uint32_t max_width, uint32_t max_height, uint32_t& out_width,
+    uint32_t& out_height)
+{
+    out_width = width;
+    out_height = height;
+    if(width <= max_width && height <= max_height)
+        return;
+
+    // Scale along the more constrained axis and round the other one
+    if(static_cast<uint64_t>(width) * max_height >= static_cast<uint64_t>(height) * max_width)
+    {
+        out_width = max_width;
+        out_height = static_cast<uint32_t>((static_cast<uint64_t>(height) * max_width + width / 2) / width);
+    }
+    else
+    {
+        out_height = max_height;
+        out_width = static_cast<uint32_t>((static_cast<uint64_t>(width) * max_height + height / 2) / height);
+    }
+    out_width = std::max<uint32_t>(out_width, 1);
+    out_height = std::max<uint32_t>(out_height, 1);
+}
+
+bitmap resize(const bitmap& source, uint32_t width, uint32_t height)
+{
+    if(width == 0 || height == 0 || source.width == 0 || source.height == 0)
+        throw std::invalid_argument {"Images can not be resized to or from an empty size."};
+
+    static const kernel_set kernels = select_kernels();
+    filter_table columns = make_table(source.width, width);
+    filter_table rows = make_table(source.height, height);
+
+    // Rows first, the intermediate image has the final width and the source height
+    bitmap wide {width, source.height, {}};
+    wide.pixels.resize(wide.stride() * wide.height);
+    if(columns.vectorizable)
+        kernels.horizontal(source, wide, columns);
+    else
+        horizontal_scalar(source, wide, columns);
+
+    bitmap out {width, height, {}};
+    out.pixels.resize(out.stride() * out.height);
+    bool even = rows.taps % 2 == 0;
+    for(uint32_t y = 0; y < height; ++y)
+    {
+        uint8_t* row = out.pixels.data() + y * out.stride();
+        const int16_t* w = &rows.weights[static_cast<size_t>(y) * rows.taps];
+        if(even)
+            kernels.vertical(wide, row, rows.first[y], w, rows.taps, 0);
+        else
+            vertical_scalar(wide, row, rows.first[y], w, rows.taps, 0);
+    }
+    return out;
+}
+
+} // namespace image
@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
 #include <memory>
 #include <thread>
 #include <csignal>
@@ -15,6 +19,11 @@
 #include "utils.hpp"
 
 #include "http/webserver.hpp"
+#include "hls/live_stream.hpp"
+#include "hls/ts_index.hpp"
+#include "hls/vod_library.hpp"
+#include "image/image_library.hpp"
+#include "mp4/faststart.hpp"
 
 // Set path to certificate and READEABLE key file used by the webserver and the cast device connector
 #define SSL_CERT "./cert.pem"
@@ -95,6 +104,39 @@ static void main_dial()
     }
 }
 
+/**
+ * Writes the transport stream file into the live stream in a loop until run_condition is cleared
+ * Stands in for the encoded desktop capture, bytes are written at the rate the file plays at
+ */
+static void replay_stream(hls::live_stream& live, const std::string& path, const std::atomic<bool>& run_condition)
+{
+    std::ifstream in {path, std::ios::binary};
+    std::string data {std::istreambuf_iterator<char> {in}, std::istreambuf_iterator<char> {}};
+    hls::ts_index index = hls::scan_transport_stream(data);
+    uint64_t ticks = (index.end_pts - index.first_pts) & hls::ts::pts_mask;
+    if(index.keyframes.empty() || ticks == 0)
+    {
+        fmt::print("No playable transport stream at {}, the live stream stays empty\n", path);
+        return;
+    }
+
+    // The segmenter sees the timestamps jump back at the start of every loop and marks a discontinuity
+    constexpr size_t chunk_size = 7 * hls::ts::packet_size;
+    auto duration = std::chrono::microseconds {ticks * 1000 / 90};
+    auto loop_start = std::chrono::steady_clock::now();
+    while(run_condition.load())
+    {
+        for(size_t offset = 0; offset < data.size() && run_condition.load(); offset += chunk_size)
+        {
+            live.write(std::string_view {data}.substr(offset, chunk_size));
+            size_t written = std::min(offset + chunk_size, data.size());
+            std::this_thread::sleep_until(loop_start + duration * written / data.size());
+        }
+        loop_start += duration;
+    }
+    live.end();
+}
+
 static void block_signals(sigset_t* sigset)
 {
     sigemptyset(sigset);
@@ -103,8 +145,11 @@ static void block_signals(sigset_t* sigset)
     pthread_sigmask(SIG_BLOCK, sigset, nullptr);
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    // "desk_cast image <path>" casts an image below the media root instead of the test video
+    std::string_view image_path = (argc >= 3 && std::string_view {argv[1]} == "image") ? argv[2] : "";
+
     sigset_t sigset;
     std::atomic<bool> run_condition {true};
     block_signals(&sigset);
@@ -114,13 +159,6 @@ int main()
         sigwait(&sigset, &signum);
         run_condition.store(false);
         fmt::print("Shutting down...\n");
-
-        // Quick and dirty to stop waiting for accept in the web server
-        // Maybe improve this later
-        try {
-            net::tcp_connection<net::ip_version::v4> sock {"127.0.0.1", WEBSERVER_PORT};
-        } catch(std::runtime_error& err) {}
-
         return signum;
     });
 
@@ -141,19 +179,62 @@ int main()
         return EXIT_FAILURE;
     }
 
+    http::server_config config;
+    config.workers = 0; // One worker per core
+    config.engine = http::io_engine::io_uring; // Falls back to epoll on older kernels
+    config.tls = false; // Receivers reject the self-signed certificate, only enable it with a CA signed one
+    http::webserver server {WEBSERVER_PORT, SSL_CERT, SSL_KEY, config};
+    std::string base_url = fmt::format("{}://{}:{}", (config.tls) ? "https" : "http", utils::get_local_ipaddr(),
+        WEBSERVER_PORT);
+
+    // Receivers start MP4 files without fetching the index from the end first
+    server.add_file_transform("video/mp4", mp4::faststart);
+
+    // The live stream is kept in memory and served below /live/ as Low-Latency
+    // HLS, a replayed test stream stands in for the encoded desktop capture.
+    // Every published part retries the parked playlist and preload hint requests
+    hls::live_config live_config;
+    live_config.target_duration = std::chrono::seconds {2};
+    live_config.part_target = std::chrono::milliseconds {500};
+    hls::live_stream live {live_config};
+    live.set_listener([&server]() { server.notify(); });
+    server.add_route("/live/", http::match_kind::prefix, http::methods::read, [&live](const http::request& req, http::response& res) {
+        live.serve(req.get_path().substr(6), req, res);
+    });
+
+    // Recordings below the media root are played from /vod/<name>.m3u8 in
+    // byte range segments of the unchanged file, MP4 files are remuxed into
+    // fragmented MP4 segments on demand. Requests wait parked while a file is indexed
+    hls::vod_library vod {config.media_root};
+    vod.set_listener([&server]() { server.notify(); });
+    server.add_route("/vod/", http::match_kind::prefix, http::methods::read, [&vod](const http::request& req, http::response& res) {
+        vod.serve(req.get_path().substr(5), req, res);
+    });
+
+    // Images are scaled down to the resolution of the receiver and cached per resolution
+    image::image_library images {config.media_root};
+    images.set_listener([&server]() { server.notify(); });
+    server.add_route("/image/", http::match_kind::prefix, http::methods::read, [&images](const http::request& req, http::response& res) {
+        images.serve(req.get_path().substr(7), req, res);
+    });
+
     std::vector<std::thread> worker;
     worker.reserve(2);
-    worker.emplace_back([&run_condition]() {
-        http::webserver server {WEBSERVER_PORT, SSL_CERT, SSL_KEY};
+    worker.emplace_back([&run_condition, &server]() {
         server.serve(run_condition);
     });
-    // worker.emplace_back(init_capture, std::ref(run_condition));
+    worker.emplace_back([&run_condition, &live, &config]() {
+        replay_stream(live, config.media_root + "/index0.ts", run_condition);
+    });
 
     googlecast::default_media_receiver dmr {*reinterpret_cast<googlecast::cast_device*>(device.get())};
-    bool launch_flag = dmr.set_media(googlecast::media_data {
-        fmt::format("http://{}:5770/index.m3u8", utils::get_local_ipaddr()),
+    googlecast::media_data media {
+        fmt::format("{}/live/index.m3u8", base_url),
         "application/x-mpegurl"
-    });
+    };
+    if(!image_path.empty())
+        media = googlecast::media_data {fmt::format("{}/image/{}", base_url, image_path), "image/jpeg"};
+    bool launch_flag = dmr.set_media(media);
     fmt::print("Status: {}", (launch_flag) ? "Launched" : "Launch error");
 
     // Wait for signal and shut down all threads
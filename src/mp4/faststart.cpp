@@ -0,0 +1,186 @@
+#include "mp4/faststart.hpp"
+#include "mp4/box.hpp"
+
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace mp4
+{
+
+/// Boxes on the path from moov to the chunk offset tables
+static constexpr std::array<uint32_t, 5> container_boxes {
+    fourcc("moov"), fourcc("trak"), fourcc("mdia"), fourcc("minf"), fourcc("stbl")
+};
+
+// Where the bytes of the original file end up in the spliced layout
+struct relocation
+{
+    uint64_t media_begin;               /// first mdat, everything from here on moves behind moov
+    uint64_t moov_begin;
+    uint64_t moov_end;
+    uint64_t moov_size;                 /// after rewriting
+
+    uint64_t map(uint64_t offset) const
+    {
+        if(offset >= moov_end)
+            return offset - (moov_end - moov_begin) + moov_size;
+        if(offset >= media_begin)
+            return offset + moov_size;
+        return offset;
+    }
+};
+
+/**
+ * Reads a range of the file from the cached content or with its descriptor
+ */
+static std::string read_range(const http::cached_file& entry, uint64_t offset, size_t length)
+{
+    if(entry.content)
+        return entry.content->substr(offset, length);
+    return entry.file->read_range(offset, length);
+}
+
+/**
+ * Copies the payload of a stco or co64 box with relocated offsets, stco is
+ * written as co64 if use_co64 is set. Sets overflow if a relocated offset
+ * does not fit into stco
+ */
+static void rewrite_chunk_offsets(const uint8_t* payload, uint64_t size, bool is_co64, const relocation& r,
+    bool use_co64, std::string& out, bool& overflow)
+{
+    if(size < 8)
+        throw std::runtime_error {"Truncated chunk offset box"};
+    uint32_t count = read_u32(payload + 4);
+    size_t entry_size = (is_co64) ? 8 : 4;
+    if(size < 8 + static_cast<uint64_t>(count) * entry_size)
+        throw std::runtime_error {"Truncated chunk offset box"};
+
+    bool to_co64 = is_co64 || use_co64;
+    append_box_header(out, (to_co64) ? fourcc("co64") : fourcc("stco"), 8 + static_cast<uint64_t>(count) * ((to_co64) ? 8 : 4));
+    out.append(reinterpret_cast<const char*>(payload), 8);     // version, flags and entry count
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        const uint8_t* p = payload + 8 + i * entry_size;
+        uint64_t offset = r.map((is_co64) ? read_u64(p) : read_u32(p));
+        if(to_co64)
+        {
+            append_u64(out, offset);
+            continue;
+        }
+        if(offset > UINT32_MAX)
+            overflow = true;
+        append_u32(out, static_cast<uint32_t>(offset));
+    }
+}
+
+/**
+ * Copies the box, containers on the way to the chunk offset tables are
+ * rebuilt because the size of their children may change
+ */
+static void rewrite_box(const uint8_t* data, const box& b, const relocation& r, bool use_co64, std::string& out,
+    bool& overflow)
+{
+    const uint8_t* payload = data + b.offset + b.header_size;
+    uint64_t payload_size = b.size - b.header_size;
+
+    if(b.type == fourcc("stco") || b.type == fourcc("co64"))
+    {
+        rewrite_chunk_offsets(payload, payload_size, b.type == fourcc("co64"), r, use_co64, out, overflow);
+        return;
+    }
+    if(std::find(container_boxes.begin(), container_boxes.end(), b.type) == container_boxes.end())
+    {
+        out.append(reinterpret_cast<const char*>(data + b.offset), b.size);
+        return;
+    }
+
+    std::string children;
+    for(uint64_t offset = 0; offset < payload_size; )
+    {
+        std::optional<box> child = parse_box(payload + offset, payload_size - offset, offset, payload_size - offset);
+        if(!child)
+            throw std::runtime_error {"Broken MP4 box structure"};
+        rewrite_box(payload, *child, r, use_co64, children, overflow);
+        offset += child->size;
+    }
+    append_box_header(out, b.type, children.size());
+    out.append(children);
+}
+
+std::shared_ptr<const http::spliced_file> faststart(const http::cached_file& entry)
+{
+    uint64_t size = entry.size;
+    std::optional<box> moov;
+    std::optional<box> mdat;
+    for(uint64_t offset = 0; offset < size; )
+    {
+        std::string header = read_range(entry, offset, static_cast<size_t>(std::min<uint64_t>(16, size - offset)));
+        std::optional<box> b = parse_box(reinterpret_cast<const uint8_t*>(header.data()), header.size(), offset, size - offset);
+        if(!b)
+            throw std::runtime_error {"Broken MP4 box structure"};
+
+        if(b->type == fourcc("moov") && !moov)
+            moov = b;
+        else if(b->type == fourcc("mdat") && !mdat)
+            mdat = b;
+        offset += b->size;
+    }
+
+    if(!moov || !mdat || moov->offset < mdat->offset)
+        return nullptr;
+    if(moov->size > max_moov_size)
+        throw std::runtime_error {"moov box too large"};
+
+    std::string original = read_range(entry, moov->offset, moov->size);
+    const auto* data = reinterpret_cast<const uint8_t*>(original.data());
+    box local {moov->type, 0, moov->size, moov->header_size};
+
+    // The offsets depend on the size of the rewritten moov, which only changes
+    // if 32 bit chunk offsets overflow and are widened, so this settles quickly
+    relocation r {mdat->offset, moov->offset, moov->offset + moov->size, moov->size};
+    bool use_co64 = false;
+    std::string rewritten;
+    for(int pass = 0; ; ++pass)
+    {
+        if(pass == 4)
+            throw std::runtime_error {"Chunk offsets do not settle"};
+
+        bool overflow = false;
+        rewritten.clear();
+        rewrite_box(data, local, r, use_co64, rewritten, overflow);
+        if(overflow)
+        {
+            use_co64 = true;
+            continue;
+        }
+        if(rewritten.size() == r.moov_size)
+            break;
+        r.moov_size = rewritten.size();
+    }
+
+    auto moov_data = std::make_shared<const std::string>(std::move(rewritten));
+    auto spliced = std::make_shared<http::spliced_file>();
+    auto add_range = [&](uint64_t begin, uint64_t end) {
+        if(begin == end)
+            return;
+        if(entry.content)
+            spliced->pieces.push_back(http::memory_body {entry.content, std::string_view {*entry.content}.substr(begin, end - begin)});
+        else
+            spliced->pieces.push_back(http::file_body {entry.file, begin, end - begin});
+        spliced->size += end - begin;
+    };
+
+    add_range(0, mdat->offset);
+    spliced->pieces.push_back(http::memory_body {moov_data, *moov_data});
+    spliced->size += moov_data->size();
+    spliced->memory = moov_data->size();
+    add_range(mdat->offset, moov->offset);
+    add_range(moov->offset + moov->size, size);
+    return spliced;
+}
+
+} // namespace mp4
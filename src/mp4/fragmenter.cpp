@@ -0,0 +1,305 @@
+#include "mp4/fragmenter.hpp"
+#include "mp4/box.hpp"
+
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+namespace mp4
+{
+
+/// Sample flags of trun, sync samples do not depend on others
+static constexpr uint32_t sync_sample_flags = 0x02000000;
+static constexpr uint32_t non_sync_sample_flags = 0x01010000;
+
+/// data-offset, sample-duration, sample-size, sample-flags and sample-composition-time-offset present
+static constexpr uint32_t trun_flags = 0x000001 | 0x000100 | 0x000200 | 0x000400 | 0x000800;
+
+/// Offsets in trun are relative to the moof box
+static constexpr uint32_t tfhd_default_base_is_moof = 0x020000;
+
+/**
+ * Appends the header of a box whose size is patched by end_box, returns its position
+ */
+static size_t begin_box(std::string& out, uint32_t type)
+{
+    size_t start = out.size();
+    append_u32(out, 0);
+    append_u32(out, type);
+    return start;
+}
+
+static void end_box(std::string& out, size_t start)
+{
+    write_u32(out.data() + start, static_cast<uint32_t>(out.size() - start));
+}
+
+/**
+ * Appends a full box without entries, the sample tables of a fragmented file are empty
+ */
+static void append_empty_table(std::string& out, uint32_t type, size_t fields)
+{
+    size_t start = begin_box(out, type);
+    for(size_t i = 0; i < fields; ++i)
+        append_u32(out, 0);
+    end_box(out, start);
+}
+
+/**
+ * Appends a copy of a movie, track or media header with its duration set to
+ * zero, players take a non-zero duration for the length of the init segment
+ * v0_offset and v1_offset locate the duration in the payload of both versions
+ * Returns the duration of the copied box
+ */
+static uint64_t append_without_duration(std::string& out, std::string_view header, size_t v0_offset, size_t v1_offset)
+{
+    std::optional<box> b = parse_box(reinterpret_cast<const uint8_t*>(header.data()), header.size(), 0, header.size());
+    if(!b || b->size - b->header_size < 1)
+        throw std::runtime_error {"Broken MP4 header box"};
+
+    size_t start = out.size();
+    out.append(header);
+    auto* payload = reinterpret_cast<uint8_t*>(out.data() + start + b->header_size);
+    bool v1 = payload[0] == 1;
+    size_t offset = (v1) ? v1_offset : v0_offset;
+    size_t width = (v1) ? 8 : 4;
+    if(b->size - b->header_size < offset + width)
+        throw std::runtime_error {"Truncated MP4 header box"};
+
+    uint64_t duration = (v1) ? read_u64(payload + offset) : read_u32(payload + offset);
+    std::fill_n(payload + offset, width, 0);
+    return duration;
+}
+
+static std::string build_init_segment(const movie& m)
+{
+    std::string out;
+    size_t ftyp = begin_box(out, fourcc("ftyp"));
+    append_u32(out, fourcc("iso6"));
+    append_u32(out, 0);
+    append_u32(out, fourcc("iso6"));
+    append_u32(out, fourcc("cmfc"));
+    append_u32(out, fourcc("isom"));
+    end_box(out, ftyp);
+
+    // The length of a fragmented movie is the sum of its fragments, the
+    // duration of the progressive file only moves to mehd
+    size_t moov = begin_box(out, fourcc("moov"));
+    uint64_t duration = append_without_duration(out, m.mvhd, 16, 24);
+    for(const auto& t : m.tracks)
+    {
+        size_t trak = begin_box(out, fourcc("trak"));
+        append_without_duration(out, t.tkhd, 20, 28);
+        size_t mdia = begin_box(out, fourcc("mdia"));
+        append_without_duration(out, t.mdhd, 16, 24);
+        out.append(t.hdlr);
+        size_t minf = begin_box(out, fourcc("minf"));
+        out.append(t.media_header);
+
+        // The media data is in the same file, a single self-contained url entry
+        size_t dinf = begin_box(out, fourcc("dinf"));
+        size_t dref = begin_box(out, fourcc("dref"));
+        append_u32(out, 0);
+        append_u32(out, 1);
+        append_u32(out, 12);
+        append_u32(out, fourcc("url "));
+        append_u32(out, 1);
+        end_box(out, dref);
+        end_box(out, dinf);
+
+        size_t stbl = begin_box(out, fourcc("stbl"));
+        out.append(t.stsd);
+        append_empty_table(out, fourcc("stts"), 2);
+        append_empty_table(out, fourcc("stsc"), 2);
+        append_empty_table(out, fourcc("stsz"), 3);
+        append_empty_table(out, fourcc("stco"), 2);
+        end_box(out, stbl);
+        end_box(out, minf);
+        end_box(out, mdia);
+        end_box(out, trak);
+    }
+
+    // Every sample is described in trun, the defaults are never used
+    size_t mvex = begin_box(out, fourcc("mvex"));
+    size_t mehd = begin_box(out, fourcc("mehd"));
+    append_u32(out, 0x01000000);
+    append_u64(out, duration);
+    end_box(out, mehd);
+    for(const auto& t : m.tracks)
+    {
+        size_t trex = begin_box(out, fourcc("trex"));
+        append_u32(out, 0);
+        append_u32(out, t.id);
+        append_u32(out, 1);
+        append_u32(out, 0);
+        append_u32(out, 0);
+        append_u32(out, 0);
+        end_box(out, trex);
+    }
+    end_box(out, mvex);
+    end_box(out, moov);
+    return out;
+}
+
+fragmenter::fragmenter(std::shared_ptr<const http::file_handle> file, std::chrono::milliseconds target)
+    : m_file {std::move(file)}, m_movie {read_movie(*m_file)}
+{
+    m_init = std::make_shared<const std::string>(build_init_segment(m_movie));
+
+    for(const auto& t : m_movie.tracks)
+    {
+        for(const auto& s : t.samples)
+        {
+            if(s.offset + s.size > m_file->size())
+                throw std::runtime_error {"MP4 sample outside of the file"};
+        }
+    }
+
+    // Cut the first track at sync samples, players have to start decoding every fragment
+    const track& primary = m_movie.tracks.front();
+    uint64_t step = std::max<uint64_t>(target.count() * primary.timescale / 1000, 1);
+    std::vector<size_t> starts {0};
+    for(size_t i = 1; i < primary.samples.size(); ++i)
+    {
+        const sample& s = primary.samples[i];
+        if(s.sync && s.decode_time - primary.samples[starts.back()].decode_time >= step)
+            starts.push_back(i);
+    }
+
+    const sample& last = primary.samples.back();
+    uint64_t end_time = last.decode_time + last.duration;
+    m_cuts.resize(starts.size());
+    for(size_t k = 0; k < starts.size(); ++k)
+    {
+        cut& c = m_cuts[k];
+        uint64_t begin = primary.samples[starts[k]].decode_time;
+        uint64_t end = (k + 1 < starts.size()) ? primary.samples[starts[k + 1]].decode_time : end_time;
+        c.duration = static_cast<double>(end - begin) / primary.timescale;
+
+        // Other tracks are split at the same time, converted into their timescale
+        c.first.push_back(starts[k]);
+        c.end.push_back((k + 1 < starts.size()) ? starts[k + 1] : primary.samples.size());
+        for(size_t t = 1; t < m_movie.tracks.size(); ++t)
+        {
+            const track& other = m_movie.tracks[t];
+            auto split = [&](uint64_t time) {
+                return static_cast<size_t>(std::partition_point(other.samples.begin(), other.samples.end(),
+                    [&](const sample& s) { return s.decode_time * primary.timescale < time * other.timescale; }) -
+                    other.samples.begin());
+            };
+            c.first.push_back((k == 0) ? 0 : split(begin));
+            c.end.push_back((k + 1 == starts.size()) ? other.samples.size() : split(end));
+        }
+    }
+    m_fragments.resize(m_cuts.size());
+}
+
+std::shared_ptr<const http::spliced_file> fragmenter::fragment(size_t index)
+{
+    if(index >= m_cuts.size())
+        throw std::out_of_range {"No such MP4 fragment"};
+
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        if(m_fragments[index])
+            return m_fragments[index];
+    }
+
+    // Built without the lock, two workers building the same fragment get equal results
+    std::shared_ptr<const http::spliced_file> built = build(index);
+    std::lock_guard<std::mutex> lock {m_mutex};
+    if(!m_fragments[index])
+        m_fragments[index] = std::move(built);
+    return m_fragments[index];
+}
+
+std::shared_ptr<const http::spliced_file> fragmenter::build(size_t index) const
+{
+    const cut& c = m_cuts[index];
+    auto header = std::make_shared<std::string>();
+    std::string& out = *header;
+
+    size_t moof = begin_box(out, fourcc("moof"));
+    size_t mfhd = begin_box(out, fourcc("mfhd"));
+    append_u32(out, 0);
+    append_u32(out, static_cast<uint32_t>(index + 1));
+    end_box(out, mfhd);
+
+    std::vector<size_t> data_offsets;               /// position of the data offset of every trun
+    std::vector<uint64_t> track_bytes;
+    for(size_t t = 0; t < m_movie.tracks.size(); ++t)
+    {
+        const track& tr = m_movie.tracks[t];
+        if(c.first[t] == c.end[t])
+            continue;
+
+        size_t traf = begin_box(out, fourcc("traf"));
+        size_t tfhd = begin_box(out, fourcc("tfhd"));
+        append_u32(out, tfhd_default_base_is_moof);
+        append_u32(out, tr.id);
+        end_box(out, tfhd);
+
+        size_t tfdt = begin_box(out, fourcc("tfdt"));
+        append_u32(out, 0x01000000);
+        append_u64(out, tr.samples[c.first[t]].decode_time);
+        end_box(out, tfdt);
+
+        // Version 1 allows negative composition offsets, the first sample is
+        // moved to presentation time zero like an edit list would
+        int32_t shift = tr.samples.front().composition_offset;
+        size_t trun = begin_box(out, fourcc("trun"));
+        append_u32(out, 0x01000000 | trun_flags);
+        append_u32(out, static_cast<uint32_t>(c.end[t] - c.first[t]));
+        data_offsets.push_back(out.size());
+        append_u32(out, 0);
+        uint64_t bytes = 0;
+        for(size_t i = c.first[t]; i < c.end[t]; ++i)
+        {
+            const sample& s = tr.samples[i];
+            append_u32(out, s.duration);
+            append_u32(out, s.size);
+            append_u32(out, (s.sync) ? sync_sample_flags : non_sync_sample_flags);
+            append_u32(out, static_cast<uint32_t>(s.composition_offset - shift));
+            bytes += s.size;
+        }
+        end_box(out, trun);
+        end_box(out, traf);
+        track_bytes.push_back(bytes);
+    }
+    end_box(out, moof);
+
+    uint64_t payload = 0;
+    for(uint64_t bytes : track_bytes)
+        payload += bytes;
+    append_box_header(out, fourcc("mdat"), payload);
+
+    // The samples of every track follow each other in the mdat box
+    uint64_t position = out.size();
+    for(size_t i = 0; i < data_offsets.size(); ++i)
+    {
+        write_u32(out.data() + data_offsets[i], static_cast<uint32_t>(position));
+        position += track_bytes[i];
+    }
+
+    auto result = std::make_shared<http::spliced_file>();
+    result->pieces.push_back(http::memory_body {header, std::string_view {*header}});
+    result->size = out.size() + payload;
+    result->memory = out.size();
+    for(size_t t = 0; t < m_movie.tracks.size(); ++t)
+    {
+        // Samples stored back to back in the file are sent as one range
+        for(size_t i = c.first[t]; i < c.end[t]; ++i)
+        {
+            const sample& s = m_movie.tracks[t].samples[i];
+            auto* previous = std::get_if<http::file_body>(&result->pieces.back());
+            if(previous && previous->offset + previous->length == s.offset)
+                previous->length += s.size;
+            else
+                result->pieces.push_back(http::file_body {m_file, s.offset, s.size});
+        }
+    }
+    return result;
+}
+
+} // namespace mp4
@@ -0,0 +1,257 @@
+#include "mp4/movie.hpp"
+#include "mp4/box.hpp"
+
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+namespace mp4
+{
+
+// Payload of a box within the moov data
+struct view
+{
+    const uint8_t* data;
+    uint64_t size;
+};
+
+static view payload_of(view parent, const box& b)
+{
+    return view {parent.data + b.offset + b.header_size, b.size - b.header_size};
+}
+
+static std::string_view bytes_of(view parent, const box& b)
+{
+    return std::string_view {reinterpret_cast<const char*>(parent.data + b.offset), b.size};
+}
+
+static std::optional<view> find_payload(view parent, uint32_t type)
+{
+    std::optional<box> b = find_box(parent.data, parent.size, type);
+    if(!b)
+        return std::nullopt;
+    return payload_of(parent, *b);
+}
+
+static view require_payload(view parent, uint32_t type)
+{
+    std::optional<view> v = find_payload(parent, type);
+    if(!v)
+        throw std::runtime_error {"Missing MP4 box"};
+    return *v;
+}
+
+static std::string require_box(view parent, uint32_t type)
+{
+    std::optional<box> b = find_box(parent.data, parent.size, type);
+    if(!b)
+        throw std::runtime_error {"Missing MP4 box"};
+    return std::string {bytes_of(parent, *b)};
+}
+
+/**
+ * Returns the entry count of a full box table and checks that all entries fit
+ */
+static uint32_t table_entries(view table, size_t header, size_t entry_size)
+{
+    if(table.size < header)
+        throw std::runtime_error {"Truncated MP4 sample table"};
+    uint32_t count = read_u32(table.data + header - 4);
+    if(table.size < header + static_cast<uint64_t>(count) * entry_size)
+        throw std::runtime_error {"Truncated MP4 sample table"};
+    return count;
+}
+
+/**
+ * Expands the run length coded tables of the sample table box into samples
+ */
+static void read_samples(view stbl, track& t)
+{
+    view stsz = require_payload(stbl, fourcc("stsz"));
+    if(stsz.size < 12)
+        throw std::runtime_error {"Truncated MP4 sample table"};
+    uint32_t uniform_size = read_u32(stsz.data + 4);
+    uint32_t count = read_u32(stsz.data + 8);
+    if(uniform_size == 0 && stsz.size < 12 + static_cast<uint64_t>(count) * 4)
+        throw std::runtime_error {"Truncated MP4 sample table"};
+
+    t.samples.resize(count);
+    for(uint32_t i = 0; i < count; ++i)
+        t.samples[i].size = (uniform_size != 0) ? uniform_size : read_u32(stsz.data + 12 + i * 4);
+
+    // Decoding times
+    view stts = require_payload(stbl, fourcc("stts"));
+    uint32_t runs = table_entries(stts, 8, 8);
+    uint64_t time = 0;
+    size_t index = 0;
+    for(uint32_t r = 0; r < runs && index < count; ++r)
+    {
+        uint32_t run = read_u32(stts.data + 8 + r * 8);
+        uint32_t delta = read_u32(stts.data + 12 + r * 8);
+        for(uint32_t i = 0; i < run && index < count; ++i, ++index)
+        {
+            t.samples[index].decode_time = time;
+            t.samples[index].duration = delta;
+            time += delta;
+        }
+    }
+    if(index < count)
+        throw std::runtime_error {"MP4 time table does not cover all samples"};
+
+    // Composition offsets, version 0 offsets are unsigned but never that large in practice
+    if(std::optional<view> ctts = find_payload(stbl, fourcc("ctts")); ctts)
+    {
+        runs = table_entries(*ctts, 8, 8);
+        index = 0;
+        for(uint32_t r = 0; r < runs && index < count; ++r)
+        {
+            uint32_t run = read_u32(ctts->data + 8 + r * 8);
+            auto offset = static_cast<int32_t>(read_u32(ctts->data + 12 + r * 8));
+            for(uint32_t i = 0; i < run && index < count; ++i, ++index)
+                t.samples[index].composition_offset = offset;
+        }
+    }
+
+    // Without a sync sample table every sample is a sync sample
+    if(std::optional<view> stss = find_payload(stbl, fourcc("stss")); stss)
+    {
+        uint32_t entries = table_entries(*stss, 8, 4);
+        for(uint32_t i = 0; i < entries; ++i)
+        {
+            uint32_t number = read_u32(stss->data + 8 + i * 4);
+            if(number >= 1 && number <= count)
+                t.samples[number - 1].sync = true;
+        }
+    }
+    else
+    {
+        for(auto& s : t.samples)
+            s.sync = true;
+    }
+
+    // File offsets from the chunk offsets and the samples per chunk
+    std::optional<view> chunk_table = find_payload(stbl, fourcc("stco"));
+    bool wide = !chunk_table;
+    if(wide)
+        chunk_table = require_payload(stbl, fourcc("co64"));
+    uint32_t chunks = table_entries(*chunk_table, 8, (wide) ? 8 : 4);
+    auto chunk_offset = [&](uint32_t chunk) -> uint64_t {
+        const uint8_t* p = chunk_table->data + 8 + chunk * ((wide) ? 8 : 4);
+        return (wide) ? read_u64(p) : read_u32(p);
+    };
+
+    view stsc = require_payload(stbl, fourcc("stsc"));
+    uint32_t groups = table_entries(stsc, 8, 12);
+    index = 0;
+    for(uint32_t g = 0; g < groups && index < count; ++g)
+    {
+        uint32_t first_chunk = read_u32(stsc.data + 8 + g * 12);
+        uint32_t per_chunk = read_u32(stsc.data + 12 + g * 12);
+        uint32_t last_chunk = (g + 1 < groups) ? read_u32(stsc.data + 8 + (g + 1) * 12) : chunks + 1;
+        if(first_chunk == 0 || last_chunk > chunks + 1)
+            throw std::runtime_error {"Broken MP4 chunk table"};
+
+        for(uint32_t chunk = first_chunk; chunk < last_chunk && index < count; ++chunk)
+        {
+            uint64_t offset = chunk_offset(chunk - 1);
+            for(uint32_t i = 0; i < per_chunk && index < count; ++i, ++index)
+            {
+                t.samples[index].offset = offset;
+                offset += t.samples[index].size;
+            }
+        }
+    }
+    if(index < count)
+        throw std::runtime_error {"MP4 chunk table does not cover all samples"};
+}
+
+static std::optional<track> read_track(view trak)
+{
+    view mdia = require_payload(trak, fourcc("mdia"));
+    view hdlr = require_payload(mdia, fourcc("hdlr"));
+    if(hdlr.size < 12)
+        throw std::runtime_error {"Truncated MP4 handler box"};
+
+    track t {};
+    t.handler = read_u32(hdlr.data + 8);
+    if(t.handler != fourcc("vide") && t.handler != fourcc("soun"))
+        return std::nullopt;
+
+    view tkhd = require_payload(trak, fourcc("tkhd"));
+    view mdhd = require_payload(mdia, fourcc("mdhd"));
+    bool tkhd_v1 = tkhd.size > 0 && tkhd.data[0] == 1;
+    bool mdhd_v1 = mdhd.size > 0 && mdhd.data[0] == 1;
+    if(tkhd.size < ((tkhd_v1) ? 24u : 16u) || mdhd.size < ((mdhd_v1) ? 24u : 16u))
+        throw std::runtime_error {"Truncated MP4 track header"};
+    t.id = read_u32(tkhd.data + ((tkhd_v1) ? 20 : 12));
+    t.timescale = read_u32(mdhd.data + ((mdhd_v1) ? 20 : 12));
+    if(t.timescale == 0)
+        throw std::runtime_error {"MP4 track without timescale"};
+
+    view minf = require_payload(mdia, fourcc("minf"));
+    view stbl = require_payload(minf, fourcc("stbl"));
+    t.tkhd = require_box(trak, fourcc("tkhd"));
+    t.mdhd = require_box(mdia, fourcc("mdhd"));
+    t.hdlr = require_box(mdia, fourcc("hdlr"));
+    t.media_header = require_box(minf, (t.handler == fourcc("vide")) ? fourcc("vmhd") : fourcc("smhd"));
+    t.stsd = require_box(stbl, fourcc("stsd"));
+    read_samples(stbl, t);
+    return t;
+}
+
+movie read_movie(const http::file_handle& file)
+{
+    // Only the headers of the top-level boxes are read to find moov
+    std::optional<box> moov;
+    for(uint64_t offset = 0; offset < file.size(); )
+    {
+        std::string header = file.read_range(offset, static_cast<size_t>(std::min<uint64_t>(16, file.size() - offset)));
+        std::optional<box> b = parse_box(reinterpret_cast<const uint8_t*>(header.data()), header.size(), offset, file.size() - offset);
+        if(!b)
+            throw std::runtime_error {"Broken MP4 box structure"};
+        if(b->type == fourcc("moov"))
+        {
+            moov = b;
+            break;
+        }
+        offset += b->size;
+    }
+    if(!moov)
+        throw std::runtime_error {"MP4 file without moov box"};
+    if(moov->size > max_moov_size)
+        throw std::runtime_error {"moov box too large"};
+
+    std::string data = file.read_range(moov->offset + moov->header_size, moov->size - moov->header_size);
+    view payload {reinterpret_cast<const uint8_t*>(data.data()), data.size()};
+    if(find_box(payload.data, payload.size, fourcc("mvex")))
+        throw std::runtime_error {"MP4 file is already fragmented"};
+
+    movie m {};
+    m.mvhd = require_box(payload, fourcc("mvhd"));
+    view mvhd = require_payload(payload, fourcc("mvhd"));
+    if(mvhd.size < ((mvhd.size > 0 && mvhd.data[0] == 1) ? 24u : 16u))
+        throw std::runtime_error {"Truncated MP4 movie header"};
+    m.timescale = read_u32(mvhd.data + ((mvhd.data[0] == 1) ? 20 : 12));
+
+    for(uint64_t offset = 0; offset < payload.size; )
+    {
+        std::optional<box> child = parse_box(payload.data + offset, payload.size - offset, offset, payload.size - offset);
+        if(!child)
+            throw std::runtime_error {"Broken MP4 box structure"};
+        if(child->type == fourcc("trak"))
+        {
+            if(std::optional<track> t = read_track(payload_of(payload, *child)); t && !t->samples.empty())
+                m.tracks.push_back(std::move(*t));
+        }
+        offset += child->size;
+    }
+
+    // Segments are cut at the sync samples of the first track
+    std::stable_partition(m.tracks.begin(), m.tracks.end(), [](const track& t) { return t.handler == fourcc("vide"); });
+    if(m.tracks.empty())
+        throw std::runtime_error {"MP4 file without audio or video track"};
+    return m;
+}
+
+} // namespace mp4